@@ -0,0 +1,69 @@
+#include "AxisAutoscaler.h"
+#include <algorithm>
+#include <cmath>
+
+
+/**
+ * Move the start of the window to sequence number seq_begin.
+ *
+ * If samples before seq_begin were never added (e.g. the variable was
+ * scrolled out of view), adding restarts at seq_begin.
+ */
+void AxisAutoscaler::set_window(uint64_t seq_begin)
+{
+    _window.evict_before(seq_begin);
+    if (_seq_next < seq_begin) {
+        _seq_next = seq_begin;
+    }
+}
+
+
+/**
+ * Add the sample with sequence number seq to the window.
+ * Samples must be added in order, without gaps after seq_next().
+ */
+void AxisAutoscaler::add(uint64_t seq, float v)
+{
+    if (std::isfinite(v)) {
+        _window.push(seq, v);
+    }
+    _seq_next = seq + 1;
+}
+
+
+/**
+ * Move axis limits towards the range of the window.
+ *
+ * @param   dt
+ *          [ms] time since the last update
+ *
+ * @return  false if the limits were not changed (empty window)
+ */
+bool AxisAutoscaler::update(float dt, float& v_lim_lower, float& v_lim_upper)
+{
+    if (_window.empty()) {
+        return false;
+    }
+
+    float v_min = _window.min();
+    float v_max = _window.max();
+    float range = v_max - v_min;
+    if (range <= 1e-6f * std::max(std::fabs(v_min), std::fabs(v_max))) {
+        // Flat signal: center it instead of dividing by zero
+        range = (v_max != 0.0f) ? std::fabs(v_max) : 1.0f;
+    }
+    float target_lower = v_min - margin * range;
+    float target_upper = v_max + margin * range;
+
+    if (!_initialized) {
+        v_lim_lower = target_lower;
+        v_lim_upper = target_upper;
+        _initialized = true;
+        return true;
+    }
+
+    float alpha = 1.0f - std::exp(-dt / tau);
+    v_lim_lower += alpha * (target_lower - v_lim_lower);
+    v_lim_upper += alpha * (target_upper - v_lim_upper);
+    return true;
+}
@@ -0,0 +1,96 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+
+/**
+ * Minimum and maximum of a sliding window over a sequence of values.
+ *
+ * Each deque holds the values that can still become the extremum once
+ * older ones leave the window, in window order. A new value removes all
+ * values it dominates from the back, the window start removes values
+ * from the front, so every value is pushed and popped at most once:
+ * O(1) amortized per value and no rescans of the window.
+ */
+class SlidingMinMax
+{
+  public:
+    /**
+     * Add the value with sequence number seq (increasing between calls).
+     */
+    void push(uint64_t seq, float v) {
+        while (!_max.empty() && _max.back().v <= v) {
+            _max.pop_back();
+        }
+        _max.push_back({seq, v});
+        while (!_min.empty() && _min.back().v >= v) {
+            _min.pop_back();
+        }
+        _min.push_back({seq, v});
+    }
+
+    /**
+     * Remove values with sequence number < seq from the window.
+     */
+    void evict_before(uint64_t seq) {
+        while (!_max.empty() && _max.front().seq < seq) {
+            _max.pop_front();
+        }
+        while (!_min.empty() && _min.front().seq < seq) {
+            _min.pop_front();
+        }
+    }
+
+    void clear() {
+        _max.clear();
+        _min.clear();
+    }
+
+    bool empty() const { return _max.empty(); }
+    float min() const { return _min.front().v; }
+    float max() const { return _max.front().v; }
+
+  private:
+    typedef struct {
+        uint64_t seq;
+        float v;
+    } entry_t;
+
+    std::deque<entry_t> _max; // decreasing values
+    std::deque<entry_t> _min; // increasing values
+};
+
+
+/**
+ * Axis limits that follow the range of the samples in the plotting window.
+ *
+ * The render thread feeds each sample once, when it first enters the
+ * window, and tells us where the window starts. The limits approach the
+ * window range (plus a margin) exponentially, so the axis does not jump
+ * when a peak enters or leaves the window.
+ */
+class AxisAutoscaler
+{
+  public:
+    AxisAutoscaler() :
+        tau(300.0),
+        margin(0.05),
+        _seq_next(0),
+        _initialized(false) {}
+
+    void set_window(uint64_t seq_begin);
+    uint64_t seq_next() const { return _seq_next; }
+    void add(uint64_t seq, float v);
+
+    bool update(float dt, float& v_lim_lower, float& v_lim_upper);
+
+    float tau;    // [ms] time constant of axis transitions
+    float margin; // fraction of the range added above and below
+
+  private:
+    SlidingMinMax _window;
+    uint64_t _seq_next;  // sequence number of next sample to add
+    bool _initialized;   // false until limits were set once
+};
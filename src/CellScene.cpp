@@ -0,0 +1,306 @@
+#include "CellScene.h"
+#include "ColorMap.h"
+#include "MorphologyShading.h"
+#include <cmath>
+#include <cstddef> // offsetof
+#include <limits>
+
+
+namespace {
+
+// Cones of the template mesh, transformed per cell. The normal is
+// transformed with the same rows, which is exact for rotations with
+// uniform scale.
+const char* CELL_VERTEX_SHADER = R"(
+attribute vec4 cell_row0;
+attribute vec4 cell_row1;
+attribute vec4 cell_row2;
+attribute float cell_value;
+varying vec4 v_color;
+
+void main() {
+    vec4 p = vec4(gl_Vertex.xyz, 1.0);
+    vec3 pos = vec3(dot(cell_row0, p), dot(cell_row1, p), dot(cell_row2, p));
+    vec3 normal = vec3(dot(cell_row0.xyz, gl_Normal),
+                       dot(cell_row1.xyz, gl_Normal),
+                       dot(cell_row2.xyz, gl_Normal));
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(pos, 1.0);
+    v_color = vec4(value_color(cell_value) * headlight(normal), color.a);
+}
+)";
+
+// Sides of the cones: fewer than the single-cell view, since there
+// are many cells and each is small on screen
+const int CONE_SIDES = 6;
+
+
+/**
+ * Append a cone from a (radius ra) to b (radius rb) to the mesh arrays.
+ */
+void add_cone(const glm::vec3& a, float ra, const glm::vec3& b, float rb,
+              std::vector<glm::vec3>& vertices, std::vector<glm::vec3>& normals,
+              std::vector<ofIndexType>& indices)
+{
+    glm::vec3 axis = b - a;
+    float len = glm::length(axis);
+    glm::vec3 w = (len > 0.0f) ? axis / len : glm::vec3(0.0, 0.0, 1.0);
+    glm::vec3 helper = (std::abs(w.x) < 0.9f) ? glm::vec3(1.0, 0.0, 0.0)
+                                              : glm::vec3(0.0, 1.0, 0.0);
+    glm::vec3 u = glm::normalize(glm::cross(w, helper));
+    glm::vec3 v = glm::cross(w, u);
+
+    ofIndexType first = vertices.size();
+    for (int i = 0; i < CONE_SIDES; i++) {
+        float angle = TWO_PI * i / CONE_SIDES;
+        glm::vec3 normal = std::cos(angle) * u + std::sin(angle) * v;
+        vertices.push_back(a + ra * normal);
+        vertices.push_back(b + rb * normal);
+        normals.push_back(normal);
+        normals.push_back(normal);
+
+        ofIndexType i0 = first + 2 * i;
+        ofIndexType i1 = first + 2 * ((i + 1) % CONE_SIDES);
+        indices.insert(indices.end(), {i0, i1, i0 + 1, i0 + 1, i1, i1 + 1});
+    }
+}
+
+
+/**
+ * Rows of the transform: scale, then rotate about x, y and z
+ * (rotation in degrees), then translate.
+ */
+void make_transform(const glm::vec3& position, const glm::vec3& rotation, float scale,
+                    glm::vec4& row0, glm::vec4& row1, glm::vec4& row2)
+{
+    float cx = std::cos(ofDegToRad(rotation.x)), sx = std::sin(ofDegToRad(rotation.x));
+    float cy = std::cos(ofDegToRad(rotation.y)), sy = std::sin(ofDegToRad(rotation.y));
+    float cz = std::cos(ofDegToRad(rotation.z)), sz = std::sin(ofDegToRad(rotation.z));
+
+    // R = Rz * Ry * Rx
+    row0 = glm::vec4(scale * cz * cy, scale * (cz * sy * sx - sz * cx),
+                     scale * (cz * sy * cx + sz * sx), position.x);
+    row1 = glm::vec4(scale * sz * cy, scale * (sz * sy * sx + cz * cx),
+                     scale * (sz * sy * cx - cz * sx), position.y);
+    row2 = glm::vec4(scale * -sy, scale * cy * sx, scale * cy * cx, position.z);
+}
+
+} // namespace
+
+
+//==============================================================================
+// Setup
+
+/**
+ * Build the mesh of a morphology template. Must be called with
+ * a GL context.
+ *
+ * @return  index of the template for add_cell()
+ */
+size_t CellScene::add_template(const Morphology& morphology)
+{
+    const Morphology& m = morphology;
+    if (!_shader.isLoaded()) {
+        _setup_shader();
+    }
+
+    _templates.emplace_back(new template_t());
+    template_t& t = *_templates.back();
+    t.num_indices = 0;
+    t.center = glm::vec3(0.0);
+    t.extent = 0.0;
+    t.cell_capacity = 0;
+    if (m.num_points() == 0) {
+        return _templates.size() - 1;
+    }
+
+    glm::vec3 lo = point_at(m, 0);
+    glm::vec3 hi = lo;
+    for (size_t i = 0; i < m.num_points(); i++) {
+        lo = glm::min(lo, point_at(m, i));
+        hi = glm::max(hi, point_at(m, i));
+    }
+    t.center = 0.5f * (lo + hi);
+    t.extent = 0.5f * glm::length(hi - lo);
+
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<ofIndexType> indices;
+    vertices.reserve(2 * CONE_SIDES * m.num_points());
+    normals.reserve(2 * CONE_SIDES * m.num_points());
+    indices.reserve(6 * CONE_SIDES * m.num_points());
+    for (size_t s = 0; s < m.num_sections(); s++) {
+        const uint32_t* points = m.section_points.data() + m.section_begin(s);
+        size_t n = m.section_end(s) - m.section_begin(s);
+
+        // Single-point soma: a cone as wide as it is long
+        if (n == 1) {
+            glm::vec3 p = point_at(m, points[0]);
+            float r = m.radius[points[0]];
+            glm::vec3 dy(0.0, r, 0.0);
+            add_cone(p - dy, r, p + dy, r, vertices, normals, indices);
+            continue;
+        }
+        for (size_t i = 1; i < n; i++) {
+            add_cone(point_at(m, points[i - 1]), m.radius[points[i - 1]],
+                     point_at(m, points[i]), m.radius[points[i]],
+                     vertices, normals, indices);
+        }
+    }
+
+    t.mesh.setVertexData(vertices.data(), vertices.size(), GL_STATIC_DRAW);
+    t.mesh.setNormalData(normals.data(), normals.size(), GL_STATIC_DRAW);
+    t.mesh.setIndexData(indices.data(), indices.size(), GL_STATIC_DRAW);
+    t.num_indices = indices.size();
+    return _templates.size() - 1;
+}
+
+
+/**
+ * Place a cell in the scene.
+ *
+ * @param   rotation
+ *          [degrees] about the x, y and z axis, applied in that order
+ *
+ * @param   samples
+ *          variable coloring the cell (nullptr for none)
+ */
+void CellScene::add_cell(size_t template_index, const glm::vec3& position,
+                         const glm::vec3& rotation, float scale,
+                         std::shared_ptr<SampleBuffer> samples)
+{
+    template_t& t = *_templates[template_index];
+    cell_instance_t cell;
+    make_transform(position, rotation, scale, cell.row0, cell.row1, cell.row2);
+    cell.value = UNMAPPED_VALUE;
+    t.cells.push_back(cell);
+    t.samples.push_back(samples);
+
+    glm::vec4 c(t.center, 1.0);
+    t.bounds.push_back(glm::vec4(glm::dot(cell.row0, c), glm::dot(cell.row1, c),
+                                 glm::dot(cell.row2, c), std::abs(scale) * t.extent));
+    _num_cells++;
+}
+
+
+void CellScene::_setup_shader()
+{
+    std::string header = std::string("#version 120\n") + COLORMAP_GLSL
+                         + MORPHOLOGY_SHADING_GLSL;
+    _shader.setupShaderFromSource(GL_VERTEX_SHADER, header + CELL_VERTEX_SHADER);
+    _shader.setupShaderFromSource(GL_FRAGMENT_SHADER, MORPHOLOGY_FRAGMENT_SHADER);
+    _shader.bindDefaults();
+    _shader.linkProgram();
+}
+
+
+/**
+ * (Re)allocate the per-cell buffer of a template for all its cells
+ * and attach it to the template mesh.
+ */
+void CellScene::_attach_cell_buffer(template_t& t)
+{
+    t.cell_capacity = t.cells.size();
+    t.cell_buffer.allocate(t.cell_capacity * sizeof(cell_instance_t), GL_DYNAMIC_DRAW);
+
+    const char* rows[3] = {"cell_row0", "cell_row1", "cell_row2"};
+    size_t offsets[3] = {offsetof(cell_instance_t, row0), offsetof(cell_instance_t, row1),
+                         offsetof(cell_instance_t, row2)};
+    for (int i = 0; i < 3; i++) {
+        int loc = _shader.getAttributeLocation(rows[i]);
+        t.mesh.setAttributeBuffer(loc, t.cell_buffer, 4, sizeof(cell_instance_t), offsets[i]);
+        t.mesh.setAttributeDivisor(loc, 1);
+    }
+    int loc_value = _shader.getAttributeLocation("cell_value");
+    t.mesh.setAttributeBuffer(loc_value, t.cell_buffer, 1, sizeof(cell_instance_t),
+                              offsetof(cell_instance_t, value));
+    t.mesh.setAttributeDivisor(loc_value, 1);
+}
+
+
+//==============================================================================
+// Per frame
+
+/**
+ * Copy the newest sample of every cell's variable into its instance
+ * and upload the instances of each template (52 bytes per cell).
+ */
+void CellScene::update_values()
+{
+    for (auto& p_template : _templates) {
+        template_t& t = *p_template;
+        if (t.cells.empty() || t.num_indices == 0) {
+            continue;
+        }
+        for (size_t i = 0; i < t.cells.size(); i++) {
+            if (!t.samples[i]) {
+                continue;
+            }
+            auto view = t.samples[i]->snapshot();
+            if (!view.empty()) {
+                t.cells[i].value = view.back().v;
+            }
+        }
+
+        if (t.cell_capacity != t.cells.size()) {
+            _attach_cell_buffer(t);
+        }
+        t.cell_buffer.updateData(0, t.cells.size() * sizeof(cell_instance_t), t.cells.data());
+    }
+}
+
+
+/**
+ * Draw all cells, one instanced draw call per template (call between
+ * camera.begin() and end()).
+ */
+void CellScene::draw() const
+{
+    _shader.begin();
+    _shader.setUniform1f("v_lower", v_lim_lower);
+    _shader.setUniform1f("v_upper", v_lim_upper);
+    _shader.setUniform4f("color", color.r, color.g, color.b, color.a);
+    for (const auto& p_template : _templates) {
+        const template_t& t = *p_template;
+        if (t.cell_capacity == 0 || t.num_indices == 0) {
+            continue;
+        }
+        t.mesh.drawElementsInstanced(GL_TRIANGLES, t.num_indices, t.cell_capacity);
+    }
+    _shader.end();
+}
+
+
+//==============================================================================
+// Bounds
+
+/**
+ * Center of the bounding box of all cells.
+ */
+glm::vec3 CellScene::center() const
+{
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    for (const auto& p_template : _templates) {
+        for (const glm::vec4& b : p_template->bounds) {
+            lo = glm::min(lo, glm::vec3(b) - glm::vec3(b.w));
+            hi = glm::max(hi, glm::vec3(b) + glm::vec3(b.w));
+        }
+    }
+    return (_num_cells > 0) ? 0.5f * (lo + hi) : glm::vec3(0.0);
+}
+
+
+/**
+ * Radius of a sphere around center() containing all cells.
+ */
+float CellScene::extent() const
+{
+    glm::vec3 c = center();
+    float extent = 0.0;
+    for (const auto& p_template : _templates) {
+        for (const glm::vec4& b : p_template->bounds) {
+            extent = std::max(extent, glm::length(glm::vec3(b) - c) + b.w);
+        }
+    }
+    return extent;
+}
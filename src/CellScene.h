@@ -0,0 +1,84 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "Morphology.h"
+#include "SampleBuffer.h"
+
+#include <memory>
+#include <vector>
+
+
+/**
+ * 3D scene of many cells that share a few morphology templates.
+ *
+ * Every template is turned into one static mesh of cones (one per
+ * segment) when it is added; the morphology itself is not kept. A cell
+ * is a template plus a transform (position, rotation, uniform scale)
+ * and is drawn as an instance of its template's mesh, so all cells of a
+ * template take one instanced draw call and GPU memory grows with the
+ * number and size of templates, plus 52 bytes per cell.
+ *
+ * Each cell can be colored by the newest sample of one variable (e.g.
+ * its soma voltage), passed to the shader as a per-instance attribute
+ * together with the transform.
+ */
+class CellScene
+{
+  public:
+    CellScene() :
+        color(ofFloatColor(0.25, 0.35, 0.6)),
+        v_lim_lower(-80.0),
+        v_lim_upper(40.0),
+        _num_cells(0) {}
+
+    size_t add_template(const Morphology& morphology);
+    void add_cell(size_t template_index, const glm::vec3& position,
+                  const glm::vec3& rotation, float scale,
+                  std::shared_ptr<SampleBuffer> samples);
+
+    bool empty() const { return _num_cells == 0; }
+    size_t num_templates() const { return _templates.size(); }
+    size_t num_cells() const { return _num_cells; }
+
+    void update_values();
+    void draw() const;
+
+    glm::vec3 center() const;
+    float extent() const;
+
+    ofFloatColor color; // of cells without a variable
+    float v_lim_lower;  // value range of the color map
+    float v_lim_upper;
+
+  private:
+    // Per-instance attributes: rows of the affine cell transform
+    // (template to scene coordinates) and the value shown
+    typedef struct {
+        glm::vec4 row0;
+        glm::vec4 row1;
+        glm::vec4 row2;
+        float value;
+    } cell_instance_t;
+
+    typedef struct {
+        ofVbo mesh;
+        int num_indices;
+        glm::vec3 center; // bounding sphere in template coordinates
+        float extent;
+
+        // Cells of this template
+        std::vector<cell_instance_t> cells;
+        std::vector<std::shared_ptr<SampleBuffer>> samples;
+        std::vector<glm::vec4> bounds; // xyz: center, w: radius in scene
+        ofBufferObject cell_buffer;
+        size_t cell_capacity;
+    } template_t;
+
+    void _setup_shader();
+    void _attach_cell_buffer(template_t& t);
+
+    std::vector<std::unique_ptr<template_t>> _templates;
+    size_t _num_cells;
+    ofShader _shader;
+};
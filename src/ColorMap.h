@@ -0,0 +1,56 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstdint>
+
+
+/**
+ * Viridis-like color map: x in [0, 1] to RGBA bytes.
+ * Values outside [0, 1] are clamped, NaN maps to black.
+ */
+inline void colormap_rgba(float x, uint8_t* rgba)
+{
+    // Color stops at x = 0, 0.25, 0.5, 0.75, 1
+    static const float stops[5][3] = {
+        {0.267f, 0.005f, 0.329f},
+        {0.229f, 0.322f, 0.546f},
+        {0.128f, 0.567f, 0.551f},
+        {0.369f, 0.789f, 0.383f},
+        {0.993f, 0.906f, 0.144f},
+    };
+
+    if (!(x == x)) {
+        rgba[0] = rgba[1] = rgba[2] = 0;
+        rgba[3] = 255;
+        return;
+    }
+    x = (x < 0.0f) ? 0.0f : ((x > 1.0f) ? 1.0f : x);
+
+    float pos = x * 4.0f;
+    int i = (int) pos;
+    if (i > 3) {
+        i = 3;
+    }
+    float frac = pos - i;
+    for (int c = 0; c < 3; c++) {
+        float value = stops[i][c] + frac * (stops[i + 1][c] - stops[i][c]);
+        rgba[c] = (uint8_t) (value * 255.0f + 0.5f);
+    }
+    rgba[3] = 255;
+}
+
+
+// The same color map as a GLSL 1.20 function, for shaders
+const char* const COLORMAP_GLSL = R"(
+vec3 colormap(float x) {
+    vec3 stops[5];
+    stops[0] = vec3(0.267, 0.005, 0.329);
+    stops[1] = vec3(0.229, 0.322, 0.546);
+    stops[2] = vec3(0.128, 0.567, 0.551);
+    stops[3] = vec3(0.369, 0.789, 0.383);
+    stops[4] = vec3(0.993, 0.906, 0.144);
+    float pos = clamp(x, 0.0, 1.0) * 4.0;
+    int i = int(min(pos, 3.0));
+    return mix(stops[i], stops[i + 1], pos - float(i));
+}
+)";
@@ -0,0 +1,454 @@
+#include "CompressedHistory.h"
+#include <algorithm>
+#include <cstring> // memcpy, ...
+
+
+//==============================================================================
+// Bit streams
+
+namespace {
+
+/**
+ * Appends bit fields MSB-first to a vector of 64-bit words.
+ */
+class BitWriter
+{
+  public:
+    BitWriter(std::vector<uint64_t>& words) : _words(words), _num_bits(0) {
+        _words.clear();
+    }
+
+    void write(uint64_t value, unsigned n) {
+        if (n == 0) {
+            return;
+        }
+        if (n < 64) {
+            value &= (uint64_t(1) << n) - 1;
+        }
+        unsigned used = _num_bits & 63;
+        if (used == 0) {
+            _words.push_back(0);
+        }
+        unsigned avail = 64 - used;
+        if (n <= avail) {
+            _words.back() |= value << (avail - n);
+        } else {
+            _words.back() |= value >> (n - avail);
+            _words.push_back(value << (64 - (n - avail)));
+        }
+        _num_bits += n;
+    }
+
+  private:
+    std::vector<uint64_t>& _words;
+    size_t _num_bits;
+};
+
+
+/**
+ * Reads bit fields written by BitWriter.
+ */
+class BitReader
+{
+  public:
+    BitReader(const std::vector<uint64_t>& words) : _words(words), _pos(0) {}
+
+    uint64_t read(unsigned n) {
+        if (n == 0) {
+            return 0;
+        }
+        size_t i_word = _pos >> 6;
+        unsigned offset = _pos & 63;
+        unsigned avail = 64 - offset;
+        uint64_t value;
+        if (n <= avail) {
+            value = (_words[i_word] << offset) >> (64 - n);
+        } else {
+            uint64_t high = (_words[i_word] << offset) >> offset;
+            value = (high << (n - avail)) | (_words[i_word + 1] >> (64 - (n - avail)));
+        }
+        _pos += n;
+        return value;
+    }
+
+    bool read_bit() { return read(1) != 0; }
+
+  private:
+    const std::vector<uint64_t>& _words;
+    size_t _pos;
+};
+
+
+inline uint32_t float_bits(float f) {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+inline float bits_float(uint32_t u) {
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+inline unsigned leading_zeros64(uint64_t x) { return __builtin_clzll(x); }
+
+
+// Float bit pattern as an integer in the order of the float values
+// (negative values reversed), so that close values are close integers.
+// A bijection: every bit pattern, NaNs included, comes back unchanged.
+inline int64_t ordered_int(uint32_t u) {
+    return (u & 0x80000000u) ? (int64_t) (~u) : (int64_t) (u | 0x80000000u);
+}
+
+inline uint32_t ordered_bits(int64_t s) {
+    uint32_t u = (uint32_t) s;
+    return (u & 0x80000000u) ? (u & 0x7fffffffu) : ~u;
+}
+
+
+// Value prediction: order 0 repeats the previous value, order 1
+// extrapolates a line through the last two, order 2 a parabola through
+// the last three (fewer at the start of a block).
+const unsigned NUM_PREDICTORS = 3;
+
+// In place of the predictor: samples stored as raw bits, for blocks
+// that do not compress (noise, non-finite values)
+const unsigned RAW_BLOCK = 3;
+
+inline int64_t predict(unsigned order, size_t i, const int64_t* prev) {
+    order = std::min<size_t>(order, i - 1);
+    switch (order) {
+        case 0:  return prev[0];
+        case 1:  return 2 * prev[0] - prev[1];
+        default: return 3 * prev[0] - 3 * prev[1] + prev[2];
+    }
+}
+
+
+/**
+ * Encode with one value predictor, see encode_block().
+ */
+void encode_with(const trace_point_t* points, size_t n, unsigned order,
+                 std::vector<uint64_t>& bits)
+{
+    BitWriter out(bits);
+
+    uint32_t t_prev = float_bits(points[0].t);
+    uint32_t v_first = float_bits(points[0].v);
+    out.write(t_prev, 32);
+    out.write(v_first, 32);
+    out.write(order, 2);
+    if (order == RAW_BLOCK) {
+        for (size_t i = 1; i < n; i++) {
+            out.write(float_bits(points[i].t), 32);
+            out.write(float_bits(points[i].v), 32);
+        }
+        return;
+    }
+
+    int64_t delta_prev = 0;
+    int64_t v_prev[3] = {ordered_int(v_first), 0, 0};
+    unsigned width_prev = 0; // no window yet
+
+    for (size_t i = 1; i < n; i++) {
+        // Time: delta-of-delta of bit patterns
+        uint32_t t_cur = float_bits(points[i].t);
+        int64_t delta = (int64_t) t_cur - (int64_t) t_prev;
+        int64_t dod = delta - delta_prev;
+        if (dod == 0) {
+            out.write(0, 1);
+        } else if (dod == -1 || dod == 1) {
+            // rounding of t = i * dt in float
+            out.write(0x2, 2);
+            out.write(dod > 0, 1);
+        } else if (dod >= -63 && dod <= 64) {
+            out.write(0x6, 3);
+            out.write(dod + 63, 7);
+        } else if (dod >= -2047 && dod <= 2048) {
+            out.write(0xE, 4);
+            out.write(dod + 2047, 12);
+        } else {
+            out.write(0xF, 4);
+            out.write((uint64_t) dod, 64);
+        }
+        delta_prev = delta;
+        t_prev = t_cur;
+
+        // Value: zigzag residual of the prediction, in a window of bits
+        int64_t v_cur = ordered_int(float_bits(points[i].v));
+        int64_t r = v_cur - predict(order, i, v_prev);
+        uint64_t z = ((uint64_t) r << 1) ^ (uint64_t) (r >> 63);
+        if (z == 0) {
+            out.write(0, 1);
+        } else {
+            unsigned width = 64 - leading_zeros64(z);
+            if (width <= width_prev && width + 6 > width_prev) {
+                out.write(0x2, 2);
+                out.write(z, width_prev);
+            } else {
+                out.write(0x3, 2);
+                out.write(width - 1, 6);
+                out.write(z, width);
+                width_prev = width;
+            }
+        }
+        v_prev[2] = v_prev[1];
+        v_prev[1] = v_prev[0];
+        v_prev[0] = v_cur;
+    }
+}
+
+} // namespace
+
+
+//==============================================================================
+// Block codec
+
+/**
+ * Encode n >= 1 samples into a bit stream.
+ *
+ * Layout: raw bits of first (t, v) and the value predictor, then per
+ * sample a delta-of-delta code for t followed by a residual code for v.
+ * Each predictor is tried and the shortest encoding is kept, or the raw
+ * samples if that is shorter still.
+ */
+void CompressedHistory::encode_block(const trace_point_t* points, size_t n,
+                                     std::vector<uint64_t>& bits)
+{
+    std::vector<uint64_t> candidate;
+    for (unsigned order = 0; order < NUM_PREDICTORS; order++) {
+        std::vector<uint64_t>& out = (order == 0) ? bits : candidate;
+        encode_with(points, n, order, out);
+        if (order > 0 && candidate.size() < bits.size()) {
+            bits.swap(candidate);
+        }
+    }
+    size_t raw_words = (64 * n + 2 + 63) / 64;
+    if (bits.size() > raw_words) {
+        encode_with(points, n, RAW_BLOCK, bits);
+    }
+}
+
+
+/**
+ * Decode n samples encoded by encode_block().
+ */
+void CompressedHistory::decode_block(const std::vector<uint64_t>& bits, size_t n,
+                                     trace_point_t* points)
+{
+    BitReader in(bits);
+
+    uint32_t t_prev = (uint32_t) in.read(32);
+    uint32_t v_first = (uint32_t) in.read(32);
+    unsigned order = (unsigned) in.read(2);
+    points[0].t = bits_float(t_prev);
+    points[0].v = bits_float(v_first);
+    if (order == RAW_BLOCK) {
+        for (size_t i = 1; i < n; i++) {
+            points[i].t = bits_float((uint32_t) in.read(32));
+            points[i].v = bits_float((uint32_t) in.read(32));
+        }
+        return;
+    }
+
+    int64_t delta_prev = 0;
+    int64_t v_prev[3] = {ordered_int(v_first), 0, 0};
+    unsigned width_prev = 0;
+
+    for (size_t i = 1; i < n; i++) {
+        int64_t dod;
+        if (!in.read_bit()) {
+            dod = 0;
+        } else if (!in.read_bit()) {
+            dod = in.read_bit() ? 1 : -1;
+        } else if (!in.read_bit()) {
+            dod = (int64_t) in.read(7) - 63;
+        } else if (!in.read_bit()) {
+            dod = (int64_t) in.read(12) - 2047;
+        } else {
+            dod = (int64_t) in.read(64);
+        }
+        int64_t delta = delta_prev + dod;
+        t_prev = (uint32_t) ((int64_t) t_prev + delta);
+        delta_prev = delta;
+
+        uint64_t z = 0;
+        if (in.read_bit()) {
+            if (in.read_bit()) {
+                width_prev = (unsigned) in.read(6) + 1;
+            }
+            z = in.read(width_prev);
+        }
+        int64_t r = (int64_t) (z >> 1) ^ -(int64_t) (z & 1);
+        int64_t v_cur = predict(order, i, v_prev) + r;
+        v_prev[2] = v_prev[1];
+        v_prev[1] = v_prev[0];
+        v_prev[0] = v_cur;
+
+        points[i].t = bits_float(t_prev);
+        points[i].v = bits_float(ordered_bits(v_cur));
+    }
+}
+
+
+//==============================================================================
+// Block storage
+
+/**
+ * Compress a block of samples and append it to the history.
+ * Oldest blocks are dropped when the history exceeds its maximum size.
+ *
+ * Blocks must be in time order for read(). When time goes back (the
+ * simulation restarted), the history of the previous run is dropped,
+ * including the samples of this block before the restart.
+ *
+ * @param   seq_first
+ *          Sequence number (in the variable's SampleBuffer) of points[0]
+ */
+void CompressedHistory::append(uint64_t seq_first,
+                               const trace_point_t* points, size_t n)
+{
+    if (n == 0) {
+        return;
+    }
+
+    size_t first = 0;
+    for (size_t i = 1; i < n; i++) {
+        if (points[i].t < points[i - 1].t) {
+            first = i;
+        }
+    }
+    bool restarted = (first > 0);
+    seq_first += first;
+    points += first;
+    n -= first;
+
+    // Encode outside the lock
+    auto block = std::make_shared<history_block_t>();
+    block->seq_first = seq_first;
+    block->count = (uint32_t) n;
+    block->t_first = points[0].t;
+    block->t_last = points[n - 1].t;
+    encode_block(points, n, block->bits);
+    block->bits.shrink_to_fit();
+
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (restarted || (!_blocks.empty() && block->t_first < _blocks.back()->t_last)) {
+        _blocks.clear();
+        _num_samples = 0;
+        _num_bytes = 0;
+    }
+    _num_samples += n;
+    _num_bytes += block->bits.size() * sizeof(uint64_t);
+    _seq_end = seq_first + n;
+    _blocks.push_back(block);
+
+    while (_num_samples > _max_samples && _blocks.size() > 1) {
+        const auto& oldest = _blocks.front();
+        _num_samples -= oldest->count;
+        _num_bytes -= oldest->bits.size() * sizeof(uint64_t);
+        _blocks.pop_front();
+    }
+}
+
+
+/**
+ * Append all retained samples with t_begin <= t < t_end to out,
+ * decompressing the blocks that overlap the interval.
+ *
+ * @return  number of samples appended
+ */
+size_t CompressedHistory::read(float t_begin, float t_end,
+                               std::vector<trace_point_t>& out) const
+{
+    // Collect overlapping blocks under the lock, decode outside of it.
+    // Blocks are in time order: binary search the first one.
+    std::vector<std::shared_ptr<const history_block_t>> overlapping;
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        auto it = std::partition_point(_blocks.begin(), _blocks.end(),
+                                       [t_begin](const std::shared_ptr<const history_block_t>& block) {
+                                           return block->t_last < t_begin;
+                                       });
+        for (; it != _blocks.end() && (*it)->t_first < t_end; ++it) {
+            overlapping.push_back(*it);
+        }
+    }
+
+    size_t num_read = 0;
+    for (const auto& block : overlapping) {
+        decoded_ptr points = _decoded(block);
+        for (const trace_point_t& pt : *points) {
+            if (pt.t >= t_begin && pt.t < t_end) {
+                out.push_back(pt);
+                num_read++;
+            }
+        }
+    }
+    return num_read;
+}
+
+
+/**
+ * Decompressed samples of block, from the cache if possible.
+ */
+CompressedHistory::decoded_ptr CompressedHistory::_decoded(
+        const std::shared_ptr<const history_block_t>& block) const
+{
+    {
+        std::lock_guard<std::mutex> guard(_cache_mutex);
+        for (auto it = _cache.begin(); it != _cache.end(); ++it) {
+            if (it->first == block->seq_first) {
+                auto entry = *it;
+                _cache.erase(it);
+                _cache.push_back(entry);
+                return entry.second;
+            }
+        }
+    }
+
+    auto points = std::make_shared<std::vector<trace_point_t>>(block->count);
+    decode_block(block->bits, block->count, points->data());
+
+    std::lock_guard<std::mutex> guard(_cache_mutex);
+    _cache.push_back(std::make_pair(block->seq_first, decoded_ptr(points)));
+    if (_cache.size() > DECODE_CACHE_BLOCKS) {
+        _cache.pop_front();
+    }
+    return points;
+}
+
+
+/**
+ * One past the sequence number of the newest compressed sample.
+ */
+uint64_t CompressedHistory::seq_end() const
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _seq_end;
+}
+
+
+/**
+ * Time of the oldest retained sample (0 if empty).
+ */
+float CompressedHistory::t_oldest() const
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _blocks.empty() ? 0.0f : _blocks.front()->t_first;
+}
+
+
+size_t CompressedHistory::num_samples() const
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _num_samples;
+}
+
+
+size_t CompressedHistory::compressed_bytes() const
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _num_bytes;
+}
@@ -0,0 +1,93 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "SampleBuffer.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+// Number of samples per compressed block
+const size_t HISTORY_BLOCK_SAMPLES = 1024;
+
+// Default maximum number of samples in the compressed tier of a variable
+const size_t DEFAULT_HISTORY_SAMPLES = 1 << 24;
+
+
+/**
+ * Compressed in-memory history of one variable.
+ *
+ * Holds samples that are older than what the SampleBuffer retains,
+ * in fixed-size lossless blocks, with times encoded like Facebook's
+ * Gorilla time series database:
+ *
+ * - sample times as delta-of-delta of their IEEE-754 bit patterns,
+ *   1-3 bits per sample for a fixed dt (rounding to float jitters the
+ *   steps by one unit),
+ *
+ * - sample values as the residual of a prediction from the previous
+ *   values (constant, linear or quadratic, whichever is shortest for
+ *   the block), on the float bit patterns taken as ordered integers;
+ *   blocks that do not compress are stored raw.
+ *
+ * Measured by test/history_codec_roundtrip, against 64 bits raw: smooth
+ * traces take 10-11 bits per sample (6-6.5x), constant stretches ~3.5
+ * bits; noise does not compress (~47 bits for random values) and
+ * non-finite values are stored raw (64 bits).
+ *
+ * Blocks are appended by the HistoryCompressor thread and decompressed
+ * on demand by the render thread. The block list is guarded by a mutex,
+ * which is only taken once per block and per read request, never per
+ * sample.
+ */
+class CompressedHistory
+{
+  public:
+    CompressedHistory(size_t max_samples = DEFAULT_HISTORY_SAMPLES) :
+        _max_samples(max_samples),
+        _num_samples(0),
+        _num_bytes(0),
+        _seq_end(0) {}
+
+    void append(uint64_t seq_first, const trace_point_t* points, size_t n);
+    size_t read(float t_begin, float t_end, std::vector<trace_point_t>& out) const;
+
+    uint64_t seq_end() const;
+    float t_oldest() const;
+    size_t num_samples() const;
+    size_t compressed_bytes() const;
+
+    static void encode_block(const trace_point_t* points, size_t n,
+                             std::vector<uint64_t>& bits);
+    static void decode_block(const std::vector<uint64_t>& bits, size_t n,
+                             trace_point_t* points);
+
+  private:
+    typedef struct {
+        uint64_t seq_first;
+        uint32_t count;
+        float t_first;
+        float t_last;
+        std::vector<uint64_t> bits;
+    } history_block_t;
+
+    typedef std::shared_ptr<const std::vector<trace_point_t>> decoded_ptr;
+
+    decoded_ptr _decoded(const std::shared_ptr<const history_block_t>& block) const;
+
+    mutable std::mutex _mutex;
+    std::deque<std::shared_ptr<const history_block_t>> _blocks;
+    size_t _max_samples;
+    size_t _num_samples;
+    size_t _num_bytes;
+    uint64_t _seq_end;
+
+    // Recently decompressed blocks (most recent last), so scrolling
+    // back and forth over the same range does not decode again.
+    static const size_t DECODE_CACHE_BLOCKS = 8;
+    mutable std::mutex _cache_mutex;
+    mutable std::deque<std::pair<uint64_t, decoded_ptr>> _cache;
+};
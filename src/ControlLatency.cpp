@@ -0,0 +1,88 @@
+#include "ControlLatency.h"
+
+
+namespace {
+
+// Commands without echo are forgotten after this long [us]
+const uint64_t COMMAND_TIMEOUT = 10 * 1000 * 1000;
+
+inline uint64_t elapsed(uint64_t from, uint64_t to)
+{
+    return (to > from) ? to - from : 0;
+}
+
+} // namespace
+
+
+/**
+ * Remember a command that was just sent.
+ *
+ * @param   t_midi
+ *          [us] callback time of the oldest MIDI event in the command,
+ *          0 if there is none
+ */
+void ControlLatency::sent(uint64_t id, uint64_t t_midi, uint64_t t_sent)
+{
+    _in_flight[id] = {t_midi, t_sent};
+    if (t_midi != 0) {
+        midi_to_send.add(elapsed(t_midi, t_sent));
+    }
+}
+
+
+/**
+ * Take the observations of the ingest thread; their commands wait for
+ * the next frame to be drawn. Expire commands that were not echoed.
+ */
+void ControlLatency::update(uint64_t t_now)
+{
+    control_observed_t observation;
+    while (_queue.pop(observation)) {
+        auto it = _in_flight.find(observation.id);
+        if (it == _in_flight.end()) {
+            continue; // expired or sent by an earlier run
+        }
+        _pending_draw.push_back({it->second, observation});
+        _in_flight.erase(it);
+    }
+
+    for (auto it = _in_flight.begin(); it != _in_flight.end();) {
+        if (elapsed(it->second.t_sent, t_now) > COMMAND_TIMEOUT) {
+            it = _in_flight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+
+/**
+ * Record all stages of the commands whose effect was drawn in the
+ * frame that just finished.
+ */
+void ControlLatency::frame_drawn(uint64_t t_now)
+{
+    for (const pending_draw_t& p : _pending_draw) {
+        send_to_apply.add(elapsed(p.sent.t_sent, p.observed.t_echo));
+        apply_to_sample.add(elapsed(p.observed.t_echo, p.observed.t_sample));
+        sample_to_draw.add(elapsed(p.observed.t_sample, t_now));
+        end_to_end.add(elapsed(p.sent.t_midi ? p.sent.t_midi : p.sent.t_sent, t_now));
+    }
+    _pending_draw.clear();
+}
+
+
+void ControlLatency::write_json(std::ostream& os) const
+{
+    os << "{\"midi_to_send\": ";
+    midi_to_send.write_json(os);
+    os << ", \"send_to_apply\": ";
+    send_to_apply.write_json(os);
+    os << ", \"apply_to_sample\": ";
+    apply_to_sample.write_json(os);
+    os << ", \"sample_to_draw\": ";
+    sample_to_draw.write_json(os);
+    os << ", \"end_to_end\": ";
+    end_to_end.write_json(os);
+    os << "}";
+}
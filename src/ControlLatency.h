@@ -0,0 +1,75 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "LatencyHistogram.h"
+#include "MpscQueue.h"
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+
+// Control command whose effect reached the app, reported by the
+// ingest thread. Times [us] are ofGetElapsedTimeMicros().
+typedef struct {
+    uint64_t id;
+    uint64_t t_echo;   // echo received: simulator applied the command
+    uint64_t t_sample; // first sample from after the command received
+} control_observed_t;
+
+
+/**
+ * End-to-end latency of control commands, from a MIDI event to its
+ * effect on screen, split into stages:
+ *
+ * - MIDI callback -> command sent (queueing, coalescing, rate limit)
+ * - sent -> simulator applied (echo of the command id received)
+ * - applied -> first sample simulated after it received
+ * - sample received -> frame drawn
+ *
+ * Each command carries an id. The simulator echoes it with the
+ * simulated time from which it is in effect (MSG_TAG_ECHO); the ingest
+ * thread reports when that echo and the first later sample arrived
+ * through a lock-free queue. Commands that are never echoed (e.g. the
+ * publisher does not support echoes) expire without being counted.
+ */
+class ControlLatency
+{
+  public:
+    ControlLatency() : _queue(1024) {}
+
+    // Render thread
+    void sent(uint64_t id, uint64_t t_midi, uint64_t t_sent);
+    void update(uint64_t t_now);
+    void frame_drawn(uint64_t t_now);
+
+    // Ingest thread
+    void observed(const control_observed_t& observation) {
+        _queue.push(observation);
+    }
+
+    void write_json(std::ostream& os) const;
+
+    LatencyHistogram midi_to_send;
+    LatencyHistogram send_to_apply;
+    LatencyHistogram apply_to_sample;
+    LatencyHistogram sample_to_draw;
+    LatencyHistogram end_to_end; // from MIDI callback, or from send
+                                 // for commands without MIDI events
+
+  private:
+    typedef struct {
+        uint64_t t_midi; // 0 if not caused by a MIDI event
+        uint64_t t_sent;
+    } in_flight_t;
+
+    typedef struct {
+        in_flight_t sent;
+        control_observed_t observed;
+    } pending_draw_t;
+
+    std::unordered_map<uint64_t, in_flight_t> _in_flight;
+    std::vector<pending_draw_t> _pending_draw;
+    MpscQueue<control_observed_t> _queue;
+};
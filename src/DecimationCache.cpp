@@ -0,0 +1,237 @@
+#include "DecimationCache.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace {
+
+const minmax_bucket_t EMPTY_BUCKET = {0.0f, 0.0f, 0};
+
+// Attempts to scan the ring buffer before giving up on samples that
+// the ingest thread overwrites faster than we read them
+const int MAX_SCAN_ATTEMPTS = 3;
+
+
+inline int64_t bucket_index(double t, float dt)
+{
+    return (int64_t) std::floor(t / dt);
+}
+
+
+inline void add_to_bucket(minmax_bucket_t& bucket, float v)
+{
+    if (bucket.count == 0) {
+        bucket.v_min = v;
+        bucket.v_max = v;
+    } else {
+        bucket.v_min = std::min(bucket.v_min, v);
+        bucket.v_max = std::max(bucket.v_max, v);
+    }
+    bucket.count++;
+}
+
+} // namespace
+
+
+/**
+ * Min/max buckets of width dt [ms] covering t_begin <= t <= t_end.
+ *
+ * Complete buckets come from the level of this width if it has them,
+ * and are added to it otherwise. The bucket with the newest sample and
+ * any later ones are still filling and are scanned but not cached.
+ *
+ * @param   dt
+ *          bucket width, should be quantized by the caller so that
+ *          zooming back to a level gives the exact same value
+ *
+ * @param   out
+ *          resized to one bucket per dt in the window
+ *
+ * @return  index k of the first bucket in out (which starts at t = k * dt)
+ */
+int64_t DecimationCache::query(const SampleBuffer& samples, const CompressedHistory* history,
+                               float dt, float t_begin, float t_end,
+                               std::vector<minmax_bucket_t>& out)
+{
+    int64_t k_end = bucket_index(t_end, dt) + 1;
+    int64_t k_begin = std::max(bucket_index(t_begin, dt),
+                               k_end - (int64_t) MAX_DECIMATION_BUCKETS);
+    out.assign(k_end - k_begin, EMPTY_BUCKET);
+
+    auto view = samples.snapshot();
+    if (view.empty()) {
+        return k_begin;
+    }
+
+    // Samples arrive in time order: buckets before the newest are complete
+    int64_t k_open = bucket_index(view.back().t, dt);
+    int64_t k_complete = std::min(k_end, k_open);
+
+    level_t& level = _level(dt);
+    int64_t k_cached = level.k_begin + (int64_t) level.buckets.size();
+
+    // Newest sample older than before, or before the end of the cached
+    // run: time went back (simulation restarted)
+    if (view.back().t < _t_newest || k_open < k_cached) {
+        _restart(view);
+        k_cached = level.k_begin;
+    }
+    _t_newest = view.back().t;
+
+    // Start over rather than fill a gap that is not shown
+    if (level.buckets.empty() || k_begin > k_cached || k_complete < level.k_begin) {
+        level.buckets.clear();
+        level.k_begin = k_begin;
+        k_cached = k_begin;
+    }
+
+    // Extend the cached run at the old end, then at the new end
+    if (k_begin < level.k_begin) {
+        std::vector<minmax_bucket_t> older(level.k_begin - k_begin, EMPTY_BUCKET);
+        _scan(samples, history, dt, k_begin, level.k_begin, older.data());
+        level.buckets.insert(level.buckets.begin(), older.begin(), older.end());
+        level.k_begin = k_begin;
+    }
+    if (k_complete > k_cached) {
+        size_t size = level.buckets.size();
+        level.buckets.resize(size + (k_complete - k_cached), EMPTY_BUCKET);
+        _scan(samples, history, dt, k_cached, k_complete, level.buckets.data() + size);
+        k_cached = k_complete;
+    }
+
+    // Bound the level, dropping buckets outside the window first
+    if (level.buckets.size() > MAX_DECIMATION_BUCKETS) {
+        size_t excess = level.buckets.size() - MAX_DECIMATION_BUCKETS;
+        size_t front = std::min<int64_t>(excess, k_begin - level.k_begin);
+        level.buckets.erase(level.buckets.begin(), level.buckets.begin() + front);
+        level.k_begin += front;
+        if (level.buckets.size() > MAX_DECIMATION_BUCKETS) {
+            level.buckets.resize(MAX_DECIMATION_BUCKETS);
+        }
+        k_cached = level.k_begin + (int64_t) level.buckets.size();
+    }
+
+    // Cached part of the window, then what is still filling
+    int64_t k_copy_begin = std::max(k_begin, level.k_begin);
+    int64_t k_copy_end = std::min(k_end, k_cached);
+    if (k_copy_end > k_copy_begin) {
+        std::copy(level.buckets.begin() + (k_copy_begin - level.k_begin),
+                  level.buckets.begin() + (k_copy_end - level.k_begin),
+                  out.begin() + (k_copy_begin - k_begin));
+    }
+    int64_t k_open_begin = std::max(k_begin, k_copy_end);
+    if (k_end > k_open_begin) {
+        _scan(samples, history, dt, k_open_begin, k_end,
+              out.data() + (k_open_begin - k_begin));
+    }
+    return k_begin;
+}
+
+
+/**
+ * Forget all cached buckets.
+ */
+void DecimationCache::clear()
+{
+    _levels.clear();
+    _t_newest = -std::numeric_limits<float>::infinity();
+    _seq_run_begin = 0;
+}
+
+
+/**
+ * Drop the buckets of all levels, which are from the previous run, and
+ * find where the current run starts in the ring: after the last sample
+ * whose successor is older. Only done once per restart.
+ */
+void DecimationCache::_restart(const SampleBuffer::View& view)
+{
+    for (level_t& level : _levels) {
+        level.buckets.clear();
+    }
+    uint64_t seq = view.seq_end() - 1;
+    while (seq > view.seq_begin() && view[seq - 1].t <= view[seq].t) {
+        seq--;
+    }
+    _seq_run_begin = std::max(seq, view.validate());
+}
+
+
+/**
+ * Level for bucket width dt, new (evicting the least recently used
+ * level if there are too many) or cached.
+ */
+DecimationCache::level_t& DecimationCache::_level(float dt)
+{
+    _clock++;
+    for (level_t& level : _levels) {
+        if (level.dt == dt) {
+            level.last_used = _clock;
+            return level;
+        }
+    }
+
+    if (_levels.size() >= _max_levels) {
+        auto lru = std::min_element(_levels.begin(), _levels.end(),
+                                    [](const level_t& a, const level_t& b) {
+                                        return a.last_used < b.last_used;
+                                    });
+        _levels.erase(lru);
+    }
+    _levels.push_back({dt, 0, {}, _clock});
+    return _levels.back();
+}
+
+
+/**
+ * Add all retained samples of buckets k_begin..k_end-1 to out
+ * (one bucket per index, initially empty).
+ */
+void DecimationCache::_scan(const SampleBuffer& samples, const CompressedHistory* history,
+                            float dt, int64_t k_begin, int64_t k_end, minmax_bucket_t* out)
+{
+    double t_begin = (double) k_begin * dt;
+    double t_end = (double) k_end * dt;
+    size_t num_buckets = k_end - k_begin;
+
+    for (int attempt = 0; attempt < MAX_SCAN_ATTEMPTS; attempt++) {
+        std::fill(out, out + num_buckets, EMPTY_BUCKET);
+
+        // Samples older than the ring buffer (or than the current run in
+        // it) from the compressed history
+        auto view = samples.snapshot();
+        view.advance_begin(_seq_run_begin);
+        float t_ring_oldest = view.empty() ? std::numeric_limits<float>::max()
+                                           : view.front().t;
+        if (history && t_begin < t_ring_oldest) {
+            _history_points.clear();
+            history->read(t_begin, std::min<double>(t_end, t_ring_oldest), _history_points);
+            for (const trace_point_t& sample : _history_points) {
+                int64_t i = bucket_index(sample.t, dt) - k_begin;
+                if (i >= 0 && i < (int64_t) num_buckets) {
+                    add_to_bucket(out[i], sample.v);
+                }
+            }
+        }
+
+        // The rest straight from the ring buffer
+        view.advance_begin(lower_bound_time(view, std::max<double>(t_begin, t_ring_oldest)));
+        for (uint64_t seq = view.seq_begin(); seq < view.seq_end(); ++seq) {
+            trace_point_t sample = view[seq];
+            if (sample.t >= t_end) {
+                break;
+            }
+            int64_t i = bucket_index(sample.t, dt) - k_begin;
+            if (i >= 0 && i < (int64_t) num_buckets) {
+                add_to_bucket(out[i], sample.v);
+            }
+        }
+
+        // Overwritten while we read it: scan again, those samples are
+        // history now (or gone)
+        if (view.validate() == view.seq_begin()) {
+            return;
+        }
+    }
+}
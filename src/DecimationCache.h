@@ -0,0 +1,79 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "SampleBuffer.h"
+#include "CompressedHistory.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+
+// Min/max of the samples of one pixel column
+typedef struct {
+    float v_min;
+    float v_max;
+    uint32_t count; // 0 if no sample of the column is retained
+} minmax_bucket_t;
+
+// Zoom levels kept per variable, and buckets per level
+const size_t DEFAULT_DECIMATION_LEVELS = 8;
+const size_t MAX_DECIMATION_BUCKETS = 1 << 16;
+
+
+/**
+ * Min/max decimation of the samples of one variable, for drawing a
+ * time window with many samples per pixel column.
+ *
+ * Buckets are aligned to multiples of their width dt in simulated
+ * time, so a bucket stays valid while the window scrolls or pans.
+ * Each zoom level (bucket width) keeps one contiguous run of buckets
+ * that is only extended at either end as the window moves, and the
+ * levels of the most recently used zooms are kept (LRU), so zooming
+ * back and forth or panning over long histories scans no sample twice.
+ * Only the bucket still receiving samples is recomputed on every query.
+ *
+ * Samples come from the ring buffer, and from the compressed history
+ * for the part of the window the ring no longer holds. When the newest
+ * sample is older than before (the simulation restarted), all levels
+ * start over and samples of the previous run left in the ring are
+ * ignored. Used by the render thread only.
+ */
+class DecimationCache
+{
+  public:
+    DecimationCache(size_t max_levels = DEFAULT_DECIMATION_LEVELS) :
+        _max_levels(max_levels),
+        _clock(0),
+        _t_newest(-std::numeric_limits<float>::infinity()),
+        _seq_run_begin(0) {}
+
+    int64_t query(const SampleBuffer& samples, const CompressedHistory* history,
+                  float dt, float t_begin, float t_end,
+                  std::vector<minmax_bucket_t>& out);
+
+    size_t num_levels() const { return _levels.size(); }
+    void clear();
+
+  private:
+    typedef struct {
+        float dt;
+        int64_t k_begin; // index of first bucket (t = k_begin * dt)
+        std::vector<minmax_bucket_t> buckets;
+        uint64_t last_used;
+    } level_t;
+
+    level_t& _level(float dt);
+    void _restart(const SampleBuffer::View& view);
+    void _scan(const SampleBuffer& samples, const CompressedHistory* history,
+               float dt, int64_t k_begin, int64_t k_end, minmax_bucket_t* out);
+
+    std::vector<level_t> _levels;
+    size_t _max_levels;
+    uint64_t _clock; // for LRU eviction of levels
+
+    float _t_newest;         // [ms] newest sample seen by query()
+    uint64_t _seq_run_begin; // first sample of the current run in the ring
+
+    std::vector<trace_point_t> _history_points; // reused by _scan()
+};
@@ -0,0 +1,351 @@
+#include "Expression.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib> // strtod
+#include <cstring> // memcpy
+
+
+//==============================================================================
+// Compiling
+
+/**
+ * Compile the expression text.
+ *
+ * @return  false if the text is not a valid expression (see error())
+ */
+bool Expression::compile(const std::string& text)
+{
+    _text = text;
+    _pos = 0;
+    _failed = false;
+    _error.clear();
+    _inputs.clear();
+    _registers.clear();
+    _code.clear();
+
+    _result = _parse_sum();
+    _skip_space();
+    if (!_failed && _pos < _text.size()) {
+        _fail("unexpected '" + _text.substr(_pos, 1) + "'");
+    }
+    if (_failed) {
+        _code.clear();
+        return false;
+    }
+
+    // One block per constant or temporary, constants filled once
+    _blocks.assign(_registers.size() * EXPRESSION_BLOCK, 0.0f);
+    _source.resize(_registers.size());
+    _target.resize(_registers.size());
+    for (size_t r = 0; r < _registers.size(); r++) {
+        float* block = &_blocks[r * EXPRESSION_BLOCK];
+        if (_registers[r].kind == CONSTANT) {
+            std::fill(block, block + EXPRESSION_BLOCK, _registers[r].value);
+        }
+        _source[r] = block;
+        _target[r] = block;
+    }
+    return true;
+}
+
+
+int Expression::_parse_sum()
+{
+    int a = _parse_product();
+    while (!_failed) {
+        _skip_space();
+        if (_pos >= _text.size() || (_text[_pos] != '+' && _text[_pos] != '-')) {
+            break;
+        }
+        opcode_t op = (_text[_pos++] == '+') ? OP_ADD : OP_SUB;
+        a = _emit(op, a, _parse_product());
+    }
+    return a;
+}
+
+
+int Expression::_parse_product()
+{
+    int a = _parse_unary();
+    while (!_failed) {
+        _skip_space();
+        if (_pos >= _text.size() || (_text[_pos] != '*' && _text[_pos] != '/')) {
+            break;
+        }
+        opcode_t op = (_text[_pos++] == '*') ? OP_MUL : OP_DIV;
+        a = _emit(op, a, _parse_unary());
+    }
+    return a;
+}
+
+
+int Expression::_parse_unary()
+{
+    _skip_space();
+    if (_pos < _text.size() && _text[_pos] == '-') {
+        _pos++;
+        return _emit(OP_NEG, _parse_unary());
+    }
+    if (_pos < _text.size() && _text[_pos] == '+') {
+        _pos++;
+        return _parse_unary();
+    }
+    return _parse_primary();
+}
+
+
+int Expression::_parse_primary()
+{
+    _skip_space();
+    if (_failed) {
+        return 0;
+    }
+    if (_pos >= _text.size()) {
+        _fail("unexpected end");
+        return 0;
+    }
+
+    char c = _text[_pos];
+    if (c == '(') {
+        _pos++;
+        int r = _parse_sum();
+        _skip_space();
+        if (_pos >= _text.size() || _text[_pos] != ')') {
+            _fail("missing ')'");
+            return 0;
+        }
+        _pos++;
+        return r;
+    }
+
+    if (std::isdigit((unsigned char) c) || c == '.') {
+        const char* begin = _text.c_str() + _pos;
+        char* end;
+        double value = std::strtod(begin, &end);
+        if (end == begin) {
+            _fail("invalid number");
+            return 0;
+        }
+        _pos += end - begin;
+        return _new_register(CONSTANT, 0, value);
+    }
+
+    if (std::isalpha((unsigned char) c) || c == '_') {
+        size_t begin = _pos;
+        while (_pos < _text.size() && (std::isalnum((unsigned char) _text[_pos])
+                                       || _text[_pos] == '_' || _text[_pos] == '.')) {
+            _pos++;
+        }
+        std::string name = _text.substr(begin, _pos - begin);
+        _skip_space();
+        if (_pos < _text.size() && _text[_pos] == '(') {
+            _pos++;
+            return _parse_call(name);
+        }
+
+        // Variable: one input register per name
+        for (size_t r = 0; r < _registers.size(); r++) {
+            if (_registers[r].kind == INPUT && _inputs[_registers[r].input] == name) {
+                return r;
+            }
+        }
+        _inputs.push_back(name);
+        return _new_register(INPUT, _inputs.size() - 1);
+    }
+
+    _fail("unexpected '" + _text.substr(_pos, 1) + "'");
+    return 0;
+}
+
+
+/**
+ * Function call, after the opening parenthesis.
+ */
+int Expression::_parse_call(const std::string& name)
+{
+    static const struct {
+        const char* name;
+        opcode_t op;
+        int num_args;
+    } functions[] = {
+        {"abs", OP_ABS, 1}, {"sqrt", OP_SQRT, 1}, {"exp", OP_EXP, 1},
+        {"log", OP_LOG, 1}, {"min", OP_MIN, 2}, {"max", OP_MAX, 2},
+    };
+
+    for (const auto& function : functions) {
+        if (name != function.name) {
+            continue;
+        }
+        int args[2] = {-1, -1};
+        for (int i = 0; i < function.num_args; i++) {
+            args[i] = _parse_sum();
+            _skip_space();
+            char expected = (i + 1 < function.num_args) ? ',' : ')';
+            if (_pos >= _text.size() || _text[_pos] != expected) {
+                _fail(name + "() takes " + std::to_string(function.num_args)
+                      + " argument(s)");
+                return 0;
+            }
+            _pos++;
+        }
+        return _emit(function.op, args[0], args[1]);
+    }
+    _fail("unknown function '" + name + "'");
+    return 0;
+}
+
+
+/**
+ * Add an instruction, or fold it if its operands are constants.
+ *
+ * The result goes to an operand register if that is a temporary
+ * (its value is not needed afterwards), so the number of temporaries
+ * stays at the nesting depth.
+ */
+int Expression::_emit(opcode_t op, int a, int b)
+{
+    if (_failed) {
+        return 0;
+    }
+    bool unary = (b < 0);
+    if (_registers[a].kind == CONSTANT && (unary || _registers[b].kind == CONSTANT)) {
+        float value = _apply(op, _registers[a].value, unary ? 0.0f : _registers[b].value);
+        return _new_register(CONSTANT, 0, value);
+    }
+
+    int dst;
+    if (_registers[a].kind == TEMPORARY) {
+        dst = a;
+    } else if (!unary && _registers[b].kind == TEMPORARY) {
+        dst = b;
+    } else {
+        dst = _new_register(TEMPORARY);
+    }
+    if (_failed) {
+        return 0;
+    }
+    _code.push_back({op, (uint8_t) dst, (uint8_t) a, (uint8_t) (unary ? a : b)});
+    return dst;
+}
+
+
+int Expression::_new_register(register_kind kind, size_t input, float value)
+{
+    if (_registers.size() >= MAX_EXPRESSION_REGISTERS) {
+        _fail("expression too long");
+        return 0;
+    }
+    _registers.push_back({kind, input, value});
+    return _registers.size() - 1;
+}
+
+
+void Expression::_skip_space()
+{
+    while (_pos < _text.size() && std::isspace((unsigned char) _text[_pos])) {
+        _pos++;
+    }
+}
+
+
+bool Expression::_fail(const std::string& message)
+{
+    if (!_failed) {
+        _error = message + " at position " + std::to_string(_pos);
+        _failed = true;
+    }
+    return false;
+}
+
+
+/**
+ * Scalar operator, for constant folding (and the reference for evaluate()).
+ */
+float Expression::_apply(opcode_t op, float a, float b)
+{
+    switch (op) {
+        case OP_ADD:  return a + b;
+        case OP_SUB:  return a - b;
+        case OP_MUL:  return a * b;
+        case OP_DIV:  return a / b;
+        case OP_MIN:  return std::min(a, b);
+        case OP_MAX:  return std::max(a, b);
+        case OP_NEG:  return -a;
+        case OP_ABS:  return std::fabs(a);
+        case OP_SQRT: return std::sqrt(a);
+        case OP_EXP:  return std::exp(a);
+        case OP_LOG:  return std::log(a);
+    }
+    return 0.0;
+}
+
+
+//==============================================================================
+// Evaluation
+
+/**
+ * Evaluate the expression for n sets of time-aligned input values.
+ *
+ * @param   inputs
+ *          one array of n values per name in inputs()
+ *
+ * @param   out
+ *          n results
+ *
+ * @pre     compile() succeeded
+ */
+void Expression::evaluate(const float* const* inputs, size_t n, float* out)
+{
+    for (size_t offset = 0; offset < n; offset += EXPRESSION_BLOCK) {
+        size_t m = std::min(EXPRESSION_BLOCK, n - offset);
+        for (size_t r = 0; r < _registers.size(); r++) {
+            if (_registers[r].kind == INPUT) {
+                _source[r] = inputs[_registers[r].input] + offset;
+            }
+        }
+
+        // Destination may be an operand: element-wise, so that is fine
+        for (const instruction_t& ins : _code) {
+            float* d = _target[ins.dst];
+            const float* a = _source[ins.a];
+            const float* b = _source[ins.b];
+            switch (ins.op) {
+                case OP_ADD:
+                    for (size_t i = 0; i < m; i++) d[i] = a[i] + b[i];
+                    break;
+                case OP_SUB:
+                    for (size_t i = 0; i < m; i++) d[i] = a[i] - b[i];
+                    break;
+                case OP_MUL:
+                    for (size_t i = 0; i < m; i++) d[i] = a[i] * b[i];
+                    break;
+                case OP_DIV:
+                    for (size_t i = 0; i < m; i++) d[i] = a[i] / b[i];
+                    break;
+                case OP_MIN:
+                    for (size_t i = 0; i < m; i++) d[i] = (b[i] < a[i]) ? b[i] : a[i];
+                    break;
+                case OP_MAX:
+                    for (size_t i = 0; i < m; i++) d[i] = (a[i] < b[i]) ? b[i] : a[i];
+                    break;
+                case OP_NEG:
+                    for (size_t i = 0; i < m; i++) d[i] = -a[i];
+                    break;
+                case OP_ABS:
+                    for (size_t i = 0; i < m; i++) d[i] = std::fabs(a[i]);
+                    break;
+                case OP_SQRT:
+                    for (size_t i = 0; i < m; i++) d[i] = std::sqrt(a[i]);
+                    break;
+                case OP_EXP:
+                    for (size_t i = 0; i < m; i++) d[i] = std::exp(a[i]);
+                    break;
+                case OP_LOG:
+                    for (size_t i = 0; i < m; i++) d[i] = std::log(a[i]);
+                    break;
+            }
+        }
+        std::memcpy(out + offset, _source[_result], m * sizeof(float));
+    }
+}
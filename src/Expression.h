@@ -0,0 +1,95 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Values evaluated per pass through the bytecode
+const size_t EXPRESSION_BLOCK = 256;
+
+// Registers of an expression (inputs, constants and temporaries)
+const size_t MAX_EXPRESSION_REGISTERS = 256;
+
+
+/**
+ * Arithmetic expression over variables, like "Vsoma - Vdend" or
+ * "1000 * cai_dend", for derived variables.
+ *
+ * The expression is compiled once into register bytecode. Every register
+ * holds a block of EXPRESSION_BLOCK values, and every instruction is a
+ * loop over a whole block, so the cost of dispatching an instruction is
+ * shared by a block of samples and the loops of the arithmetic operators
+ * are vectorized by the compiler.
+ *
+ * Syntax: numbers, variable names, + - * / (with the usual precedence),
+ * unary minus, parentheses and the functions abs, sqrt, exp, log (one
+ * argument), min and max (two arguments). Parts without variables are
+ * folded into constants when compiling.
+ */
+class Expression
+{
+  public:
+    Expression() : _pos(0), _failed(false), _result(0) {}
+
+    bool compile(const std::string& text);
+    const std::string& error() const { return _error; }
+
+    // Variable names in the expression, in order of first use
+    const std::vector<std::string>& inputs() const { return _inputs; }
+
+    void evaluate(const float* const* inputs, size_t n, float* out);
+
+  private:
+    enum opcode_t : uint8_t {
+        OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MIN, OP_MAX,
+        OP_NEG, OP_ABS, OP_SQRT, OP_EXP, OP_LOG
+    };
+
+    typedef struct {
+        opcode_t op;
+        uint8_t dst;
+        uint8_t a;
+        uint8_t b; // unused by unary operators
+    } instruction_t;
+
+    enum register_kind { INPUT, CONSTANT, TEMPORARY };
+
+    typedef struct {
+        register_kind kind;
+        size_t input;   // INPUT: index into inputs()
+        float value;    // CONSTANT
+    } register_info_t;
+
+    // Recursive descent, each returns the register holding the result
+    int _parse_sum();
+    int _parse_product();
+    int _parse_unary();
+    int _parse_primary();
+    int _parse_call(const std::string& name);
+
+    int _emit(opcode_t op, int a, int b = -1);
+    int _new_register(register_kind kind, size_t input = 0, float value = 0.0);
+    void _skip_space();
+    bool _fail(const std::string& message);
+    static float _apply(opcode_t op, float a, float b);
+
+    // Compiling
+    std::string _text;
+    size_t _pos;
+    bool _failed;
+    std::string _error;
+
+    // Program
+    std::vector<std::string> _inputs;
+    std::vector<register_info_t> _registers;
+    std::vector<instruction_t> _code;
+    int _result;
+
+    // Evaluation: one block per constant or temporary register
+    std::vector<float> _blocks;
+    std::vector<const float*> _source; // of each register, for this block
+    std::vector<float*> _target;       // of temporaries
+};
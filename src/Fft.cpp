@@ -0,0 +1,125 @@
+#include "Fft.h"
+#include <cmath>
+
+
+/**
+ * Prepare transforms of n real samples.
+ *
+ * @param   n
+ *          power of two, at least 4
+ */
+Fft::Fft(size_t n) :
+    _n(n),
+    _half(n / 2),
+    _bit_reverse(n / 2),
+    _stage_cos(n / 2),
+    _stage_sin(n / 2),
+    _split_cos(n / 2),
+    _split_sin(n / 2),
+    _re(n / 2 + 1),
+    _im(n / 2 + 1),
+    _spectrum_re(n / 2 + 1),
+    _spectrum_im(n / 2 + 1)
+{
+    int bits = 0;
+    while (((size_t) 1 << bits) < _half) {
+        bits++;
+    }
+    for (size_t i = 0; i < _half; i++) {
+        size_t reversed = 0;
+        for (int b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        _bit_reverse[i] = reversed;
+    }
+
+    // Stage combining transforms of size h into 2h uses e^(-pi i j / h), j < h
+    for (size_t h = 1; h < _half; h *= 2) {
+        for (size_t j = 0; j < h; j++) {
+            double angle = -M_PI * j / h;
+            _stage_cos[h + j] = std::cos(angle);
+            _stage_sin[h + j] = std::sin(angle);
+        }
+    }
+    for (size_t k = 0; k < _half; k++) {
+        double angle = -2.0 * M_PI * k / n;
+        _split_cos[k] = std::cos(angle);
+        _split_sin[k] = std::sin(angle);
+    }
+}
+
+
+/**
+ * In-place complex FFT of _half values (bit-reversal, then butterflies).
+ */
+void Fft::_transform(float* re, float* im) const
+{
+    for (size_t i = 0; i < _half; i++) {
+        size_t j = _bit_reverse[i];
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    for (size_t h = 1; h < _half; h *= 2) {
+        const float* __restrict w_re = &_stage_cos[h];
+        const float* __restrict w_im = &_stage_sin[h];
+        for (size_t group = 0; group < _half; group += 2 * h) {
+            float* __restrict a_re = re + group;
+            float* __restrict a_im = im + group;
+            float* __restrict b_re = re + group + h;
+            float* __restrict b_im = im + group + h;
+            for (size_t j = 0; j < h; j++) {
+                float t_re = b_re[j] * w_re[j] - b_im[j] * w_im[j];
+                float t_im = b_re[j] * w_im[j] + b_im[j] * w_re[j];
+                b_re[j] = a_re[j] - t_re;
+                b_im[j] = a_im[j] - t_im;
+                a_re[j] += t_re;
+                a_im[j] += t_im;
+            }
+        }
+    }
+}
+
+
+/**
+ * Spectrum of n real samples: n/2 + 1 complex values, for frequencies
+ * k / n (in units of the sample rate), k = 0..n/2.
+ */
+void Fft::forward(const float* signal, float* re, float* im)
+{
+    for (size_t i = 0; i < _half; i++) {
+        _re[i] = signal[2 * i];
+        _im[i] = signal[2 * i + 1];
+    }
+    _transform(_re.data(), _im.data());
+
+    // Z = FFT(even + i odd): X[k] = E[k] + e^(-2 pi i k / n) O[k] with
+    // E[k] = (Z[k] + conj(Z[h - k])) / 2, O[k] = (Z[k] - conj(Z[h - k])) / 2i
+    _re[_half] = _re[0];
+    _im[_half] = _im[0];
+    for (size_t k = 0; k <= _half; k++) {
+        size_t m = _half - k;
+        float e_re = 0.5f * (_re[k] + _re[m]);
+        float e_im = 0.5f * (_im[k] - _im[m]);
+        float o_re = 0.5f * (_im[k] + _im[m]);
+        float o_im = -0.5f * (_re[k] - _re[m]);
+        float w_re = (k < _half) ? _split_cos[k] : -1.0f;
+        float w_im = (k < _half) ? _split_sin[k] : 0.0f;
+        re[k] = e_re + w_re * o_re - w_im * o_im;
+        im[k] = e_im + w_re * o_im + w_im * o_re;
+    }
+}
+
+
+/**
+ * Squared magnitude of the spectrum of n real samples (n/2 + 1 values).
+ */
+void Fft::power_spectrum(const float* signal, float* power)
+{
+    forward(signal, _spectrum_re.data(), _spectrum_im.data());
+    for (size_t k = 0; k <= _half; k++) {
+        power[k] = _spectrum_re[k] * _spectrum_re[k] + _spectrum_im[k] * _spectrum_im[k];
+    }
+}
@@ -0,0 +1,47 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * Fast Fourier transform of real signals of one fixed power-of-two size.
+ *
+ * A real signal of n samples is transformed as n/2 complex samples (even
+ * and odd samples as real and imaginary part) with an iterative radix-2
+ * FFT, and the spectrum of the real signal is separated from the result.
+ *
+ * Complex values are kept as separate arrays of real and imaginary parts,
+ * and the twiddle factors of each stage are stored one after another, so
+ * the inner butterfly loop runs over contiguous arrays with unit stride
+ * and no shuffles, which compilers vectorize.
+ *
+ * Tables and work arrays are allocated once, in the constructor.
+ */
+class Fft
+{
+  public:
+    explicit Fft(size_t n);
+
+    size_t size() const { return _n; }
+
+    void power_spectrum(const float* signal, float* power);
+    void forward(const float* signal, float* re, float* im);
+
+  private:
+    void _transform(float* re, float* im) const;
+
+    size_t _n;    // real samples
+    size_t _half; // complex samples transformed
+
+    std::vector<size_t> _bit_reverse;   // of _half indices
+    std::vector<float> _stage_cos;      // twiddles, stage with span h at [h, 2h)
+    std::vector<float> _stage_sin;
+    std::vector<float> _split_cos;      // e^(-2 pi i k / n) for k < _half
+    std::vector<float> _split_sin;
+    std::vector<float> _re;             // work arrays
+    std::vector<float> _im;
+    std::vector<float> _spectrum_re;
+    std::vector<float> _spectrum_im;
+};
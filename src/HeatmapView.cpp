@@ -0,0 +1,167 @@
+#include "HeatmapView.h"
+#include "ofApp.h" // GraphedVariable
+#include "ColorMap.h"
+#include <limits>
+
+
+/**
+ * Forget binning state, e.g. when the view is switched on again:
+ * binning restarts at the newest samples.
+ */
+void HeatmapView::reset()
+{
+    _seq_next.clear();
+    _binning = false;
+}
+
+
+/**
+ * Add a column for the newest time bin completed since the last update.
+ *
+ * At most one column is added per frame, so the cost of a frame stays
+ * O(variables) with a single column upload. If the simulation completed
+ * several bins since the last frame, the older ones are skipped (choose
+ * dt_bin >= simulated time per frame to see every bin).
+ *
+ * @param   variables
+ *          All variables in display order, one row each
+ */
+void HeatmapView::update(const std::vector<std::shared_ptr<GraphedVariable>>& variables)
+{
+    if (variables.empty()) {
+        return;
+    }
+
+    // Rows: one per variable, or several variables per row if too many
+    int rows = std::min((int) variables.size(), MAX_ROWS);
+    if (!_texture.is_allocated() || rows > _texture.num_rows()
+                                 || num_columns != _texture.num_columns()) {
+        // leave room for variables that are discovered later
+        int rows_allocated = 64;
+        while (rows_allocated < rows) {
+            rows_allocated *= 2;
+        }
+        _texture.allocate(num_columns, std::min(rows_allocated, MAX_ROWS));
+        _row_sum.assign(_texture.num_rows(), 0.0);
+        _row_count.assign(_texture.num_rows(), 0);
+        _row_last.assign(_texture.num_rows(), NAN);
+        _column.assign(_texture.num_rows() * 4, 0);
+        reset();
+    }
+    _rows_used = rows;
+
+    // Start binning at the newest sample of new variables
+    float t_newest = -std::numeric_limits<float>::max();
+    size_t num_known = _seq_next.size();
+    _seq_next.resize(variables.size(), 0);
+    for (size_t i = 0; i < variables.size(); i++) {
+        auto view = variables[i]->samples->snapshot();
+        if (view.empty()) {
+            continue;
+        }
+        t_newest = std::max(t_newest, view.back().t);
+        if (i >= num_known) {
+            _seq_next[i] = view.seq_end();
+        }
+    }
+    if (t_newest == -std::numeric_limits<float>::max()) {
+        return; // no samples yet
+    }
+    if (!_binning || t_newest < _t_bin_begin) {
+        _t_bin_begin = t_newest;
+        _binning = true;
+        return;
+    }
+
+    int num_bins = (int) ((t_newest - _t_bin_begin) / dt_bin);
+    if (num_bins == 0) {
+        return;
+    }
+    if (num_bins > 1) {
+        _t_bin_begin += (num_bins - 1) * dt_bin;
+        _skip_to(variables, _t_bin_begin);
+    }
+    float t_bin_end = _t_bin_begin + dt_bin;
+    _emit_column(variables, t_bin_end);
+    _t_bin_begin = t_bin_end;
+}
+
+
+/**
+ * Drop the unbinned samples before t of every variable
+ * (a binary search each).
+ */
+void HeatmapView::_skip_to(const std::vector<std::shared_ptr<GraphedVariable>>& variables,
+                           float t)
+{
+    for (size_t i = 0; i < variables.size(); i++) {
+        auto view = variables[i]->samples->snapshot();
+        view.advance_begin(_seq_next[i]);
+        uint64_t seq = lower_bound_time(view, t);
+        _seq_next[i] = std::max(seq, view.validate());
+    }
+}
+
+
+/**
+ * Average the samples of each variable before t_bin_end
+ * and upload the resulting column.
+ */
+void HeatmapView::_emit_column(const std::vector<std::shared_ptr<GraphedVariable>>& variables,
+                               float t_bin_end)
+{
+    std::fill(_row_sum.begin(), _row_sum.end(), 0.0f);
+    std::fill(_row_count.begin(), _row_count.end(), 0);
+
+    size_t num_vars = variables.size();
+    for (size_t i = 0; i < num_vars; i++) {
+        const GraphedVariable& var = *variables[i];
+        int row = (int) (i * _rows_used / num_vars);
+
+        auto view = var.samples->snapshot();
+        view.advance_begin(_seq_next[i]);
+
+        float sum = 0.0;
+        int count = 0;
+        uint64_t seq = view.seq_begin();
+        for (; seq < view.seq_end(); ++seq) {
+            trace_point_t sample = view[seq];
+            if (sample.t >= t_bin_end) {
+                break;
+            }
+            sum += sample.v;
+            count++;
+        }
+        if (view.validate() > view.seq_begin()) {
+            continue; // overwritten while reading, skip this bin
+        }
+        _seq_next[i] = seq;
+
+        if (count > 0) {
+            // scale to [0, 1] using the plot limits of the variable
+            float mean = sum / count;
+            _row_sum[row] += (mean - var.v_lim_lower) / (var.v_lim_upper - var.v_lim_lower);
+            _row_count[row]++;
+        }
+    }
+
+    for (int row = 0; row < _texture.num_rows(); row++) {
+        if (_row_count[row] > 0) {
+            _row_last[row] = _row_sum[row] / _row_count[row];
+        }
+        colormap_rgba(_row_last[row], &_column[4 * row]);
+    }
+    _texture.write_column(_column.data());
+}
+
+
+/**
+ * Draw heatmap with the newest time bin at the right.
+ */
+void HeatmapView::draw(const ofRectangle& viewport) const
+{
+    ofPushStyle();
+    ofSetColor(255);
+    _texture.draw(viewport, _rows_used);
+    ofPopStyle();
+}
@@ -0,0 +1,54 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "ScrollingTexture.h"
+
+class GraphedVariable;
+
+
+/**
+ * Heatmap (waterfall) of many variables: one row per variable, one
+ * column per time bin, color is the mean value in the bin scaled to
+ * the variable's [v_lim_lower, v_lim_upper].
+ *
+ * Each sample is visited once, when its bin is completed, and each
+ * frame costs O(variables) plus at most one column upload to a
+ * ScrollingTexture. The depth of the history shown does not matter.
+ */
+class HeatmapView
+{
+  public:
+    HeatmapView() :
+        dt_bin(1.0),
+        num_columns(1024),
+        _t_bin_begin(0.0),
+        _binning(false),
+        _rows_used(0) {}
+
+    void update(const std::vector<std::shared_ptr<GraphedVariable>>& variables);
+    void draw(const ofRectangle& viewport) const;
+    void reset();
+
+    float dt_bin;    // [ms] simulated time per column
+    int num_columns; // number of time bins shown
+
+  private:
+    void _emit_column(const std::vector<std::shared_ptr<GraphedVariable>>& variables,
+                      float t_bin_end);
+    void _skip_to(const std::vector<std::shared_ptr<GraphedVariable>>& variables,
+                  float t);
+
+    static const int MAX_ROWS = 4096; // more variables share rows
+
+    ScrollingTexture _texture;
+    std::vector<uint64_t> _seq_next; // next unbinned sample per variable
+    std::vector<float> _row_sum;
+    std::vector<int> _row_count;
+    std::vector<float> _row_last;    // shown for rows without new samples
+    std::vector<uint8_t> _column;    // RGBA pixels of one column
+
+    float _t_bin_begin;
+    bool _binning; // false until first sample time is known
+    int _rows_used;
+};
@@ -0,0 +1,45 @@
+#include "HistoryCompressor.h"
+
+
+/**
+ * Queue a block of raw samples for compression.
+ *
+ * @param   seq_first
+ *          Sequence number of points[0] in the variable's SampleBuffer
+ */
+void HistoryCompressor::submit(std::shared_ptr<CompressedHistory> history,
+                               uint64_t seq_first,
+                               std::vector<trace_point_t>&& points)
+{
+    {
+        std::lock_guard<std::mutex> guard(_job_mutex);
+        if (_jobs.size() >= MAX_COMPRESS_JOBS) {
+            num_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        _jobs.push_back({history, seq_first, std::move(points)});
+    }
+    _job_available.notify_one();
+}
+
+
+/**
+ * Compress queued blocks until the thread is stopped.
+ */
+void HistoryCompressor::threadedFunction()
+{
+    while (isThreadRunning()) {
+        compress_job_t job;
+        {
+            std::unique_lock<std::mutex> lock(_job_mutex);
+            // Wake up regularly to notice when we are asked to stop
+            if (!_job_available.wait_for(lock, std::chrono::milliseconds(100),
+                                         [this] { return !_jobs.empty(); })) {
+                continue;
+            }
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+        job.history->append(job.seq_first, job.points.data(), job.points.size());
+    }
+}
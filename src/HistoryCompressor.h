@@ -0,0 +1,50 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "CompressedHistory.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+
+// Blocks waiting for compression at most (1024 samples each)
+const size_t MAX_COMPRESS_JOBS = 4096;
+
+
+/**
+ * Background thread that compresses full blocks of samples
+ * into the CompressedHistory of their variable.
+ *
+ * The ingest thread hands over raw blocks with submit() and
+ * never waits for compression to finish. If the compressor falls
+ * behind by MAX_COMPRESS_JOBS blocks, new blocks are dropped (they
+ * are missing from the history) rather than growing the queue.
+ */
+class HistoryCompressor : public ofThread
+{
+  public:
+    HistoryCompressor() : num_dropped(0) {}
+
+    void submit(std::shared_ptr<CompressedHistory> history,
+                uint64_t seq_first,
+                std::vector<trace_point_t>&& points);
+
+    std::atomic<uint64_t> num_dropped; // blocks, queue was full
+
+  protected:
+    void threadedFunction() override;
+
+  private:
+    typedef struct {
+        std::shared_ptr<CompressedHistory> history;
+        uint64_t seq_first;
+        std::vector<trace_point_t> points;
+    } compress_job_t;
+
+    std::mutex _job_mutex;
+    std::condition_variable _job_available;
+    std::deque<compress_job_t> _jobs;
+};
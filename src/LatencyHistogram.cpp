@@ -0,0 +1,110 @@
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+
+void LatencyHistogram::clear()
+{
+    std::memset(_buckets, 0, sizeof(_buckets));
+    _count = 0;
+    _sum = 0;
+    _max = 0;
+}
+
+
+void LatencyHistogram::add(uint64_t us)
+{
+    _buckets[_bucket(us)]++;
+    _count++;
+    _sum += us;
+    _max = std::max(_max, us);
+}
+
+
+/**
+ * Bucket index: exact below 8, else 8 buckets per power of two,
+ * selected by the 3 bits after the leading one.
+ */
+int LatencyHistogram::_bucket(uint64_t us)
+{
+    if (us < 8) {
+        return us;
+    }
+    int exponent = 63 - __builtin_clzll(us);
+    int sub = (us >> (exponent - 3)) & 7;
+    return (exponent - 2) * 8 + sub;
+}
+
+
+/**
+ * Largest value that falls into a bucket.
+ */
+uint64_t LatencyHistogram::_bucket_upper(int bucket)
+{
+    if (bucket < 8) {
+        return bucket;
+    }
+    int exponent = bucket / 8 + 2;
+    uint64_t lower = uint64_t(8 + bucket % 8) << (exponent - 3);
+    return lower + (uint64_t(1) << (exponent - 3)) - 1;
+}
+
+
+/**
+ * Upper bound of the q-quantile (q in [0, 1]), 0 if empty.
+ */
+uint64_t LatencyHistogram::percentile(double q) const
+{
+    if (_count == 0) {
+        return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, q * _count + 0.5);
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        seen += _buckets[i];
+        if (seen >= rank) {
+            return std::min(_bucket_upper(i), _max);
+        }
+    }
+    return _max;
+}
+
+
+/**
+ * One line for the stats overlay, in milliseconds.
+ */
+std::string LatencyHistogram::summary() const
+{
+    std::ostringstream line;
+    line << std::fixed;
+    line.precision(2);
+    line << "n " << _count << ", p50 " << percentile(0.5) * 1e-3
+         << ", p99 " << percentile(0.99) * 1e-3 << ", max " << _max * 1e-3 << " ms";
+    return line.str();
+}
+
+
+/**
+ * JSON object with count, mean, percentiles and the non-empty buckets
+ * (as [upper bound, count] pairs), all times in microseconds.
+ */
+void LatencyHistogram::write_json(std::ostream& os) const
+{
+    os << "{\"count\": " << _count
+       << ", \"mean_us\": " << mean()
+       << ", \"p50_us\": " << percentile(0.5)
+       << ", \"p90_us\": " << percentile(0.9)
+       << ", \"p99_us\": " << percentile(0.99)
+       << ", \"max_us\": " << _max
+       << ", \"buckets\": [";
+    bool first = true;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        if (_buckets[i] == 0) {
+            continue;
+        }
+        os << (first ? "" : ", ") << "[" << _bucket_upper(i) << ", " << _buckets[i] << "]";
+        first = false;
+    }
+    os << "]}";
+}
@@ -0,0 +1,58 @@
+#include "MidiEventQueue.h"
+
+
+/**
+ * Queue a message. Called on the MIDI input thread: no locks,
+ * no allocation.
+ */
+void MidiEventQueue::push(const ofxMidiMessage& msg)
+{
+    midi_event_t event;
+    event.t_received = ofGetElapsedTimeMicros();
+    event.status = msg.status;
+    event.channel = msg.channel;
+    event.port = msg.portNum;
+    switch (msg.status) {
+        case MIDI_CONTROL_CHANGE:
+            event.number = msg.control;
+            event.value = msg.value;
+            break;
+        case MIDI_NOTE_ON:
+        case MIDI_NOTE_OFF:
+            event.number = msg.pitch;
+            event.value = msg.velocity;
+            break;
+        default:
+            event.number = 0;
+            event.value = msg.value;
+            break;
+    }
+    if (!_queue.push(event)) {
+        num_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+/**
+ * Move all queued events to 'events' (appended, oldest first) and
+ * update the latency statistics.
+ *
+ * @return  number of events taken
+ */
+size_t MidiEventQueue::drain(std::vector<midi_event_t>& events)
+{
+    uint64_t t_now = ofGetElapsedTimeMicros();
+    size_t n = 0;
+    midi_event_t event;
+    while (_queue.pop(event)) {
+        events.push_back(event);
+        n++;
+
+        uint64_t latency = (t_now > event.t_received) ? t_now - event.t_received : 0;
+        num_drained++;
+        latency_last = latency;
+        latency_max = std::max(latency_max, latency);
+        latency_mean += (latency - latency_mean) / num_drained;
+    }
+    return n;
+}
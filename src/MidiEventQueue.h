@@ -0,0 +1,61 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "ofxMidi.h"
+#include "MpscQueue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+
+// One MIDI message, as queued by the MIDI input thread
+typedef struct {
+    uint64_t t_received; // [us] ofGetElapsedTimeMicros() in the callback
+    uint8_t status;      // MidiStatus
+    uint8_t channel;     // 1-16
+    uint8_t number;      // controller (CC) or pitch (notes)
+    uint8_t port;
+    int32_t value;       // CC value, velocity or pitch bend (0-16383)
+} midi_event_t;
+
+// Default number of MIDI events that can wait for the app
+const size_t DEFAULT_MIDI_QUEUE_CAPACITY = 4096;
+
+
+/**
+ * MIDI events from ofxMidi's input thread(s) to the app.
+ *
+ * newMidiMessage() runs on the input thread of each open port; it only
+ * timestamps the message and pushes it into a lock-free queue, so a fast
+ * knob sweep loses no events (unless the app stalls for thousands of
+ * them) and the input thread never waits for the app. The app drains the
+ * queue once per update() and gets the time events spent in the queue.
+ */
+class MidiEventQueue
+{
+  public:
+    MidiEventQueue(size_t capacity = DEFAULT_MIDI_QUEUE_CAPACITY) :
+        num_dropped(0),
+        num_drained(0),
+        latency_last(0),
+        latency_max(0),
+        latency_mean(0.0),
+        _queue(capacity) {}
+
+    void push(const ofxMidiMessage& msg);
+    size_t drain(std::vector<midi_event_t>& events);
+
+    // Written by the input thread(s)
+    std::atomic<uint64_t> num_dropped; // queue was full
+
+    // Callback-to-processing latency [us], written by drain()
+    uint64_t num_drained;
+    uint64_t latency_last; // of the newest drained event
+    uint64_t latency_max;
+    double latency_mean;
+
+  private:
+    MpscQueue<midi_event_t> _queue;
+};
@@ -0,0 +1,619 @@
+#include "Morphology.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring> // memcmp, ...
+#include <iostream>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+//==============================================================================
+// Number parsing
+//
+// strtod() needs a terminated string (a mapped file is not) and is locale
+// dependent, so we parse the plain decimal numbers of SWC ourselves.
+
+inline void skip_blanks(const char*& p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+}
+
+
+inline bool parse_int(const char*& p, const char* end, int32_t& out)
+{
+    skip_blanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    const char* digits = p;
+    int64_t value = 0;
+    while (p < end && *p >= '0' && *p <= '9' && value < INT32_MAX) {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    if (p == digits || value >= INT32_MAX) {
+        return false;
+    }
+    out = (int32_t) (negative ? -value : value);
+    return true;
+}
+
+
+inline bool parse_float(const char*& p, const char* end, float& out)
+{
+    static const double POW10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+        1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+    };
+
+    skip_blanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    // Up to 18 significant digits, more do not matter for a float
+    uint64_t mantissa = 0;
+    int num_digits = 0;
+    int exponent = 0;
+    const char* start = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (num_digits < 18) {
+            mantissa = mantissa * 10 + (*p - '0');
+            num_digits += (mantissa != 0);
+        } else {
+            exponent++;
+        }
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (num_digits < 18) {
+                mantissa = mantissa * 10 + (*p - '0');
+                num_digits += (mantissa != 0);
+                exponent--;
+            }
+            p++;
+        }
+    }
+    if (p == start || (p == start + 1 && *start == '.')) {
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        int32_t exp_value;
+        if (!parse_int(p, end, exp_value)) {
+            return false;
+        }
+        exponent += exp_value;
+    }
+
+    double value = (double) mantissa;
+    while (exponent > 18) {
+        value *= 1e18;
+        exponent -= 18;
+    }
+    while (exponent < -18) {
+        value /= 1e18;
+        exponent += 18;
+    }
+    value = (exponent >= 0) ? value * POW10[exponent] : value / POW10[-exponent];
+    out = (float) (negative ? -value : value);
+    return true;
+}
+
+
+inline void skip_line(const char*& p, const char* end)
+{
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    p = eol ? eol + 1 : end;
+}
+
+
+//==============================================================================
+// Binary cache layout: header followed by the arrays in declaration order
+
+const char CACHE_MAGIC[8] = {'N', 'M', 'C', 'S', 'W', 'C', '\0', '\0'};
+const uint32_t CACHE_VERSION = 2;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_points;
+    uint32_t num_sections;
+    uint32_t num_section_points;
+    uint64_t source_size;  // of the SWC file the cache was made from
+    int64_t source_mtime;  // [ns]
+} cache_header_t;
+
+
+/**
+ * Size of a cache file with the given array sizes.
+ */
+uint64_t cache_file_size(const cache_header_t& header)
+{
+    uint64_t n = header.num_points;
+    uint64_t num_sec = header.num_sections;
+    return sizeof(cache_header_t)
+           + n * (4 * sizeof(float) + sizeof(int32_t) + sizeof(uint8_t)
+                  + sizeof(int32_t) + sizeof(uint32_t))
+           + (num_sec + 1) * sizeof(uint32_t)
+           + header.num_section_points * sizeof(uint32_t)
+           + num_sec * sizeof(int32_t);
+}
+
+
+/**
+ * Modification time [ns], so that edits within a second are noticed.
+ */
+int64_t modification_time(const struct stat& st)
+{
+#ifdef __APPLE__
+    return (int64_t) st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+
+template <class T>
+bool write_array(std::FILE* file, const std::vector<T>& array)
+{
+    return std::fwrite(array.data(), sizeof(T), array.size(), file) == array.size();
+}
+
+
+template <class T>
+bool read_array(std::FILE* file, std::vector<T>& array, size_t n)
+{
+    array.resize(n);
+    return std::fread(array.data(), sizeof(T), n, file) == n;
+}
+
+} // namespace
+
+
+//==============================================================================
+// Loading
+
+/**
+ * Read a morphology from an SWC file, or from its binary cache if that
+ * is up to date.
+ *
+ * Errors (unreadable file, malformed lines, parent links to missing
+ * samples, cycles) are reported and leave the morphology empty.
+ *
+ * @return  true if a morphology was loaded
+ */
+bool Morphology::load(const std::string& swc_path, bool use_cache)
+{
+    clear();
+
+    int fd = ::open(swc_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "Could not open morphology file '" << swc_path << "'." << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        std::cout << "Morphology file '" << swc_path << "' is empty." << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    std::string cache_path = swc_path + ".cache";
+    if (use_cache && _read_cache(cache_path, st.st_size, modification_time(st))) {
+        ::close(fd);
+        return true;
+    }
+    clear();
+
+    // Map the file instead of reading it: a single pass over the bytes
+    // without copying them into a stream buffer first
+    size_t size = st.st_size;
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        std::cout << "Could not map morphology file '" << swc_path << "'." << std::endl;
+        return false;
+    }
+    ::madvise(data, size, MADV_SEQUENTIAL);
+
+    bool ok = _parse(static_cast<const char*>(data), size, swc_path)
+              && _link_parents(swc_path);
+    ::munmap(data, size);
+    if (!ok) {
+        clear();
+        return false;
+    }
+
+    _build_sections();
+    if (use_cache && !_write_cache(cache_path, st.st_size, modification_time(st))) {
+        std::cout << "Could not write morphology cache '" << cache_path << "'." << std::endl;
+    }
+    return true;
+}
+
+
+void Morphology::clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    radius.clear();
+    parent.clear();
+    type.clear();
+    swc_id.clear();
+    section.clear();
+    section_offset.clear();
+    section_points.clear();
+    section_parent.clear();
+    _parent_id.clear();
+    _index.clear();
+}
+
+
+/**
+ * Look up the points with the given SWC sample numbers.
+ *
+ * @param   points
+ *          indices of the points found are appended, in order of ids
+ *
+ * @return  false if some sample number is not in the morphology
+ */
+bool Morphology::find_points(const std::vector<unsigned int>& ids,
+                             std::vector<uint32_t>& points) const
+{
+    if (_index.empty()) {
+        _index.reserve(num_points());
+        for (size_t i = 0; i < num_points(); i++) {
+            _index.emplace(swc_id[i], i);
+        }
+    }
+
+    bool all_found = true;
+    for (unsigned int id : ids) {
+        auto it = _index.find((int32_t) id);
+        if (it != _index.end()) {
+            points.push_back(it->second);
+        } else {
+            all_found = false;
+        }
+    }
+    return all_found;
+}
+
+
+/**
+ * Parse SWC sample lines "id type x y z radius parent".
+ * Comments (#) and blank lines are skipped, extra columns are ignored.
+ */
+bool Morphology::_parse(const char* text, size_t size, const std::string& path)
+{
+    const char* p = text;
+    const char* end = text + size;
+
+    // Typical lines are 30-60 characters
+    size_t expected = size / 40 + 16;
+    x.reserve(expected);
+    y.reserve(expected);
+    z.reserve(expected);
+    radius.reserve(expected);
+    type.reserve(expected);
+    swc_id.reserve(expected);
+    _parent_id.reserve(expected);
+
+    size_t line = 0;
+    while (p < end) {
+        line++;
+        skip_blanks(p, end);
+        if (p == end) {
+            break;
+        }
+        if (*p == '#' || *p == '\n' || *p == '\r') {
+            skip_line(p, end);
+            continue;
+        }
+
+        int32_t id, sample_type, parent_id;
+        float px, py, pz, r;
+        if (!(parse_int(p, end, id) && parse_int(p, end, sample_type)
+              && parse_float(p, end, px) && parse_float(p, end, py)
+              && parse_float(p, end, pz) && parse_float(p, end, r)
+              && parse_int(p, end, parent_id))
+            || (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'))
+        {
+            std::cout << path << ":" << line << ": malformed SWC sample." << std::endl;
+            return false;
+        }
+        skip_line(p, end);
+
+        swc_id.push_back(id);
+        type.push_back((uint8_t) sample_type);
+        x.push_back(px);
+        y.push_back(py);
+        z.push_back(pz);
+        radius.push_back(r);
+        _parent_id.push_back(parent_id);
+    }
+
+    if (x.empty()) {
+        std::cout << path << ": no samples in morphology file." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Resolve parent sample numbers to indices and check that they
+ * form a forest (unique ids, existing parents, no cycles).
+ */
+bool Morphology::_link_parents(const std::string& path)
+{
+    size_t n = swc_id.size();
+    int32_t min_id = swc_id[0];
+    int32_t max_id = swc_id[0];
+    for (int32_t id : swc_id) {
+        min_id = std::min(min_id, id);
+        max_id = std::max(max_id, id);
+    }
+
+    // Sample numbers are nearly always 1..n, so usually a plain
+    // lookup table maps them to indices
+    std::vector<int32_t> dense;
+    std::unordered_map<int32_t, int32_t> sparse;
+    bool use_dense = min_id >= 0 && (size_t) max_id <= 4 * n + 16;
+    if (use_dense) {
+        dense.assign(max_id + 1, -1);
+    } else {
+        sparse.reserve(n);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        bool duplicate;
+        if (use_dense) {
+            duplicate = dense[swc_id[i]] >= 0;
+            dense[swc_id[i]] = i;
+        } else {
+            duplicate = !sparse.emplace(swc_id[i], (int32_t) i).second;
+        }
+        if (duplicate) {
+            std::cout << path << ": duplicate sample number " << swc_id[i] << "." << std::endl;
+            return false;
+        }
+    }
+
+    parent.resize(n);
+    bool ordered = true; // all parents precede their children
+    for (size_t i = 0; i < n; i++) {
+        int32_t pid = _parent_id[i];
+        if (pid < 0) {
+            parent[i] = -1;
+            continue;
+        }
+        int32_t index = -1;
+        if (use_dense) {
+            index = (pid <= max_id) ? dense[pid] : -1;
+        } else {
+            auto it = sparse.find(pid);
+            index = (it != sparse.end()) ? it->second : -1;
+        }
+        if (index < 0 || index == (int32_t) i) {
+            std::cout << path << ": sample " << swc_id[i]
+                      << " has invalid parent " << pid << "." << std::endl;
+            return false;
+        }
+        parent[i] = index;
+        ordered = ordered && index < (int32_t) i;
+    }
+    _parent_id.clear();
+    _parent_id.shrink_to_fit();
+
+    if (ordered) {
+        return true;
+    }
+
+    // Otherwise walk up from every point, marking points known to lead
+    // to a root, so that each point is visited a bounded number of times
+    std::vector<uint8_t> state(n, 0); // 0 unknown, 1 on current path, 2 reaches root
+    std::vector<int32_t> path_points;
+    for (size_t i = 0; i < n; i++) {
+        int32_t p = i;
+        path_points.clear();
+        while (p >= 0 && state[p] == 0) {
+            state[p] = 1;
+            path_points.push_back(p);
+            p = parent[p];
+        }
+        if (p >= 0 && state[p] == 1) {
+            std::cout << path << ": cycle in parent links at sample "
+                      << swc_id[p] << "." << std::endl;
+            return false;
+        }
+        for (int32_t q : path_points) {
+            state[q] = 2;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Split the tree into unbranched sections, depth first from each root.
+ */
+void Morphology::_build_sections()
+{
+    size_t n = num_points();
+
+    // Children as linked lists, in file order
+    std::vector<int32_t> first_child(n, -1);
+    std::vector<int32_t> next_sibling(n, -1);
+    std::vector<uint32_t> num_children(n, 0);
+    for (size_t i = n; i-- > 0; ) {
+        if (parent[i] >= 0) {
+            next_sibling[i] = first_child[parent[i]];
+            first_child[parent[i]] = i;
+            num_children[parent[i]]++;
+        }
+    }
+
+    section.assign(n, 0);
+    section_offset.assign(1, 0);
+    section_points.clear();
+    section_points.reserve(n + n / 8);
+    section_parent.clear();
+
+    // Points that start a section, roots in file order first
+    std::vector<int32_t> starts;
+    for (size_t i = n; i-- > 0; ) {
+        if (parent[i] < 0) {
+            starts.push_back(i);
+        }
+    }
+
+    std::vector<int32_t> children;
+    while (!starts.empty()) {
+        int32_t p = starts.back();
+        starts.pop_back();
+
+        uint32_t s = section_parent.size();
+        int32_t proximal = parent[p];
+        section_parent.push_back(proximal >= 0 ? (int32_t) section[proximal] : -1);
+        if (proximal >= 0) {
+            section_points.push_back(proximal);
+        }
+
+        // Follow the chain while it neither branches nor changes type
+        while (true) {
+            section[p] = s;
+            section_points.push_back(p);
+            int32_t child = first_child[p];
+            if (num_children[p] == 1 && type[child] == type[p]) {
+                p = child;
+                continue;
+            }
+            children.clear();
+            for (; child >= 0; child = next_sibling[child]) {
+                children.push_back(child);
+            }
+            starts.insert(starts.end(), children.rbegin(), children.rend());
+            break;
+        }
+        section_offset.push_back(section_points.size());
+    }
+}
+
+
+//==============================================================================
+// Binary cache
+
+/**
+ * Read the arrays from the cache, if it was made from a source
+ * file of the given size and modification time.
+ *
+ * The cache is checked before anything is allocated (the array sizes
+ * must add up to the file size) and the indices in it are checked
+ * before they are used, so a truncated, stale or foreign cache makes
+ * load() parse the SWC file instead.
+ */
+bool Morphology::_read_cache(const std::string& cache_path,
+                             uint64_t source_size, int64_t source_mtime)
+{
+    std::FILE* file = std::fopen(cache_path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    cache_header_t header = {};
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1
+              && std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+              && header.version == CACHE_VERSION
+              && header.source_size == source_size
+              && header.source_mtime == source_mtime;
+    struct stat st;
+    ok = ok && ::fstat(fileno(file), &st) == 0
+         && (uint64_t) st.st_size == cache_file_size(header);
+    if (!ok) {
+        std::fclose(file);
+        return false;
+    }
+
+    size_t n = header.num_points;
+    size_t num_sec = header.num_sections;
+    ok = ok
+         && read_array(file, x, n) && read_array(file, y, n) && read_array(file, z, n)
+         && read_array(file, radius, n) && read_array(file, parent, n)
+         && read_array(file, type, n) && read_array(file, swc_id, n)
+         && read_array(file, section, n)
+         && read_array(file, section_offset, num_sec + 1)
+         && read_array(file, section_points, header.num_section_points)
+         && read_array(file, section_parent, num_sec);
+    std::fclose(file);
+
+    // Indices must be in range, sections in order
+    ok = ok && n > 0 && section_offset[0] == 0
+         && section_offset.back() == section_points.size();
+    for (size_t i = 0; ok && i < n; i++) {
+        ok = parent[i] >= -1 && parent[i] < (int32_t) n && section[i] < num_sec;
+    }
+    for (size_t s = 0; ok && s < num_sec; s++) {
+        ok = section_offset[s] <= section_offset[s + 1]
+             && section_parent[s] >= -1 && section_parent[s] < (int32_t) num_sec;
+    }
+    for (size_t k = 0; ok && k < section_points.size(); k++) {
+        ok = section_points[k] < n;
+    }
+    return ok;
+}
+
+
+/**
+ * Write the arrays to a cache file. The file is written under a temporary
+ * name and renamed, so readers never see a partial cache.
+ */
+bool Morphology::_write_cache(const std::string& cache_path,
+                              uint64_t source_size, int64_t source_mtime) const
+{
+    cache_header_t header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.num_points = num_points();
+    header.num_sections = num_sections();
+    header.num_section_points = section_points.size();
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+
+    std::string tmp_path = cache_path + ".tmp";
+    std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+              && write_array(file, x) && write_array(file, y) && write_array(file, z)
+              && write_array(file, radius) && write_array(file, parent)
+              && write_array(file, type) && write_array(file, swc_id)
+              && write_array(file, section)
+              && write_array(file, section_offset)
+              && write_array(file, section_points)
+              && write_array(file, section_parent);
+    ok = (std::fclose(file) == 0) && ok;
+
+    if (!ok || std::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
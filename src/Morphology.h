@@ -0,0 +1,86 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Structure identifiers of the SWC format
+enum swc_type_t {
+    SWC_UNDEFINED = 0,
+    SWC_SOMA = 1,
+    SWC_AXON = 2,
+    SWC_BASAL_DENDRITE = 3,
+    SWC_APICAL_DENDRITE = 4,
+};
+
+
+/**
+ * Neuron morphology read from an SWC file.
+ *
+ * Sample points are stored as structure of arrays in file order, with
+ * parent links resolved to indices (-1 for roots). Each point with a
+ * parent is the distal end of one segment (parent -> point), so segment
+ * i is identified by its point index i.
+ *
+ * Unbranched chains of points form sections. A section starts at a root,
+ * after a branch point, or where the structure type changes, and lists
+ * its points proximal to distal, starting with the last point of its
+ * parent section (if any) so that it can be drawn on its own.
+ *
+ * Parsing large reconstructions costs tens of milliseconds, so after the
+ * first load the arrays are written to a binary cache next to the SWC
+ * file ("<file>.cache"), which is read instead while the SWC file keeps
+ * its size and modification time.
+ */
+class Morphology
+{
+  public:
+    bool load(const std::string& swc_path, bool use_cache = true);
+    void clear();
+
+    size_t num_points() const { return x.size(); }
+    size_t num_sections() const { return section_parent.size(); }
+
+    /**
+     * Points of section s are section_points[section_offset[s]]
+     * up to (excluding) section_points[section_offset[s + 1]].
+     */
+    size_t section_begin(size_t s) const { return section_offset[s]; }
+    size_t section_end(size_t s) const { return section_offset[s + 1]; }
+
+    bool find_points(const std::vector<unsigned int>& ids,
+                     std::vector<uint32_t>& points) const;
+
+    // Sample points
+    std::vector<float> x, y, z;
+    std::vector<float> radius;
+    std::vector<int32_t> parent;    // index of parent point, -1 for roots
+    std::vector<uint8_t> type;      // swc_type_t
+    std::vector<int32_t> swc_id;    // sample number in the SWC file
+    std::vector<uint32_t> section;  // section of each point
+
+    // Section topology
+    std::vector<uint32_t> section_offset;  // num_sections() + 1 entries
+    std::vector<uint32_t> section_points;
+    std::vector<int32_t> section_parent;   // -1 for sections at a root
+
+  private:
+    bool _parse(const char* text, size_t size, const std::string& path);
+    bool _link_parents(const std::string& path);
+    void _build_sections();
+
+    bool _read_cache(const std::string& cache_path,
+                     uint64_t source_size, int64_t source_mtime);
+    bool _write_cache(const std::string& cache_path,
+                      uint64_t source_size, int64_t source_mtime) const;
+
+    // Parent sample numbers as given in the file, until resolved
+    std::vector<int32_t> _parent_id;
+
+    // Sample number to point index, built on first lookup
+    mutable std::unordered_map<int32_t, uint32_t> _index;
+};
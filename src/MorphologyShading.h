@@ -0,0 +1,48 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "Morphology.h"
+
+
+// Value of segments or cells that no variable is bound to
+const float UNMAPPED_VALUE = -1e30;
+
+
+inline glm::vec3 point_at(const Morphology& m, uint32_t i)
+{
+    return glm::vec3(m.x[i], m.y[i], m.z[i]);
+}
+
+
+// Coloring and shading shared by the vertex shaders of MorphologyView
+// and CellScene, after COLORMAP_GLSL: values are mapped from
+// [v_lower, v_upper] through the color map, unmapped ones (see
+// UNMAPPED_VALUE) are drawn in 'color', and surfaces are lit by a
+// headlight from their normal.
+const char* const MORPHOLOGY_SHADING_GLSL = R"(
+uniform float v_lower;
+uniform float v_upper;
+uniform vec4 color;
+
+vec3 value_color(float value) {
+    if (value < -1e29) {
+        return color.rgb;
+    }
+    return colormap((value - v_lower) / (v_upper - v_lower));
+}
+
+float headlight(vec3 normal) {
+    return 0.35 + 0.65 * abs(normalize(gl_NormalMatrix * normal).z);
+}
+)";
+
+// Fragment shader for the colors computed per vertex
+const char* const MORPHOLOGY_FRAGMENT_SHADER = R"(
+#version 120
+varying vec4 v_color;
+
+void main() {
+    gl_FragColor = v_color;
+}
+)";
@@ -0,0 +1,477 @@
+#include "MorphologyView.h"
+#include "ColorMap.h"
+#include "MorphologyShading.h"
+#include <cstddef> // offsetof
+#include <cstring> // memcmp
+
+
+namespace {
+
+// Segment values: a float texture with one texel per segment, in rows
+// of values_size.x texels.
+const char* SEGMENT_COLOR_GLSL = R"(
+uniform sampler2D values;
+uniform vec2 values_size;
+
+vec3 segment_color(float segment) {
+    float row = floor(segment / values_size.x);
+    vec2 uv = vec2(segment - row * values_size.x + 0.5, row + 0.5) / values_size;
+    return value_color(texture2DLod(values, uv, 0.0).r);
+}
+)";
+
+// Cones are built around the unit cylinder (cos a, sin a, h), h in [0, 1]:
+// h selects the end, (x, y) the direction from the axis.
+const char* CONE_VERTEX_SHADER = R"(
+attribute vec4 seg_start; // xyz: proximal point, w: radius
+attribute vec4 seg_end;   // xyz: distal point, w: radius
+attribute float segment;
+varying vec4 v_color;
+
+void main() {
+    vec3 axis = seg_end.xyz - seg_start.xyz;
+    float len = length(axis);
+    vec3 w = (len > 0.0) ? axis / len : vec3(0.0, 0.0, 1.0);
+    vec3 helper = (abs(w.x) < 0.9) ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0);
+    vec3 u = normalize(cross(w, helper));
+    vec3 v = cross(w, u);
+
+    float h = gl_Vertex.z;
+    vec3 normal = u * gl_Vertex.x + v * gl_Vertex.y;
+    vec3 pos = seg_start.xyz + axis * h + normal * mix(seg_start.w, seg_end.w, h);
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(pos, 1.0);
+
+    v_color = vec4(segment_color(segment) * headlight(normal), color.a);
+}
+)";
+
+const char* LINE_VERTEX_SHADER = R"(
+attribute float segment;
+varying vec4 v_color;
+
+void main() {
+    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+    v_color = vec4(segment_color(segment), color.a);
+}
+)";
+
+// Width of the segment value texture
+const int VALUES_TEXTURE_WIDTH = 1024;
+
+// Longest run of segments merged into one cone
+const size_t MAX_MERGED_SEGMENTS = 32;
+
+
+/**
+ * Check if points first..last (indices into 'points') stay within
+ * half a radius of the straight line between first and last.
+ */
+bool is_straight(const Morphology& m, const uint32_t* points, size_t first, size_t last)
+{
+    glm::vec3 a = point_at(m, points[first]);
+    glm::vec3 axis = point_at(m, points[last]) - a;
+    float len2 = glm::dot(axis, axis);
+    for (size_t i = first + 1; i < last; i++) {
+        glm::vec3 d = point_at(m, points[i]) - a;
+        float t = (len2 > 0.0f) ? glm::dot(d, axis) / len2 : 0.0f;
+        glm::vec3 off = d - t * axis;
+        float tolerance = 0.5f * m.radius[points[i]];
+        if (glm::dot(off, off) > tolerance * tolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+
+//==============================================================================
+// Setup
+
+/**
+ * Precompute cone instances of all sections at all levels of detail
+ * and create the GL resources. Must be called with a GL context.
+ */
+void MorphologyView::setup(const Morphology& morphology)
+{
+    const Morphology& m = morphology;
+    _sections.clear();
+    _full.clear();
+    _merged.clear();
+    if (m.num_points() == 0) {
+        return;
+    }
+
+    glm::vec3 lo = point_at(m, 0);
+    glm::vec3 hi = lo;
+    for (size_t i = 0; i < m.num_points(); i++) {
+        lo = glm::min(lo, point_at(m, i));
+        hi = glm::max(hi, point_at(m, i));
+    }
+    _center = 0.5f * (lo + hi);
+    _extent = 0.5f * glm::length(hi - lo);
+
+    _sections.resize(m.num_sections());
+    for (size_t s = 0; s < m.num_sections(); s++) {
+        const uint32_t* points = m.section_points.data() + m.section_begin(s);
+        size_t n = m.section_end(s) - m.section_begin(s);
+        section_geometry_t& sec = _sections[s];
+
+        glm::vec3 sec_lo = point_at(m, points[0]);
+        glm::vec3 sec_hi = sec_lo;
+        sec.max_radius = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            sec_lo = glm::min(sec_lo, point_at(m, points[i]));
+            sec_hi = glm::max(sec_hi, point_at(m, points[i]));
+            sec.max_radius = std::max(sec.max_radius, m.radius[points[i]]);
+        }
+        sec.center = 0.5f * (sec_lo + sec_hi);
+        sec.bound_radius = 0.5f * glm::length(sec_hi - sec_lo) + sec.max_radius;
+        sec.lod = LOD_FULL;
+        sec.in_view = true;
+
+        // Single-point soma: a cone as wide as it is long
+        if (n == 1) {
+            glm::vec3 p = point_at(m, points[0]);
+            float r = m.radius[points[0]];
+            glm::vec3 dy(0.0, r, 0.0);
+            instance_t soma = {glm::vec4(p - dy, r), glm::vec4(p + dy, r),
+                               (float) points[0]};
+            sec.full_begin = _full.size();
+            _full.push_back(soma);
+            sec.full_end = _full.size();
+            sec.merged_begin = _merged.size();
+            _merged.push_back(soma);
+            sec.merged_end = _merged.size();
+            sec.mean_length = 2 * r;
+            continue;
+        }
+
+        float total_length = 0.0;
+        sec.full_begin = _full.size();
+        for (size_t i = 1; i < n; i++) {
+            glm::vec3 a = point_at(m, points[i - 1]);
+            glm::vec3 b = point_at(m, points[i]);
+            _full.push_back({glm::vec4(a, m.radius[points[i - 1]]),
+                             glm::vec4(b, m.radius[points[i]]),
+                             (float) points[i]});
+            total_length += glm::length(b - a);
+        }
+        sec.full_end = _full.size();
+        sec.mean_length = total_length / (n - 1);
+
+        // Greedily extend each merged cone while the section stays straight
+        sec.merged_begin = _merged.size();
+        size_t first = 0;
+        while (first + 1 < n) {
+            size_t last = first + 1;
+            while (last + 1 < n && last + 1 - first <= MAX_MERGED_SEGMENTS
+                   && is_straight(m, points, first, last + 1)) {
+                last++;
+            }
+            _merged.push_back({glm::vec4(point_at(m, points[first]), m.radius[points[first]]),
+                               glm::vec4(point_at(m, points[last]), m.radius[points[last]]),
+                               (float) points[last]});
+            first = last;
+        }
+        sec.merged_end = _merged.size();
+    }
+
+    _point_section = m.section;
+    _bvh.build(m);
+    _last_viewport_height = -1.0;
+
+    _setup_shaders();
+    _setup_cylinder(8);
+    _setup_values(m.num_points());
+
+    _instances.reserve(_full.size());
+    _line_vertices.reserve(2 * _merged.size());
+    _dirty = true;
+}
+
+
+void MorphologyView::_setup_shaders()
+{
+    std::string header = std::string("#version 120\n") + COLORMAP_GLSL
+                         + MORPHOLOGY_SHADING_GLSL + SEGMENT_COLOR_GLSL;
+
+    _shader.setupShaderFromSource(GL_VERTEX_SHADER, header + CONE_VERTEX_SHADER);
+    _shader.setupShaderFromSource(GL_FRAGMENT_SHADER, MORPHOLOGY_FRAGMENT_SHADER);
+    _shader.bindDefaults();
+    _shader.linkProgram();
+
+    _line_shader.setupShaderFromSource(GL_VERTEX_SHADER, header + LINE_VERTEX_SHADER);
+    _line_shader.setupShaderFromSource(GL_FRAGMENT_SHADER, MORPHOLOGY_FRAGMENT_SHADER);
+    _line_shader.bindDefaults();
+    _line_shader.linkProgram();
+}
+
+
+/**
+ * Create the instanced cylinder and attach the per-instance buffer.
+ * The buffer is sized for the most detailed level, so it never grows.
+ */
+void MorphologyView::_setup_cylinder(int sides)
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<ofIndexType> indices;
+    for (int i = 0; i < sides; i++) {
+        float angle = TWO_PI * i / sides;
+        vertices.push_back(glm::vec3(std::cos(angle), std::sin(angle), 0.0));
+        vertices.push_back(glm::vec3(std::cos(angle), std::sin(angle), 1.0));
+
+        ofIndexType a = 2 * i;
+        ofIndexType b = 2 * ((i + 1) % sides);
+        indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+    _cylinder.setVertexData(vertices.data(), vertices.size(), GL_STATIC_DRAW);
+    _cylinder.setIndexData(indices.data(), indices.size(), GL_STATIC_DRAW);
+    _num_cylinder_indices = indices.size();
+
+    _instance_capacity = _full.size();
+    _instance_buffer.allocate(_instance_capacity * sizeof(instance_t), GL_DYNAMIC_DRAW);
+
+    int loc_start = _shader.getAttributeLocation("seg_start");
+    int loc_end = _shader.getAttributeLocation("seg_end");
+    int loc_segment = _shader.getAttributeLocation("segment");
+    _cylinder.setAttributeBuffer(loc_start, _instance_buffer, 4, sizeof(instance_t),
+                                 offsetof(instance_t, start));
+    _cylinder.setAttributeBuffer(loc_end, _instance_buffer, 4, sizeof(instance_t),
+                                 offsetof(instance_t, end));
+    _cylinder.setAttributeBuffer(loc_segment, _instance_buffer, 1, sizeof(instance_t),
+                                 offsetof(instance_t, segment));
+    _cylinder.setAttributeDivisor(loc_start, 1);
+    _cylinder.setAttributeDivisor(loc_end, 1);
+    _cylinder.setAttributeDivisor(loc_segment, 1);
+}
+
+
+/**
+ * Create the segment value texture, with all segments unbound.
+ */
+void MorphologyView::_setup_values(size_t num_segments)
+{
+    _values_width = VALUES_TEXTURE_WIDTH;
+    _values_height = (num_segments + _values_width - 1) / _values_width;
+    _values.assign(_values_width * _values_height, UNMAPPED_VALUE);
+
+    // Texel lookup by normalized coordinates in the shader
+    ofTextureData data;
+    data.width = _values_width;
+    data.height = _values_height;
+    data.textureTarget = GL_TEXTURE_2D;
+    data.glInternalFormat = GL_R32F;
+    _values_texture.allocate(data);
+    _values_texture.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+    _bindings.clear();
+    _bound_points.clear();
+    update_values();
+}
+
+
+//==============================================================================
+// Values
+
+/**
+ * Color the given points (segments ending there) by the newest
+ * sample of a variable.
+ */
+void MorphologyView::bind_variable(std::shared_ptr<SampleBuffer> samples,
+                                   const std::vector<uint32_t>& points)
+{
+    size_t begin = _bound_points.size();
+    for (uint32_t point : points) {
+        if (point < _values.size()) {
+            _bound_points.push_back(point);
+        }
+    }
+    _bindings.push_back({samples, begin, _bound_points.size()});
+}
+
+
+/**
+ * Copy the newest sample of every bound variable to its segments and
+ * upload all segment values in one texture update.
+ */
+void MorphologyView::update_values()
+{
+    for (const binding_t& binding : _bindings) {
+        auto view = binding.samples->snapshot();
+        if (view.empty()) {
+            continue;
+        }
+        float v = view.back().v;
+        for (size_t i = binding.begin; i < binding.end; i++) {
+            _values[_bound_points[i]] = v;
+        }
+    }
+
+    if (_values_height == 0) {
+        return;
+    }
+    const ofTextureData& data = _values_texture.getTextureData();
+    glBindTexture(data.textureTarget, data.textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(data.textureTarget, 0, 0, 0, _values_width, _values_height,
+                    GL_RED, GL_FLOAT, _values.data());
+    glBindTexture(data.textureTarget, 0);
+}
+
+
+void MorphologyView::_set_value_uniforms(const ofShader& shader) const
+{
+    shader.setUniformTexture("values", _values_texture, 0);
+    shader.setUniform2f("values_size", _values_width, _values_height);
+    shader.setUniform1f("v_lower", v_lim_lower);
+    shader.setUniform1f("v_upper", v_lim_upper);
+    shader.setUniform4f("color", color.r, color.g, color.b, color.a);
+}
+
+
+//==============================================================================
+// Per frame
+
+/**
+ * Choose the level of detail of every section from its size on screen,
+ * if the camera moved. O(sections) plus the culling query; buffers are
+ * only refilled if a level changed.
+ */
+void MorphologyView::update(const ofCamera& camera, const ofRectangle& viewport)
+{
+    glm::mat4 mvp = camera.getModelViewProjectionMatrix(viewport);
+    if (std::memcmp(&mvp, &_last_mvp, sizeof(mvp)) == 0
+        && viewport.height == _last_viewport_height) {
+        return;
+    }
+    _last_mvp = mvp;
+    _last_viewport_height = viewport.height;
+    _cull(mvp);
+
+    glm::vec3 eye = camera.getGlobalPosition();
+    float pixels_per_unit = viewport.height / (2.0 * std::tan(ofDegToRad(camera.getFov()) / 2.0));
+
+    for (section_geometry_t& sec : _sections) {
+        // Nearest possible distance of any part of the section
+        float distance = std::max(glm::length(sec.center - eye) - sec.bound_radius, 1e-3f);
+        float scale = pixels_per_unit / distance;
+
+        lod_t lod = LOD_FULL;
+        if (!sec.in_view) {
+            lod = LOD_CULLED;
+        } else if (2 * sec.max_radius * scale < line_pixels) {
+            lod = LOD_LINES;
+        } else if (sec.mean_length * scale < merge_pixels) {
+            lod = LOD_MERGED;
+        }
+        if (lod != sec.lod) {
+            sec.lod = lod;
+            _dirty = true;
+        }
+    }
+
+    if (_dirty) {
+        _fill_buffers();
+    }
+}
+
+
+/**
+ * Mark the sections with at least one segment in the view frustum.
+ */
+void MorphologyView::_cull(const glm::mat4& model_view_projection)
+{
+    _bvh.cull(model_view_projection, _visible_segments);
+    for (section_geometry_t& sec : _sections) {
+        sec.in_view = false;
+    }
+    for (uint32_t segment : _visible_segments) {
+        _sections[_point_section[segment]].in_view = true;
+    }
+}
+
+
+/**
+ * Find the segment under screen position (x, y).
+ *
+ * @param   point
+ *          index of the distal point of the segment
+ *
+ * @return  false if there is no segment at that position
+ */
+bool MorphologyView::pick(const ofCamera& camera, const ofRectangle& viewport,
+                          float x, float y, uint32_t& point) const
+{
+    // Ray from the near to the far clipping plane
+    glm::vec3 near = camera.screenToWorld(glm::vec3(x, y, -1.0), viewport);
+    glm::vec3 far = camera.screenToWorld(glm::vec3(x, y, 1.0), viewport);
+    float distance;
+    return _bvh.pick(near, glm::normalize(far - near), point, distance);
+}
+
+
+/**
+ * Collect the instances and line vertices of the selected levels
+ * and upload them.
+ */
+void MorphologyView::_fill_buffers()
+{
+    _instances.clear();
+    _line_vertices.clear();
+    for (const section_geometry_t& sec : _sections) {
+        switch (sec.lod) {
+            case LOD_FULL:
+                _instances.insert(_instances.end(), _full.begin() + sec.full_begin,
+                                  _full.begin() + sec.full_end);
+                break;
+            case LOD_MERGED:
+                _instances.insert(_instances.end(), _merged.begin() + sec.merged_begin,
+                                  _merged.begin() + sec.merged_end);
+                break;
+            case LOD_LINES:
+                for (uint32_t i = sec.merged_begin; i < sec.merged_end; i++) {
+                    _line_vertices.push_back({glm::vec3(_merged[i].start), _merged[i].segment});
+                    _line_vertices.push_back({glm::vec3(_merged[i].end), _merged[i].segment});
+                }
+                break;
+            case LOD_CULLED:
+                break;
+        }
+    }
+
+    _num_instances = _instances.size();
+    if (_num_instances > 0) {
+        _instance_buffer.updateData(0, _num_instances * sizeof(instance_t), _instances.data());
+    }
+    _num_line_vertices = _line_vertices.size();
+    if (_num_line_vertices > 0) {
+        const line_vertex_t* first = _line_vertices.data();
+        _lines.setVertexData(&first->position.x, 3, _num_line_vertices,
+                             GL_DYNAMIC_DRAW, sizeof(line_vertex_t));
+        _lines.setAttributeData(_line_shader.getAttributeLocation("segment"),
+                                &first->segment, 1, _num_line_vertices,
+                                GL_DYNAMIC_DRAW, sizeof(line_vertex_t));
+    }
+    _dirty = false;
+}
+
+
+/**
+ * Draw with the current camera (call between camera.begin() and end()).
+ */
+void MorphologyView::draw() const
+{
+    if (_num_instances > 0) {
+        _shader.begin();
+        _set_value_uniforms(_shader);
+        _cylinder.drawElementsInstanced(GL_TRIANGLES, _num_cylinder_indices, _num_instances);
+        _shader.end();
+    }
+    if (_num_line_vertices > 0) {
+        _line_shader.begin();
+        _set_value_uniforms(_line_shader);
+        _lines.draw(GL_LINES, 0, _num_line_vertices);
+        _line_shader.end();
+    }
+}
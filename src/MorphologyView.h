@@ -0,0 +1,165 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "Morphology.h"
+#include "SampleBuffer.h"
+#include "SegmentBvh.h"
+
+#include <memory>
+#include <vector>
+
+
+/**
+ * 3D rendering of a cell morphology, after SharkViewer: every segment
+ * (parent point -> point) is a truncated cone.
+ *
+ * All cones are instances of one small cylinder mesh, positioned and
+ * scaled in the vertex shader from per-instance end points and radii,
+ * so the whole cell is drawn with one instanced draw call plus one draw
+ * call for the segments shown as lines.
+ *
+ * Level of detail is chosen per section from its projected size:
+ *
+ * - FULL:   one cone per segment
+ * - MERGED: unbranched runs of segments merged into longer cones
+ *           (while the points stay close to the merged axis)
+ * - LINES:  merged segments as line primitives, for thin or distant
+ *           sections that would be at most a pixel wide
+ *
+ * Sections outside the view frustum are culled (LOD_CULLED), using a
+ * BVH over the segments that also serves mouse picking. Levels are only
+ * re-evaluated when the camera moves, and instance and line buffers are
+ * only refilled when a level changed, by copying precomputed ranges.
+ *
+ * Simulated values are shown as colors: every instance and line vertex
+ * carries its segment index, and the vertex shader looks up the value
+ * of that segment in a float texture (one texel per segment) and applies
+ * the color map. When values change only that texture is uploaded, the
+ * geometry is never touched. Merged cones show the value of their most
+ * distal segment.
+ */
+class MorphologyView
+{
+  public:
+    MorphologyView() :
+        line_pixels(1.5),
+        merge_pixels(8.0),
+        color(ofFloatColor(0.25, 0.35, 0.6)),
+        v_lim_lower(-80.0),
+        v_lim_upper(40.0),
+        _last_viewport_height(-1.0),
+        _num_instances(0),
+        _num_line_vertices(0),
+        _dirty(true),
+        _instance_capacity(0),
+        _num_cylinder_indices(0),
+        _values_width(0),
+        _values_height(0),
+        _extent(0.0) {}
+
+    void setup(const Morphology& morphology);
+    bool empty() const { return _sections.empty(); }
+
+    void update(const ofCamera& camera, const ofRectangle& viewport);
+    void draw() const;
+
+    bool pick(const ofCamera& camera, const ofRectangle& viewport,
+              float x, float y, uint32_t& point) const;
+
+    void bind_variable(std::shared_ptr<SampleBuffer> samples,
+                       const std::vector<uint32_t>& points);
+    void update_values();
+
+    glm::vec3 center() const { return _center; }
+    float extent() const { return _extent; }
+
+    size_t num_instances() const { return _num_instances; }
+    size_t num_line_vertices() const { return _num_line_vertices; }
+
+    float line_pixels;  // draw as lines below this projected diameter
+    float merge_pixels; // merge segments below this projected length
+    ofFloatColor color; // of segments without a variable
+    float v_lim_lower;  // value range of the color map
+    float v_lim_upper;
+
+  protected:
+    enum lod_t { LOD_FULL, LOD_MERGED, LOD_LINES, LOD_CULLED };
+
+    // Per-instance attributes: segment end points (xyz) and radii (w)
+    typedef struct {
+        glm::vec4 start;
+        glm::vec4 end;
+        float segment; // index of the segment whose value is shown
+    } instance_t;
+
+    typedef struct {
+        glm::vec3 position;
+        float segment;
+    } line_vertex_t;
+
+    // Points colored by one variable: _bound_points[begin, end)
+    typedef struct {
+        std::shared_ptr<SampleBuffer> samples;
+        size_t begin;
+        size_t end;
+    } binding_t;
+
+    // Precomputed geometry of one section at all levels
+    typedef struct {
+        glm::vec3 center;  // bounding sphere
+        float bound_radius;
+        float max_radius;  // of the segments
+        float mean_length; // of the full-detail segments
+        uint32_t full_begin, full_end;     // range in _full
+        uint32_t merged_begin, merged_end; // range in _merged
+        lod_t lod;
+        bool in_view;      // some segment inside the view frustum
+    } section_geometry_t;
+
+    void _setup_shaders();
+    void _setup_cylinder(int sides);
+    void _setup_values(size_t num_segments);
+    void _cull(const glm::mat4& model_view_projection);
+    void _fill_buffers();
+    void _set_value_uniforms(const ofShader& shader) const;
+
+    std::vector<section_geometry_t> _sections;
+    std::vector<uint32_t> _point_section; // section of each segment
+
+    SegmentBvh _bvh;
+    std::vector<uint32_t> _visible_segments; // reused by _cull()
+
+    // Camera of the last level update
+    glm::mat4 _last_mvp;
+    float _last_viewport_height;
+    std::vector<instance_t> _full;
+    std::vector<instance_t> _merged;
+
+    // Instances and line vertices of the current levels
+    std::vector<instance_t> _instances;
+    std::vector<line_vertex_t> _line_vertices;
+    size_t _num_instances;
+    size_t _num_line_vertices;
+    bool _dirty; // levels changed since buffers were filled
+
+    ofVbo _cylinder;
+    ofBufferObject _instance_buffer;
+    size_t _instance_capacity;
+    int _num_cylinder_indices;
+    ofVbo _lines;
+    ofShader _shader;      // cones
+    ofShader _line_shader; // line-level sections
+
+    // Newest value of every segment, as a texture of rows
+    std::vector<float> _values;
+    ofTexture _values_texture;
+    int _values_width;
+    int _values_height;
+
+    std::vector<binding_t> _bindings;
+    std::vector<uint32_t> _bound_points;
+
+    glm::vec3 _center;
+    float _extent;
+};
@@ -0,0 +1,120 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+
+/**
+ * Bounded lock-free queue with any number of producers and one consumer
+ * (after Dmitry Vyukov's bounded MPMC queue, with a plain dequeue
+ * position since only one thread pops).
+ *
+ * Every slot carries a sequence number that tells whose turn it is: a
+ * producer claims slot pos by advancing the enqueue position with a CAS
+ * once the slot's sequence equals pos, writes the element and publishes
+ * it by setting the sequence to pos + 1 (release). The consumer takes
+ * the element when it sees pos + 1 (acquire) and hands the slot back to
+ * producers of the next round by setting it to pos + capacity.
+ *
+ * Pushing never blocks: if the queue is full the element is dropped and
+ * push() returns false, so a stalled consumer cannot stall a producer
+ * (e.g. a driver callback thread).
+ */
+template <typename T>
+class MpscQueue
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "MpscQueue elements must be trivially copyable");
+
+  public:
+    /**
+     * Create queue that holds at least min_capacity elements
+     * (rounded up to a power of two).
+     */
+    explicit MpscQueue(size_t min_capacity) :
+        _capacity(_round_pow2(min_capacity)),
+        _mask(_capacity - 1),
+        _slots(new slot_t[_capacity]),
+        _enqueue_pos(0),
+        _dequeue_pos(0)
+    {
+        for (size_t i = 0; i < _capacity; i++) {
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return _capacity; }
+
+    /**
+     * Append an element. Safe to call from any number of threads.
+     *
+     * @return  false if the queue is full (element dropped)
+     */
+    bool push(const T& element) {
+        uint64_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            slot_t& slot = _slots[pos & _mask];
+            uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            int64_t diff = (int64_t) seq - (int64_t) pos;
+            if (diff == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                                       std::memory_order_relaxed)) {
+                    slot.element = element;
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+                // pos was reloaded by the failed CAS
+            } else if (diff < 0) {
+                return false; // slot still holds an element of the last round
+            } else {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Take the oldest element. Must only be called from the consumer thread.
+     *
+     * @return  false if the queue is empty
+     */
+    bool pop(T& element) {
+        slot_t& slot = _slots[_dequeue_pos & _mask];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != _dequeue_pos + 1) {
+            return false;
+        }
+        element = slot.element;
+        slot.seq.store(_dequeue_pos + _capacity, std::memory_order_release);
+        _dequeue_pos++;
+        return true;
+    }
+
+  private:
+    typedef struct {
+        std::atomic<uint64_t> seq;
+        T element;
+    } slot_t;
+
+    static size_t _round_pow2(size_t n) {
+        size_t p = 1;
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    const size_t _capacity;
+    const size_t _mask;
+    std::unique_ptr<slot_t[]> _slots;
+
+    // Producers and the consumer write different positions: keep them
+    // on separate cache lines (padding, since alignas members would
+    // need aligned new)
+    std::atomic<uint64_t> _enqueue_pos;
+    char _padding[64];
+    uint64_t _dequeue_pos;
+};
@@ -0,0 +1,77 @@
+#include "PacingController.h"
+#include <algorithm>
+#include <cmath>
+
+
+/**
+ * Measure the rate and compute a new command once per interval.
+ *
+ * @param   t_sim
+ *          [ms] newest simulated time received
+ *
+ * @param   t_wall
+ *          [ms] current wall clock time
+ *
+ * @return  true if there is a new command to send
+ */
+bool PacingController::update(double t_sim, uint64_t t_wall)
+{
+    if (!enabled) {
+        return false;
+    }
+    if (!_started) {
+        _t_sim_last = t_sim;
+        _t_wall_last = t_wall;
+        _command = target;
+        _started = true;
+        return true;
+    }
+    if (t_wall - _t_wall_last < interval) {
+        return false;
+    }
+
+    double dt_wall = (t_wall - _t_wall_last) * 1e-3; // [s]
+    double rate = std::max(t_sim - _t_sim_last, 0.0) / dt_wall;
+    _t_sim_last = t_sim;
+    _t_wall_last = t_wall;
+
+    // Low-pass: sample messages arrive in bursts
+    double alpha = 1.0 - std::exp(-1e3 * dt_wall / tau);
+    _measured += alpha * (rate - _measured);
+    if (_measured <= 0.0) {
+        return false; // nothing received yet: hold the command
+    }
+
+    // The command only limits the simulator: one far above what it
+    // achieves has no effect, so keep it within headroom of the
+    // measured rate, which also bounds the integral for models that
+    // cannot reach the target
+    double error = std::log(target / _measured);
+    double log_min = std::log(std::max(rate_min, _measured / headroom) / target);
+    double log_max = std::log(std::min(rate_max, _measured * headroom) / target);
+
+    // Conditional integration (anti-windup)
+    double integral = _integral + ki * error * dt_wall;
+    double u = kp * error + integral;
+    if ((u > log_max && error > 0) || (u < log_min && error < 0)) {
+        u = kp * error + _integral;
+    } else {
+        _integral = integral;
+    }
+    u = std::min(std::max(u, log_min), log_max);
+
+    _command = target * std::exp(u);
+    return true;
+}
+
+
+/**
+ * Forget the measurement and the integral, e.g. when pacing is switched
+ * on again or the target changes a lot.
+ */
+void PacingController::reset()
+{
+    _started = false;
+    _integral = 0.0;
+    _measured = 0.0;
+}
@@ -0,0 +1,71 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstdint>
+
+
+/**
+ * Closed-loop pacing of the simulation: keeps simulated time advancing
+ * at a target rate relative to the wall clock (e.g. 1 sim-ms per
+ * wall-second) by sending the simulator a rate limit.
+ *
+ * The measured rate (newest sample time over wall time, low-pass
+ * filtered) is compared to the target every 'interval'. A PI controller
+ * sets the rate command. It works on the logarithm of the rates, so
+ * its gains mean the same for a model that manages 10 sim-ms per
+ * second as for one that manages 10 sim-s: the command is
+ *
+ *     command = target * exp(kp * e + integral),  e = log(target / measured)
+ *
+ * clamped to [rate_min, rate_max] and to within a factor 'headroom'
+ * of the measured rate. Anti-windup: the integral only grows while the
+ * command is not saturated in the direction of the error, so a model
+ * that cannot reach the target (or a simulator that is paused) does not
+ * wind it up, and the loop recovers at once when the target becomes
+ * reachable again. The integral is kept when the target changes: it
+ * holds the ratio of achieved to commanded rate, not the rate itself.
+ */
+class PacingController
+{
+  public:
+    PacingController() :
+        enabled(false),
+        target(1000.0),
+        kp(0.3),
+        ki(2.0),
+        rate_min(1e-3),
+        rate_max(1e7),
+        headroom(4.0),
+        interval(100),
+        tau(300.0),
+        _command(0.0),
+        _measured(0.0),
+        _integral(0.0),
+        _t_sim_last(0.0),
+        _t_wall_last(0),
+        _started(false) {}
+
+    bool update(double t_sim, uint64_t t_wall);
+    void reset();
+
+    double command() const { return _command; }   // [sim ms / wall s]
+    double measured() const { return _measured; } // [sim ms / wall s]
+
+    bool enabled;
+    double target;   // [sim ms / wall s]
+    double kp;       // proportional gain [1]
+    double ki;       // integral gain [1/s]
+    double rate_min; // command limits [sim ms / wall s]
+    double rate_max;
+    double headroom; // command at most this factor from the measured rate
+    uint64_t interval; // [ms] between commands
+    double tau;        // [ms] time constant of the rate measurement
+
+  private:
+    double _command;
+    double _measured;
+    double _integral; // [log units]
+    double _t_sim_last;
+    uint64_t _t_wall_last;
+    bool _started;
+};
@@ -0,0 +1,187 @@
+#include "ParameterControl.h"
+#include "Protocol.h"
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+
+//==============================================================================
+// Setup
+
+/**
+ * Read all [[midi.mapping]] tables. Invalid mappings are reported
+ * and skipped, like other config errors.
+ */
+void ParameterControl::parse_mappings(const cpptoml::table& config)
+{
+    auto mappings = config.get_table_array_qualified("midi.mapping");
+    if (!mappings) {
+        return;
+    }
+    for (const auto& descr : *mappings) {
+        auto p_control = descr->get_as<int>("cc");
+        auto p_parameter = descr->get_as<std::string>("parameter");
+        if (!(p_control && p_parameter) || *p_control < 0 || *p_control > 127) {
+            std::cout << "Each MIDI mapping must contain a controller "
+                      << "number (cc, 0-127) and a parameter name." << std::endl;
+            continue;
+        }
+        auto p_channel = descr->get_as<int>("channel");
+        auto p_lower = descr->get_as<double>("lower");
+        auto p_upper = descr->get_as<double>("upper");
+        auto p_curve = descr->get_as<std::string>("curve");
+
+        midi_mapping_t mapping;
+        mapping.channel = p_channel ? *p_channel : 0;
+        mapping.control = *p_control;
+        mapping.lower = p_lower ? *p_lower : 0.0;
+        mapping.upper = p_upper ? *p_upper : 1.0;
+        mapping.curve = CURVE_LINEAR;
+        if (p_curve && *p_curve == "exponential") {
+            if (mapping.lower * mapping.upper <= 0.0) {
+                std::cout << "Exponential MIDI mapping of '" << *p_parameter
+                          << "' needs a range of one sign, using linear." << std::endl;
+            } else {
+                mapping.curve = CURVE_EXPONENTIAL;
+            }
+        } else if (p_curve && *p_curve != "linear") {
+            std::cout << "Unknown curve '" << *p_curve << "' of MIDI mapping of '"
+                      << *p_parameter << "', using linear." << std::endl;
+        }
+        mapping.parameter = _parameter_index(*p_parameter);
+        _mappings.push_back(mapping);
+    }
+}
+
+
+size_t ParameterControl::_parameter_index(const std::string& name)
+{
+    for (size_t i = 0; i < _names.size(); i++) {
+        if (_names[i] == name) {
+            return i;
+        }
+    }
+    _names.push_back(name);
+    _values.push_back(0.0);
+    _pending.push_back(false);
+    return _names.size() - 1;
+}
+
+
+/**
+ * Create the control socket and connect it to the simulator.
+ *
+ * @param   socket_type
+ *          ZMQ_PUB or ZMQ_DEALER
+ */
+void ParameterControl::connect(zmq::context_t& context, int socket_type,
+                               const std::string& addr)
+{
+    _p_socket = std::make_unique<zmq::socket_t>(context, socket_type);
+
+    // Do not keep unsent parameters around after exit
+    int linger_ms = 0;
+    _p_socket->setsockopt(ZMQ_LINGER, &linger_ms, sizeof(linger_ms));
+    _p_socket->connect(addr);
+}
+
+
+//==============================================================================
+// Per update
+
+/**
+ * Set the pending value of every parameter mapped to a controller event.
+ * Other events are ignored.
+ */
+void ParameterControl::handle(const midi_event_t& event)
+{
+    if (event.status != MIDI_CONTROL_CHANGE) {
+        return;
+    }
+    float position = std::min(std::max(event.value, 0), 127) / 127.0f;
+    for (const midi_mapping_t& mapping : _mappings) {
+        if (mapping.control != event.number
+            || (mapping.channel != 0 && mapping.channel != event.channel)) {
+            continue;
+        }
+        if (_t_midi_oldest == 0) {
+            _t_midi_oldest = event.t_received;
+        }
+        float value;
+        if (mapping.curve == CURVE_EXPONENTIAL) {
+            value = mapping.lower * std::pow(mapping.upper / mapping.lower, position);
+        } else {
+            value = mapping.lower + (mapping.upper - mapping.lower) * position;
+        }
+        _set(mapping.parameter, value);
+    }
+}
+
+
+/**
+ * Set the pending value of a parameter by name, sent with the next
+ * flush() like controller values.
+ */
+void ParameterControl::set_parameter(const std::string& name, float value)
+{
+    _set(_parameter_index(name), value);
+}
+
+
+void ParameterControl::_set(size_t parameter, float value)
+{
+    _values[parameter] = value;
+    if (!_pending[parameter]) {
+        _pending[parameter] = true;
+        _num_pending++;
+    }
+}
+
+
+/**
+ * Send all pending parameter values in one message, unless the last
+ * message was sent less than 1 / max_rate ago.
+ *
+ * @param   t_now
+ *          [ms] current time
+ */
+void ParameterControl::flush(uint64_t t_now)
+{
+    if (_num_pending == 0 || !_p_socket) {
+        return;
+    }
+    if (max_rate > 0 && num_messages_sent > 0
+        && (t_now - _t_last_send) < 1000.0 / max_rate) {
+        return;
+    }
+
+    // Header: command id and send time, echoed by the simulator
+    uint64_t t_sent = ofGetElapsedTimeMicros();
+    char value[32];
+    _message.assign(MSG_TAG_PARAMETERS, MSG_TAG_SIZE);
+    _message += std::to_string(_next_id) + " " + std::to_string(t_sent) + "\n";
+    for (size_t i = 0; i < _names.size(); i++) {
+        if (!_pending[i]) {
+            continue;
+        }
+        std::snprintf(value, sizeof(value), " %.9g\n", _values[i]);
+        _message += _names[i];
+        _message += value;
+    }
+
+    // Never block the render thread, keep values pending if not sent
+    zmq::message_t msg(_message.data(), _message.size());
+    if (!_p_socket->send(msg, ZMQ_DONTWAIT)) {
+        num_send_failed++;
+        return;
+    }
+    if (_p_latency) {
+        _p_latency->sent(_next_id, _t_midi_oldest, t_sent);
+    }
+    std::fill(_pending.begin(), _pending.end(), false);
+    _num_pending = 0;
+    _t_midi_oldest = 0;
+    _t_last_send = t_now;
+    _next_id++;
+    num_messages_sent++;
+}
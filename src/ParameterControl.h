@@ -0,0 +1,107 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <limits> // needed by cpptoml.h
+#include "cpptoml.h"
+#include "zmq.hpp"
+#include "MidiEventQueue.h"
+#include "ControlLatency.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// How a controller position in [0, 1] maps to the parameter range
+enum mapping_curve_t {
+    CURVE_LINEAR,
+    CURVE_EXPONENTIAL, // equal ratios per step, for ranges of one sign
+};
+
+// One MIDI controller driving one simulator parameter
+typedef struct {
+    int channel;        // 1-16, 0 for any channel
+    int control;        // CC number
+    size_t parameter;   // index into parameter names
+    float lower;        // value at controller position 0
+    float upper;        // value at controller position 127
+    mapping_curve_t curve;
+} midi_mapping_t;
+
+// Default maximum rate of parameter messages
+const float DEFAULT_CONTROL_MAX_RATE = 30.0; // [Hz]
+
+
+/**
+ * Sends simulator parameters set with MIDI controllers back to NEURON,
+ * over its own ZMQ socket (PUB or DEALER).
+ *
+ * Controllers are mapped to parameters in the config file:
+ *
+ *     [[midi.mapping]]
+ *     channel = 1            # optional, any channel if missing
+ *     cc = 21
+ *     parameter = "soma.gnabar_hh"
+ *     lower = 0.0
+ *     upper = 0.5
+ *     curve = "linear"       # or "exponential"
+ *
+ * A knob sweep produces a CC message every few milliseconds. Incoming
+ * values only overwrite the pending value of their parameter; pending
+ * values are sent together in one message (MSG_TAG_PARAMETERS) at most
+ * max_rate times per second, so the simulator sees the latest value of
+ * every parameter without being flooded. Other parts of the app set
+ * parameters the same way with set_parameter().
+ *
+ * Every message starts with a command id and its send time, which the
+ * simulator can echo to measure control latency (see ControlLatency).
+ */
+class ParameterControl
+{
+  public:
+    ParameterControl() :
+        max_rate(DEFAULT_CONTROL_MAX_RATE),
+        num_messages_sent(0),
+        num_send_failed(0),
+        _p_latency(nullptr),
+        _t_last_send(0),
+        _num_pending(0),
+        _next_id(1),
+        _t_midi_oldest(0) {}
+
+    void parse_mappings(const cpptoml::table& config);
+    void connect(zmq::context_t& context, int socket_type, const std::string& addr);
+    void set_latency(ControlLatency* latency) { _p_latency = latency; }
+
+    bool empty() const { return _mappings.empty(); }
+    size_t num_parameters() const { return _names.size(); }
+
+    void handle(const midi_event_t& event);
+    void set_parameter(const std::string& name, float value);
+    void flush(uint64_t t_now);
+
+    float max_rate; // [Hz] of parameter messages
+
+    uint64_t num_messages_sent;
+    uint64_t num_send_failed; // no peer or send queue full, values kept
+
+  private:
+    size_t _parameter_index(const std::string& name);
+    void _set(size_t parameter, float value);
+
+    std::vector<midi_mapping_t> _mappings;
+
+    // Per parameter: name, newest value, whether it was not sent yet
+    std::vector<std::string> _names;
+    std::vector<float> _values;
+    std::vector<bool> _pending;
+
+    std::unique_ptr<zmq::socket_t> _p_socket;
+    ControlLatency* _p_latency; // informed of every command sent
+    uint64_t _t_last_send; // [ms]
+    size_t _num_pending;
+    uint64_t _next_id;       // of the next command
+    uint64_t _t_midi_oldest; // [us] oldest MIDI event pending, 0 if none
+    std::string _message; // reused buffer
+};
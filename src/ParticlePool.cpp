@@ -0,0 +1,181 @@
+#include "ParticlePool.h"
+
+
+namespace {
+
+const char* PARTICLE_VERTEX_SHADER = R"(
+#version 120
+uniform float point_size;
+varying float v_life;
+
+void main() {
+    v_life = gl_Vertex.w; // remaining fraction of the lifetime
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(gl_Vertex.xyz, 1.0);
+    gl_PointSize = point_size * (0.5 + 0.5 * v_life);
+}
+)";
+
+const char* PARTICLE_FRAGMENT_SHADER = R"(
+#version 120
+uniform vec4 color;
+varying float v_life;
+
+void main() {
+    vec2 d = gl_PointCoord - vec2(0.5);
+    float falloff = max(1.0 - 4.0 * dot(d, d), 0.0);
+    gl_FragColor = vec4(color.rgb, color.a * v_life * falloff);
+}
+)";
+
+} // namespace
+
+
+/**
+ * Allocate state for 'capacity' particles. Must be called with
+ * a GL context.
+ */
+void ParticlePool::setup(size_t capacity)
+{
+    for (auto* array : {&_px, &_py, &_pz, &_vx, &_vy, &_vz, &_age, &_lifetime}) {
+        array->assign(capacity, 0.0f);
+    }
+    _vertices.resize(capacity);
+    _size = 0;
+
+    _shader.setupShaderFromSource(GL_VERTEX_SHADER, PARTICLE_VERTEX_SHADER);
+    _shader.setupShaderFromSource(GL_FRAGMENT_SHADER, PARTICLE_FRAGMENT_SHADER);
+    _shader.bindDefaults();
+    _shader.linkProgram();
+}
+
+
+/**
+ * Emit particles at a position, flying off in random directions.
+ * Particles that do not fit into the pool are dropped.
+ *
+ * @param   speed
+ *          [units/s] initial speed
+ *
+ * @param   lifetime
+ *          [ms]
+ */
+void ParticlePool::emit(const glm::vec3& position, size_t count, float speed, float lifetime)
+{
+    size_t free = capacity() - _size;
+    if (count > free) {
+        _num_dropped += count - free;
+        count = free;
+    }
+
+    for (size_t i = _size; i < _size + count; i++) {
+        glm::vec3 dir(_random(), _random(), _random());
+        float len = glm::length(dir);
+        dir = (len > 1e-3f) ? dir / len : glm::vec3(0.0, 1.0, 0.0);
+
+        _px[i] = position.x;
+        _py[i] = position.y;
+        _pz[i] = position.z;
+        _vx[i] = dir.x * speed;
+        _vy[i] = dir.y * speed;
+        _vz[i] = dir.z * speed;
+        _age[i] = 0.0f;
+        _lifetime[i] = lifetime * (0.75f + 0.25f * _random());
+    }
+    _size += count;
+}
+
+
+/**
+ * Advance all particles by dt [ms] and remove expired ones.
+ */
+void ParticlePool::update(float dt)
+{
+    size_t n = _size;
+    float dt_s = dt * 1e-3f;
+    float decay = std::max(0.0f, 1.0f - damping * dt_s);
+
+    // Plain loops over separate arrays: vectorized by the compiler
+    float* px = _px.data();
+    float* py = _py.data();
+    float* pz = _pz.data();
+    float* vx = _vx.data();
+    float* vy = _vy.data();
+    float* vz = _vz.data();
+    float* age = _age.data();
+    for (size_t i = 0; i < n; i++) {
+        px[i] += vx[i] * dt_s;
+        py[i] += vy[i] * dt_s;
+        pz[i] += vz[i] * dt_s;
+    }
+    for (size_t i = 0; i < n; i++) {
+        vx[i] *= decay;
+        vy[i] *= decay;
+        vz[i] *= decay;
+        age[i] += dt;
+    }
+
+    // Replace expired particles by the last live one
+    size_t i = 0;
+    while (i < n) {
+        if (_age[i] < _lifetime[i]) {
+            i++;
+            continue;
+        }
+        n--;
+        _px[i] = _px[n];
+        _py[i] = _py[n];
+        _pz[i] = _pz[n];
+        _vx[i] = _vx[n];
+        _vy[i] = _vy[n];
+        _vz[i] = _vz[n];
+        _age[i] = _age[n];
+        _lifetime[i] = _lifetime[n];
+    }
+    _size = n;
+}
+
+
+/**
+ * Draw all live particles as point sprites with additive blending.
+ * Call with the camera of the scene active. Particles are hidden behind
+ * opaque geometry but do not write depth, so their order does not matter.
+ */
+void ParticlePool::draw()
+{
+    if (_size == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < _size; i++) {
+        _vertices[i] = glm::vec4(_px[i], _py[i], _pz[i], 1.0f - _age[i] / _lifetime[i]);
+    }
+    _vbo.setVertexData(&_vertices[0].x, 4, _size, GL_STREAM_DRAW, sizeof(glm::vec4));
+
+    ofPushStyle();
+    ofEnableBlendMode(OF_BLENDMODE_ADD);
+    ofEnablePointSprites();
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glDepthMask(GL_FALSE);
+    _shader.begin();
+    _shader.setUniform1f("point_size", point_size);
+    _shader.setUniform4f("color", color.r, color.g, color.b, color.a);
+    _vbo.draw(GL_POINTS, 0, _size);
+    _shader.end();
+    glDepthMask(GL_TRUE);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+    ofDisablePointSprites();
+    ofPopStyle();
+}
+
+
+/**
+ * Uniform random number in [-1, 1] (xorshift32: cheap and good enough
+ * for particle directions).
+ */
+float ParticlePool::_random()
+{
+    _rng_state ^= _rng_state << 13;
+    _rng_state ^= _rng_state >> 17;
+    _rng_state ^= _rng_state << 5;
+    return (_rng_state >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
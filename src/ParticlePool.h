@@ -0,0 +1,64 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * Fixed-capacity pool of short-lived particles.
+ *
+ * Particle state is kept as structure of arrays, allocated once. Live
+ * particles are always the first size() entries: expired ones are
+ * replaced by the last live particle, so nothing is allocated or freed
+ * per particle and the update loops run over plain contiguous arrays,
+ * which the compiler vectorizes.
+ *
+ * All particles are drawn as one batch of point sprites that shrink and
+ * fade over their lifetime.
+ */
+class ParticlePool
+{
+  public:
+    ParticlePool() :
+        point_size(12.0),
+        damping(2.0),
+        color(ofFloatColor(1.0, 0.8, 0.3, 1.0)),
+        _size(0),
+        _num_dropped(0),
+        _rng_state(0x9e3779b9u) {}
+
+    void setup(size_t capacity);
+
+    size_t capacity() const { return _age.size(); }
+    size_t size() const { return _size; }
+    uint64_t num_dropped() const { return _num_dropped; }
+
+    void emit(const glm::vec3& position, size_t count, float speed, float lifetime);
+    void update(float dt);
+    void clear() { _size = 0; }
+    void draw();
+
+    float point_size; // [pixels] of a new particle
+    float damping;    // [1/s] velocity decay
+    ofFloatColor color;
+
+  private:
+    float _random();
+
+    // Particle state, first _size entries are alive
+    std::vector<float> _px, _py, _pz;
+    std::vector<float> _vx, _vy, _vz;
+    std::vector<float> _age;      // [ms]
+    std::vector<float> _lifetime; // [ms]
+    size_t _size;
+    uint64_t _num_dropped; // not emitted because the pool was full
+
+    std::vector<glm::vec4> _vertices; // xyz, w: remaining life fraction
+    ofVbo _vbo;
+    ofShader _shader;
+
+    uint32_t _rng_state;
+};
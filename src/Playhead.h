@@ -0,0 +1,41 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <algorithm>
+
+
+/**
+ * Right edge of the time window shown by the scrolling views.
+ *
+ * Live, the window follows the newest samples. Frozen, it stays at a
+ * fixed simulated time that the user can move back through the samples
+ * still retained (ring buffer and compressed history) and forward up to
+ * the live edge, while the ingest thread keeps appending as usual.
+ */
+class Playhead
+{
+  public:
+    Playhead() :
+        frozen(false),
+        t_end(0.0) {}
+
+    /**
+     * Stop at the live edge, or go back to live.
+     */
+    void toggle(float t_live) {
+        frozen = !frozen;
+        t_end = t_live;
+    }
+
+    /**
+     * Move the frozen window by dt [ms], clamped to the retained samples.
+     */
+    void scrub(float dt, float t_oldest, float t_live) {
+        if (frozen) {
+            t_end = std::max(t_oldest, std::min(t_live, t_end + dt));
+        }
+    }
+
+    bool frozen;
+    float t_end; // [ms] simulated time at the right edge while frozen
+};
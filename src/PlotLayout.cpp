@@ -0,0 +1,143 @@
+#include "PlotLayout.h"
+#include "ofApp.h" // GraphedVariable
+
+
+/**
+ * Append a variable at the bottom of the stack.
+ */
+void PlotLayout::add(std::shared_ptr<GraphedVariable> variable)
+{
+    if (_y_top.empty()) {
+        _y_top.push_back(0.0);
+    }
+    variable->x_width_max = _viewport.width;
+    _variables.push_back(variable);
+    _y_top.push_back(_y_top.back() + variable->y_height_max());
+}
+
+
+/**
+ * Recompute plot positions after plot heights or viewport changed.
+ * O(variables), no per-sample work.
+ */
+void PlotLayout::relayout()
+{
+    _y_top.assign(1, 0.0);
+    for (const auto& variable : _variables) {
+        variable->x_width_max = _viewport.width;
+        _y_top.push_back(_y_top.back() + variable->y_height_max());
+    }
+    scroll_to(_scroll);
+}
+
+
+void PlotLayout::set_viewport(const ofRectangle& viewport)
+{
+    _viewport = viewport;
+    relayout();
+}
+
+
+float PlotLayout::content_height() const
+{
+    return _y_top.empty() ? 0.0 : _y_top.back();
+}
+
+
+void PlotLayout::scroll_by(float dy)
+{
+    scroll_to(_scroll + dy);
+}
+
+
+/**
+ * Scroll so that content coordinate y is at the top of the viewport,
+ * without scrolling past the end of the stack.
+ */
+void PlotLayout::scroll_to(float y)
+{
+    float max_scroll = std::max(0.0f, content_height() - _viewport.height);
+    _scroll = ofClamp(y, 0.0, max_scroll);
+}
+
+
+/**
+ * Scroll so that the plot of a variable is at the top of the viewport.
+ *
+ * @return  false if the variable is not in the layout
+ */
+bool PlotLayout::scroll_to_variable(const GraphedVariable* variable)
+{
+    for (size_t i = 0; i < _variables.size(); i++) {
+        if (_variables[i].get() == variable) {
+            scroll_to(_y_top[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Find the variables with a plot inside the viewport and
+ * give them their screen position.
+ */
+void PlotLayout::update_visible()
+{
+    _visible.clear();
+    if (_variables.empty()) {
+        return;
+    }
+
+    // First plot whose bottom is below the top of the viewport
+    auto it_bottom = std::upper_bound(_y_top.begin() + 1, _y_top.end(), _scroll);
+    size_t i_first = it_bottom - (_y_top.begin() + 1);
+
+    float y_end = _scroll + _viewport.height;
+    for (size_t i = i_first; i < _variables.size() && _y_top[i] < y_end; i++) {
+        GraphedVariable* variable = _variables[i].get();
+
+        // Axes origin is the bottom left corner of the plot
+        variable->ax_origin = ofPoint(_viewport.x,
+                                      _viewport.y + _y_top[i + 1] - _scroll);
+        _visible.push_back(variable);
+    }
+}
+
+
+/**
+ * Visible plot at screen coordinate y (nullptr if none).
+ */
+GraphedVariable* PlotLayout::visible_at(float y) const
+{
+    for (GraphedVariable* variable : _visible) {
+        if (y <= variable->ax_origin.y
+            && y > variable->ax_origin.y - variable->y_height_max()) {
+            return variable;
+        }
+    }
+    return nullptr;
+}
+
+
+/**
+ * Draw a scrollbar at the right of the viewport if not all plots fit.
+ */
+void PlotLayout::draw_scrollbar() const
+{
+    float height = content_height();
+    if (height <= _viewport.height) {
+        return;
+    }
+
+    float x = _viewport.getRight() + 10;
+    float bar_height = _viewport.height * _viewport.height / height;
+    float bar_y = _viewport.y + _viewport.height * _scroll / height;
+
+    ofPushStyle();
+    ofSetColor(200);
+    ofDrawRectangle(x, _viewport.y, 4, _viewport.height);
+    ofSetColor(100);
+    ofDrawRectangle(x, bar_y, 4, bar_height);
+    ofPopStyle();
+}
@@ -0,0 +1,59 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+
+#include <memory>
+#include <vector>
+
+class GraphedVariable;
+
+
+/**
+ * Vertical, scrollable stack of plots.
+ *
+ * Plot positions are kept in content coordinates (prefix sums of plot
+ * heights), so finding the plots inside the viewport is a binary search
+ * and only those get screen positions (GraphedVariable::ax_origin),
+ * geometry and draw calls. Off-screen variables keep receiving samples
+ * but cost nothing per frame.
+ */
+class PlotLayout
+{
+  public:
+    PlotLayout() : _scroll(0.0) {}
+
+    void add(std::shared_ptr<GraphedVariable> variable);
+    void relayout();
+
+    void set_viewport(const ofRectangle& viewport);
+    const ofRectangle& viewport() const { return _viewport; }
+
+    void scroll_by(float dy);
+    void scroll_to(float y);
+    bool scroll_to_variable(const GraphedVariable* variable);
+    float scroll() const { return _scroll; }
+    float content_height() const;
+
+    void update_visible();
+    const std::vector<GraphedVariable*>& visible() const { return _visible; }
+    GraphedVariable* visible_at(float y) const;
+
+    void draw_scrollbar() const;
+
+    size_t size() const { return _variables.size(); }
+    const std::vector<std::shared_ptr<GraphedVariable>>& variables() const {
+        return _variables;
+    }
+
+  private:
+    // Variables in display order, with top of each plot in content
+    // coordinates; _y_top has one extra entry for the end of the stack.
+    std::vector<std::shared_ptr<GraphedVariable>> _variables;
+    std::vector<float> _y_top;
+
+    std::vector<GraphedVariable*> _visible; // updated once per frame
+
+    ofRectangle _viewport; // screen area showing plots
+    float _scroll;         // content y at top of viewport
+};
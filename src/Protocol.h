@@ -0,0 +1,48 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+
+// Message types on the data socket.
+//
+// Plain sample messages (see NEURON-sockets/ZmqOutputVars.mod) are a
+// sequence of sample_t triples without header. All other messages start
+// with a four-character tag. A sample message can not start with a tag:
+// the first bytes of a small integer gid stored as double are zero.
+
+// Variable metadata, text body with one "<gid> <name>\n" line per variable
+const char MSG_TAG_METADATA[4] = {'M', 'E', 'T', 'A'};
+
+// Spike events, body is a sequence of spike_msg_t pairs
+const char MSG_TAG_SPIKES[4] = {'S', 'P', 'K', 'E'};
+
+// Parameter updates on the control socket (to the simulator), text body
+// with a "<command id> <send time [us]>\n" line followed by one
+// "<parameter> <value>\n" line per parameter
+const char MSG_TAG_PARAMETERS[4] = {'P', 'A', 'R', 'M'};
+
+// Echo of parameter updates on the data socket, text body with one
+// "<command id> <t>\n" line per command, where t [ms] is the simulated
+// time from which its parameters are in effect. Optional: only used to
+// measure control latency.
+const char MSG_TAG_ECHO[4] = {'E', 'C', 'H', 'O'};
+
+const size_t MSG_TAG_SIZE = 4;
+
+
+// Wire format of one spike event
+typedef struct {
+    double gid;
+    double t;
+} spike_msg_t;
+
+
+/**
+ * Check if message data starts with the given tag.
+ */
+inline bool has_message_tag(const void* data, size_t size, const char tag[4])
+{
+    return size >= MSG_TAG_SIZE && std::memcmp(data, tag, MSG_TAG_SIZE) == 0;
+}
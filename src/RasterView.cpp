@@ -0,0 +1,97 @@
+#include "RasterView.h"
+
+
+/**
+ * Extend the gid range with events that arrived since the last update.
+ */
+void RasterView::update(const spike_stores_t& spikes)
+{
+    for (int source = 0; source < NUM_SPIKE_SOURCES; source++) {
+        if (!spikes[source]) {
+            continue;
+        }
+        auto view = spikes[source]->snapshot();
+        view.advance_begin(_seq_scanned[source]);
+        for (uint64_t seq = view.seq_begin(); seq < view.seq_end(); ++seq) {
+            uint32_t gid = view[seq].gid;
+            _gid_min = std::min(_gid_min, gid);
+            _gid_max = std::max(_gid_max, gid);
+        }
+        _seq_scanned[source] = view.seq_end();
+    }
+}
+
+
+/**
+ * Draw all spikes that fall inside the viewport's time window.
+ */
+void RasterView::draw(const spike_stores_t& spikes, const ofRectangle& viewport,
+                      const Playhead& playhead)
+{
+    ofPushStyle();
+    ofNoFill();
+    ofSetColor(200);
+    ofDrawRectangle(viewport);
+
+    // Time window ending at the newest spike of any source, or at the
+    // frozen playhead
+    bool any = false;
+    float t_newest = -std::numeric_limits<float>::infinity();
+    for (const auto& store : spikes) {
+        if (!store) {
+            continue;
+        }
+        auto all = store->snapshot();
+        if (!all.empty()) {
+            t_newest = std::max(t_newest, all.back().t);
+            any = true;
+        }
+    }
+    if (!any || _gid_min > _gid_max) {
+        ofPopStyle();
+        return;
+    }
+    float t_end = playhead.frozen ? playhead.t_end : t_newest;
+    float t_begin = t_end - viewport.width / x_per_t;
+
+    float row_height = viewport.height / (_gid_max - _gid_min + 1);
+
+    // Fill vertex array in place: no per-spike allocation
+    auto& vertices = _points.getVertices();
+    size_t num_shown = 0;
+    for (const auto& store : spikes) {
+        if (!store) {
+            continue;
+        }
+        auto view = store->snapshot_since(t_begin);
+        size_t first = num_shown;
+        vertices.resize(num_shown + view.size());
+        for (uint64_t seq = view.seq_begin(); seq < view.seq_end(); ++seq) {
+            spike_event_t spike = view[seq];
+            if (spike.t > t_end) {
+                break; // newer than the frozen window
+            }
+            vertices[num_shown++] = ofPoint(
+                viewport.x + (spike.t - t_begin) * x_per_t,
+                viewport.y + (std::min(spike.gid, _gid_max) - _gid_min + 0.5f) * row_height);
+        }
+        vertices.resize(num_shown);
+
+        // Drop events of this store that were overwritten while we read them
+        uint64_t seq_intact = view.validate();
+        if (seq_intact > view.seq_begin()) {
+            size_t num_lost = std::min<uint64_t>(seq_intact - view.seq_begin(),
+                                                 num_shown - first);
+            vertices.erase(vertices.begin() + first, vertices.begin() + first + num_lost);
+            num_shown -= num_lost;
+        }
+    }
+
+    ofSetColor(0);
+    glPointSize(point_size);
+    _points.draw();
+
+    ofDrawBitmapString("gid " + ofToString(_gid_min), viewport.x - 70, viewport.y + 10);
+    ofDrawBitmapString("gid " + ofToString(_gid_max), viewport.x - 70, viewport.getBottom());
+    ofPopStyle();
+}
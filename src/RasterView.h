@@ -0,0 +1,48 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "SpikeStore.h"
+#include "Playhead.h"
+
+#include <limits>
+
+
+/**
+ * Spike raster plot: one row per cell (ordered by gid), one point per
+ * spike, scrolling with the newest spike time at the right edge (or
+ * standing still at the playhead while it is frozen).
+ *
+ * All spikes in the time window, published and detected, are drawn as
+ * a single point mesh, so the cost per frame is one vertex per visible
+ * spike and one draw call.
+ */
+class RasterView
+{
+  public:
+    RasterView() :
+        x_per_t(0.5),
+        point_size(2.0),
+        _gid_min(std::numeric_limits<uint32_t>::max()),
+        _gid_max(0),
+        _seq_scanned()
+    {
+        _points.setMode(OF_PRIMITIVE_POINTS);
+        _points.setUsage(GL_STREAM_DRAW);
+    }
+
+    void update(const spike_stores_t& spikes);
+    void draw(const spike_stores_t& spikes, const ofRectangle& viewport,
+              const Playhead& playhead);
+
+    float x_per_t;    // [pixels / ms]
+    float point_size; // [pixels]
+
+  private:
+    ofVboMesh _points;
+
+    // Range of gids seen so far, determines row height
+    uint32_t _gid_min;
+    uint32_t _gid_max;
+    uint64_t _seq_scanned[NUM_SPIKE_SOURCES]; // events already included in gid range
+};
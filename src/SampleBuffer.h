@@ -0,0 +1,50 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "SnapshotRing.h"
+
+
+// Wire format of one sample published by NEURON-sockets/ZmqOutputVars.mod
+typedef struct {
+    double gid;
+    double t;
+    double v;
+} sample_t;
+
+
+// Storage format of one sample of a graphed variable.
+// Small enough to be stored as a lock-free atomic in SnapshotRing.
+typedef struct {
+    float t;
+    float v;
+} trace_point_t;
+
+
+// Per-variable sample store, written by the ingest thread
+// and read by the render thread.
+typedef SnapshotRing<trace_point_t> SampleBuffer;
+
+// Default number of samples retained per variable
+const size_t DEFAULT_BUFFER_CAPACITY = 1 << 16;
+
+
+/**
+ * Find first sequence number in view with sample time t >= t_min.
+ *
+ * Samples of a variable arrive in order of increasing time,
+ * so we can do a binary search.
+ */
+inline uint64_t lower_bound_time(const SampleBuffer::View& view, float t_min)
+{
+    uint64_t lo = view.seq_begin();
+    uint64_t hi = view.seq_end();
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (view[mid].t < t_min) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
@@ -0,0 +1,541 @@
+#include "SampleReceiver.h"
+#include "ofApp.h" // DBGMSG
+#include "Protocol.h"
+#include <algorithm>
+#include <cstring> // memcpy, ...
+#include <limits>
+
+
+/**
+ * Register the sample buffer for a variable.
+ *
+ * @param   history
+ *          If given, samples are also kept in compressed form once
+ *          a full block has arrived (requires set_compressor()).
+ *
+ * @pre     thread has not been started yet
+ */
+void SampleReceiver::add_buffer(unsigned int gid,
+                                std::shared_ptr<SampleBuffer> buffer,
+                                std::shared_ptr<CompressedHistory> history)
+{
+    ingest_slot_t& slot = _slots[gid];
+    slot.buffer = buffer;
+    slot.staging.reserve(256);
+    slot.history = history;
+    slot.seq_uncompressed = 0;
+    slot.discovered = false;
+}
+
+
+/**
+ * Set the thread that compresses history blocks.
+ *
+ * @pre     thread has not been started yet
+ */
+void SampleReceiver::set_compressor(HistoryCompressor* compressor)
+{
+    _p_compressor = compressor;
+}
+
+
+/**
+ * Create buffers for gids that were not registered with add_buffer()
+ * when their first sample arrives.
+ *
+ * @param   buffer_capacity
+ *          Capacity of buffers for discovered variables (usually much
+ *          smaller than for configured ones)
+ *
+ * @param   max_variables, max_bytes
+ *          Stop discovering after this many variables, or when their
+ *          buffers would take more than max_bytes, so that a
+ *          misbehaving publisher can not exhaust memory.
+ *
+ * @pre     thread has not been started yet
+ */
+void SampleReceiver::enable_discovery(size_t buffer_capacity, size_t max_variables,
+                                      size_t max_bytes)
+{
+    _discovery_enabled = true;
+    _discovery_capacity = buffer_capacity;
+    _discovery_max_vars = max_variables;
+    _discovery_max_bytes = max_bytes;
+}
+
+
+/**
+ * Move variables discovered since the last call into 'discovered'.
+ *
+ * Called by the render thread. Never waits for the ingest thread:
+ * if it is busy registering a variable we pick it up next frame.
+ */
+void SampleReceiver::take_discovered(std::vector<discovered_var_t>& discovered)
+{
+    std::unique_lock<std::mutex> lock(_discovered_mutex, std::try_to_lock);
+    if (lock.owns_lock() && !_discovered.empty()) {
+        discovered.swap(_discovered);
+        _discovered.clear();
+    }
+}
+
+
+/**
+ * Set the stores for spike event messages and for detected spikes.
+ * Without a store, spike messages are ignored, or no spikes are
+ * detected.
+ *
+ * @pre     thread has not been started yet
+ */
+void SampleReceiver::set_spike_stores(const spike_stores_t& spikes)
+{
+    _spikes = spikes;
+}
+
+
+/**
+ * Detect spikes in the samples of a registered variable, as they
+ * arrive. Detected spikes go to the store of detected spikes (see
+ * set_spike_stores()) with the variable's gid.
+ *
+ * @pre     buffer of gid was added, thread has not been started yet
+ */
+void SampleReceiver::add_spike_detector(unsigned int gid, float threshold, float refractory)
+{
+    auto it = _slots.find(gid);
+    if (it != _slots.end()) {
+        it->second.detector = std::make_unique<SpikeDetector>(gid, threshold, refractory);
+    }
+}
+
+
+/**
+ * Compute a variable from the samples of others as they arrive.
+ *
+ * Samples of the inputs are matched by time (the simulator publishes
+ * all variables of a time step together) and the expression is
+ * evaluated for all samples matched in a message at once. Input samples
+ * without a match in every other input are dropped.
+ *
+ * @param   input_gids
+ *          gid of each name in expression->inputs()
+ *
+ * @pre     buffers of gid and of all inputs were added,
+ *          thread has not been started yet
+ */
+void SampleReceiver::add_derived(unsigned int gid, std::unique_ptr<Expression> expression,
+                                 const std::vector<unsigned int>& input_gids)
+{
+    derived_t derived;
+    derived.output = &_slots.at(gid);
+    for (unsigned int input_gid : input_gids) {
+        derived.inputs.push_back(&_slots.at(input_gid));
+    }
+    derived.pending.resize(input_gids.size());
+    derived.pending_begin.resize(input_gids.size(), 0);
+    derived.expression = std::move(expression);
+    _derived.push_back(std::move(derived));
+
+    if (_aligned_values.size() < input_gids.size()) {
+        _aligned_values.resize(input_gids.size());
+        _aligned_index.resize(input_gids.size());
+        _aligned_inputs.resize(input_gids.size());
+    }
+}
+
+
+/**
+ * Report echoed control commands to a latency tracker. Without it,
+ * echo messages are ignored.
+ *
+ * @pre     thread has not been started yet
+ */
+void SampleReceiver::set_latency(ControlLatency* latency)
+{
+    _p_latency = latency;
+}
+
+
+/**
+ * Receive loop of the ingest thread.
+ *
+ * The socket must have a receive timeout (ZMQ_RCVTIMEO) so that
+ * we notice when the thread is asked to stop.
+ */
+void SampleReceiver::threadedFunction()
+{
+    zmq::message_t update;
+    while (isThreadRunning()) {
+        if (!_socket.recv(&update)) {
+            continue; // timed out
+        }
+        _ingest(update);
+        _flush();
+    }
+}
+
+
+/**
+ * Parse a sample message and stage samples per variable.
+ *
+ * See NEURON-sockets/ZmqOutputVars.mod: we got sequence of triples
+ * (double, double, double) all concatenated into arbitrary size message.
+ */
+void SampleReceiver::_ingest(const zmq::message_t& msg)
+{
+    if (has_message_tag(msg.data(), msg.size(), MSG_TAG_METADATA)) {
+        _ingest_metadata(static_cast<const char*>(msg.data()) + MSG_TAG_SIZE,
+                         msg.size() - MSG_TAG_SIZE);
+        return;
+    }
+    if (has_message_tag(msg.data(), msg.size(), MSG_TAG_SPIKES)) {
+        _ingest_spikes(static_cast<const char*>(msg.data()) + MSG_TAG_SIZE,
+                       msg.size() - MSG_TAG_SIZE);
+        return;
+    }
+    if (has_message_tag(msg.data(), msg.size(), MSG_TAG_ECHO)) {
+        _ingest_echo(static_cast<const char*>(msg.data()) + MSG_TAG_SIZE,
+                     msg.size() - MSG_TAG_SIZE);
+        return;
+    }
+
+    size_t sample_size = sizeof(sample_t);
+    size_t num_samples = msg.size() / sample_size;
+    const char* data_addr = static_cast<const char*>(msg.data());
+    bool debug_var_encountered = false;
+    double t_newest = this->t_newest.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < num_samples; i++) {
+        // message data is not guaranteed to be aligned
+        sample_t sample;
+        std::memcpy(&sample, data_addr + i * sample_size, sample_size);
+
+        // Look up the variable by identifier and stage sample
+        ingest_slot_t* slot = nullptr;
+        auto it = _slots.find((unsigned int) sample.gid);
+        if (it != _slots.end()) {
+            slot = &it->second;
+        } else if (_discovery_enabled) {
+            slot = _discover((unsigned int) sample.gid);
+        }
+        if (slot) {
+            if (slot->staging.empty()) {
+                _dirty_slots.push_back(slot);
+            }
+            slot->staging.push_back({(float) sample.t, (float) sample.v});
+        }
+        t_newest = std::max(t_newest, sample.t);
+
+        // One debug statement per message received
+        if (sample.gid == 1.0 && !debug_var_encountered) {
+            DBGMSG(std::cerr, "Received (gid, t, v): "
+                   << sample.gid << ", "
+                   << sample.t << ", "
+                   << sample.v);
+            debug_var_encountered = true;
+        }
+    }
+
+    messages_received.fetch_add(1, std::memory_order_relaxed);
+    samples_received.fetch_add(num_samples, std::memory_order_relaxed);
+    this->t_newest.store(t_newest, std::memory_order_relaxed);
+
+    // First samples simulated after echoed commands
+    if (!_pending_echoes.empty()) {
+        uint64_t t_now = ofGetElapsedTimeMicros();
+        size_t kept = 0;
+        for (const pending_echo_t& echo : _pending_echoes) {
+            if (t_newest >= echo.t_apply) {
+                _p_latency->observed({echo.id, echo.t_echo, t_now});
+            } else {
+                _pending_echoes[kept++] = echo;
+            }
+        }
+        _pending_echoes.resize(kept);
+    }
+}
+
+
+/**
+ * Parse a metadata message: one "<gid> <name>" line per variable.
+ *
+ * Names are remembered for gids we have not seen yet, and forwarded
+ * to the render thread for variables that were already discovered.
+ * Configured variables keep the name from the config file.
+ */
+void SampleReceiver::_ingest_metadata(const char* text, size_t size)
+{
+    std::istringstream lines(std::string(text, size));
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        unsigned int gid;
+        std::string name;
+        if (!(fields >> gid >> name)) {
+            continue;
+        }
+        _names[gid] = name;
+
+        auto it = _slots.find(gid);
+        if (it != _slots.end() && it->second.discovered) {
+            std::lock_guard<std::mutex> guard(_discovered_mutex);
+            _discovered.push_back({gid, name, nullptr});
+        }
+    }
+}
+
+
+/**
+ * Parse an echo message: one "<command id> <t>" line per command
+ * applied by the simulator from simulated time t on.
+ */
+void SampleReceiver::_ingest_echo(const char* text, size_t size)
+{
+    if (!_p_latency) {
+        return;
+    }
+    uint64_t t_echo = ofGetElapsedTimeMicros();
+    std::istringstream lines(std::string(text, size));
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        uint64_t id;
+        double t_apply;
+        if (!(fields >> id >> t_apply)) {
+            continue;
+        }
+        // Bounded, in case the simulation stops before t_apply
+        if (_pending_echoes.size() >= MAX_PENDING_ECHOES) {
+            _pending_echoes.erase(_pending_echoes.begin());
+        }
+        _pending_echoes.push_back({id, t_apply, t_echo});
+    }
+}
+
+
+/**
+ * Parse a spike message and append all its events in one batch.
+ */
+void SampleReceiver::_ingest_spikes(const char* data, size_t size)
+{
+    SpikeStore* store = _spikes[SPIKES_PUBLISHED].get();
+    if (!store) {
+        return;
+    }
+
+    size_t num_spikes = size / sizeof(spike_msg_t);
+    _spike_staging.resize(num_spikes);
+    for (size_t i = 0; i < num_spikes; i++) {
+        spike_msg_t spike;
+        std::memcpy(&spike, data + i * sizeof(spike_msg_t), sizeof(spike_msg_t));
+        _spike_staging[i] = {(float) spike.t, (uint32_t) spike.gid};
+    }
+    store->push(_spike_staging.data(), num_spikes);
+
+    messages_received.fetch_add(1, std::memory_order_relaxed);
+    spikes_received.fetch_add(num_spikes, std::memory_order_relaxed);
+}
+
+
+/**
+ * Register a gid seen for the first time and allocate its buffer.
+ *
+ * @return  the new slot, or nullptr if the discovery limit is reached
+ */
+SampleReceiver::ingest_slot_t* SampleReceiver::_discover(unsigned int gid)
+{
+    // Buffer capacity is rounded up to a power of two
+    size_t buffer_bytes = sizeof(trace_point_t);
+    while (buffer_bytes < _discovery_capacity * sizeof(trace_point_t)) {
+        buffer_bytes *= 2;
+    }
+    if (_discovery_full) {
+        return nullptr;
+    }
+    if (_num_discovered >= _discovery_max_vars
+            || _discovered_bytes + buffer_bytes > _discovery_max_bytes) {
+        DBGMSG(std::cerr, "Discovery limit reached after " << _num_discovered
+               << " variables (" << (_discovered_bytes >> 20) << " MB)");
+        _discovery_full = true;
+        return nullptr;
+    }
+    _num_discovered++;
+    _discovered_bytes += buffer_bytes;
+
+    ingest_slot_t& slot = _slots[gid];
+    slot.buffer = std::make_shared<SampleBuffer>(_discovery_capacity);
+    slot.seq_uncompressed = 0;
+    slot.discovered = true;
+
+    auto it_name = _names.find(gid);
+    std::string name = (it_name != _names.end()) ?
+                       it_name->second : "gid_" + std::to_string(gid);
+
+    std::lock_guard<std::mutex> guard(_discovered_mutex);
+    _discovered.push_back({gid, name, slot.buffer});
+    return &slot;
+}
+
+
+/**
+ * Publish staged samples: one batch append per variable per message,
+ * and one batch of the spikes detected in them.
+ */
+void SampleReceiver::_flush()
+{
+    // Derived samples are staged, then published with the received ones
+    for (derived_t& derived : _derived) {
+        _evaluate(derived);
+    }
+
+    for (ingest_slot_t* slot : _dirty_slots) {
+        if (slot->detector && _spikes[SPIKES_DETECTED]) {
+            slot->detector->detect(slot->staging.data(), slot->staging.size(),
+                                   _spikes_detected);
+        }
+        slot->buffer->push(slot->staging.data(), slot->staging.size());
+        slot->staging.clear();
+        if (slot->history && _p_compressor) {
+            _submit_history(*slot);
+        }
+    }
+    _dirty_slots.clear();
+
+    // Spikes of several variables: keep the store sorted by time (the
+    // samples of all variables arrive in order of time, see SpikeStore)
+    if (!_spikes_detected.empty()) {
+        std::stable_sort(_spikes_detected.begin(), _spikes_detected.end(),
+                         [](const spike_event_t& a, const spike_event_t& b) {
+                             return a.t < b.t;
+                         });
+        _spikes[SPIKES_DETECTED]->push(_spikes_detected.data(), _spikes_detected.size());
+        spikes_detected.fetch_add(_spikes_detected.size(), std::memory_order_relaxed);
+        _spikes_detected.clear();
+    }
+}
+
+
+/**
+ * Stage the samples of a derived variable for the input samples staged
+ * in this message (and earlier ones still waiting for a match).
+ *
+ * Matched samples are consumed by advancing a read index per input;
+ * the consumed front is only erased once it is half of the vector, so
+ * the cost per message is that of its samples, not of all pending ones.
+ */
+void SampleReceiver::_evaluate(derived_t& derived)
+{
+    size_t num_inputs = derived.inputs.size();
+    bool received = false;
+    for (size_t k = 0; k < num_inputs; k++) {
+        const std::vector<trace_point_t>& staging = derived.inputs[k]->staging;
+        if (staging.empty()) {
+            continue;
+        }
+        std::vector<trace_point_t>& pending = derived.pending[k];
+        size_t& begin = derived.pending_begin[k];
+        if (begin > 0 && begin >= pending.size() / 2) {
+            pending.erase(pending.begin(), pending.begin() + begin);
+            begin = 0;
+        }
+        pending.insert(pending.end(), staging.begin(), staging.end());
+        if (pending.size() - begin > MAX_DERIVED_PENDING) {
+            // Another input stopped arriving
+            begin = pending.size() - MAX_DERIVED_PENDING;
+        }
+        received = true;
+    }
+    if (!received) {
+        return;
+    }
+
+    // Match samples by time, as columns of values per input
+    _aligned_times.clear();
+    for (size_t k = 0; k < num_inputs; k++) {
+        _aligned_values[k].clear();
+        _aligned_index[k] = derived.pending_begin[k];
+    }
+    while (true) {
+        float t = -std::numeric_limits<float>::infinity();
+        bool complete = true;
+        for (size_t k = 0; k < num_inputs && complete; k++) {
+            complete = _aligned_index[k] < derived.pending[k].size();
+            if (complete) {
+                t = std::max(t, derived.pending[k][_aligned_index[k]].t);
+            }
+        }
+        if (!complete) {
+            break;
+        }
+        bool matched = true;
+        for (size_t k = 0; k < num_inputs; k++) {
+            if (derived.pending[k][_aligned_index[k]].t < t) {
+                _aligned_index[k]++; // no match in some other input
+                matched = false;
+            }
+        }
+        if (!matched) {
+            continue;
+        }
+        _aligned_times.push_back(t);
+        for (size_t k = 0; k < num_inputs; k++) {
+            _aligned_values[k].push_back(derived.pending[k][_aligned_index[k]++].v);
+        }
+    }
+    for (size_t k = 0; k < num_inputs; k++) {
+        if (_aligned_index[k] == derived.pending[k].size()) {
+            derived.pending[k].clear(); // all matched, the usual case
+            derived.pending_begin[k] = 0;
+        } else {
+            derived.pending_begin[k] = _aligned_index[k];
+        }
+    }
+
+    size_t n = _aligned_times.size();
+    if (n == 0) {
+        return;
+    }
+    for (size_t k = 0; k < num_inputs; k++) {
+        _aligned_inputs[k] = _aligned_values[k].data();
+    }
+    _derived_values.resize(n);
+    derived.expression->evaluate(_aligned_inputs.data(), n, _derived_values.data());
+
+    ingest_slot_t* slot = derived.output;
+    if (slot->staging.empty()) {
+        _dirty_slots.push_back(slot);
+    }
+    for (size_t i = 0; i < n; i++) {
+        slot->staging.push_back({_aligned_times[i], _derived_values[i]});
+    }
+}
+
+
+/**
+ * Hand every complete block of samples that has not been compressed
+ * yet to the compressor thread.
+ *
+ * We are the only writer of the buffer, so reading back what we
+ * pushed needs no validation.
+ */
+void SampleReceiver::_submit_history(ingest_slot_t& slot)
+{
+    uint64_t head = slot.buffer->head();
+
+    // Samples overwritten before they formed a block are lost from history
+    uint64_t capacity = slot.buffer->capacity();
+    uint64_t seq_oldest = (head > capacity) ? head - capacity : 0;
+    if (slot.seq_uncompressed < seq_oldest) {
+        slot.seq_uncompressed = seq_oldest;
+    }
+
+    while (head - slot.seq_uncompressed >= HISTORY_BLOCK_SAMPLES) {
+        std::vector<trace_point_t> points(HISTORY_BLOCK_SAMPLES);
+        for (size_t i = 0; i < HISTORY_BLOCK_SAMPLES; i++) {
+            points[i] = slot.buffer->writer_load(slot.seq_uncompressed + i);
+        }
+        _p_compressor->submit(slot.history, slot.seq_uncompressed,
+                              std::move(points));
+        slot.seq_uncompressed += HISTORY_BLOCK_SAMPLES;
+    }
+}
@@ -0,0 +1,170 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "zmq.hpp"
+#include "SampleBuffer.h"
+#include "HistoryCompressor.h"
+#include "SpikeStore.h"
+#include "SpikeDetector.h"
+#include "ControlLatency.h"
+#include "Expression.h"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+
+// Defaults for variables that are discovered rather than configured
+const size_t DEFAULT_DISCOVERY_CAPACITY = 1 << 13;
+const size_t DEFAULT_DISCOVERY_MAX_VARS = 2000;
+const size_t DEFAULT_DISCOVERY_MAX_MB = 256; // of sample buffers
+
+// Echoed control commands waiting for samples simulated after them
+const size_t MAX_PENDING_ECHOES = 1024;
+
+// Samples of an input of a derived variable waiting for the other inputs
+const size_t MAX_DERIVED_PENDING = 1 << 16;
+
+
+// Variable seen for the first time on the data socket, or new name
+// for such a variable (then buffer is nullptr).
+typedef struct {
+    unsigned int gid;
+    std::string name;
+    std::shared_ptr<SampleBuffer> buffer;
+} discovered_var_t;
+
+
+/**
+ * Ingest thread: receives sample messages from the NEURON publisher
+ * and appends them to the sample buffer of each variable.
+ *
+ * All configured buffers must be registered before the thread is started.
+ * After that, the render thread only reads the buffers through
+ * SampleBuffer::snapshot(), so there is no lock anywhere in the
+ * per-sample path.
+ *
+ * With discovery enabled, samples of unknown gids are not dropped: the
+ * ingest thread allocates a buffer the first time a gid is seen and
+ * hands it to the render thread through take_discovered().
+ *
+ * Derived variables are computed from the samples of their inputs as
+ * they arrive, and published like received ones (see add_derived()).
+ */
+class SampleReceiver : public ofThread
+{
+  public:
+    SampleReceiver(zmq::socket_t& socket) :
+        samples_received(0),
+        messages_received(0),
+        spikes_received(0),
+        spikes_detected(0),
+        t_newest(0.0),
+        _socket(socket),
+        _p_compressor(nullptr),
+        _p_latency(nullptr),
+        _discovery_enabled(false),
+        _discovery_capacity(0),
+        _discovery_max_vars(0),
+        _discovery_max_bytes(0),
+        _num_discovered(0),
+        _discovered_bytes(0),
+        _discovery_full(false) {}
+
+    void add_buffer(unsigned int gid, std::shared_ptr<SampleBuffer> buffer,
+                    std::shared_ptr<CompressedHistory> history = nullptr);
+    void set_compressor(HistoryCompressor* compressor);
+    void set_latency(ControlLatency* latency);
+    void enable_discovery(size_t buffer_capacity, size_t max_variables,
+                          size_t max_bytes);
+    void take_discovered(std::vector<discovered_var_t>& discovered);
+    void set_spike_stores(const spike_stores_t& spikes);
+    void add_spike_detector(unsigned int gid, float threshold, float refractory);
+    void add_derived(unsigned int gid, std::unique_ptr<Expression> expression,
+                     const std::vector<unsigned int>& input_gids);
+
+    // Counters for diagnostics (written by ingest thread only)
+    std::atomic<uint64_t> samples_received;
+    std::atomic<uint64_t> messages_received;
+    std::atomic<uint64_t> spikes_received;
+    std::atomic<uint64_t> spikes_detected; // in samples, see add_spike_detector()
+    std::atomic<double> t_newest; // [ms] newest sample time of any variable
+
+  protected:
+    void threadedFunction() override;
+
+  private:
+    void _ingest(const zmq::message_t& msg);
+    void _ingest_metadata(const char* text, size_t size);
+    void _ingest_spikes(const char* data, size_t size);
+    void _ingest_echo(const char* text, size_t size);
+    void _flush();
+
+    // Samples of one variable received in the current message
+    typedef struct {
+        std::shared_ptr<SampleBuffer> buffer;
+        std::vector<trace_point_t> staging;
+        std::shared_ptr<CompressedHistory> history; // optional
+        uint64_t seq_uncompressed; // oldest sample not yet sent to compressor
+        bool discovered; // not configured but created on first sample
+        std::unique_ptr<SpikeDetector> detector; // optional
+    } ingest_slot_t;
+
+    void _submit_history(ingest_slot_t& slot);
+    ingest_slot_t* _discover(unsigned int gid);
+
+    // Variable computed from the samples of others
+    typedef struct {
+        std::unique_ptr<Expression> expression;
+        ingest_slot_t* output;
+        std::vector<ingest_slot_t*> inputs; // in order of expression->inputs()
+        std::vector<std::vector<trace_point_t>> pending; // per input, not aligned yet
+        std::vector<size_t> pending_begin; // per input, first sample still pending
+    } derived_t;
+
+    void _evaluate(derived_t& derived);
+
+    std::unordered_map<unsigned int, ingest_slot_t> _slots;
+    std::vector<ingest_slot_t*> _dirty_slots;
+
+    zmq::socket_t& _socket; // only used by ingest thread after start
+    HistoryCompressor* _p_compressor;
+
+    // Echoed control commands waiting for a sample simulated after them
+    typedef struct {
+        uint64_t id;
+        double t_apply;  // [ms] simulated time
+        uint64_t t_echo; // [us] echo received
+    } pending_echo_t;
+
+    ControlLatency* _p_latency; // (optional)
+    std::vector<pending_echo_t> _pending_echoes;
+
+    // Spike events of all cells, by source (optional)
+    spike_stores_t _spikes;
+    std::vector<spike_event_t> _spike_staging;
+    std::vector<spike_event_t> _spikes_detected; // in the current message
+
+    // Derived variables, and time-aligned input values reused by _evaluate()
+    std::vector<derived_t> _derived;
+    std::vector<size_t> _aligned_index;
+    std::vector<float> _aligned_times;
+    std::vector<std::vector<float>> _aligned_values;
+    std::vector<const float*> _aligned_inputs;
+    std::vector<float> _derived_values;
+
+    // Discovery of unknown gids
+    bool _discovery_enabled;
+    size_t _discovery_capacity;
+    size_t _discovery_max_vars;
+    size_t _discovery_max_bytes;
+    size_t _num_discovered;
+    size_t _discovered_bytes; // of the buffers allocated
+    bool _discovery_full; // limit reached
+    std::unordered_map<unsigned int, std::string> _names; // from metadata
+
+    // Hand-over to render thread, only locked when a new gid is seen
+    std::mutex _discovered_mutex;
+    std::vector<discovered_var_t> _discovered;
+};
@@ -0,0 +1,84 @@
+#include "ScrollingTexture.h"
+
+
+/**
+ * Allocate RGBA texture with given number of columns (time bins)
+ * and rows, cleared to black.
+ */
+void ScrollingTexture::allocate(int num_columns, int num_rows)
+{
+    // Normalized texture coordinates are needed for GL_REPEAT,
+    // so we can not use the default rectangle (ARB) textures.
+    ofTextureData data;
+    data.width = num_columns;
+    data.height = num_rows;
+    data.textureTarget = GL_TEXTURE_2D;
+    data.glInternalFormat = GL_RGBA8;
+    _texture.allocate(data);
+    _texture.setTextureWrap(GL_REPEAT, GL_CLAMP_TO_EDGE);
+    _texture.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+
+    _num_columns = num_columns;
+    _num_rows = num_rows;
+    _next_column = 0;
+
+    std::vector<uint8_t> black(num_rows * 4, 0);
+    for (int i = 0; i < num_columns; i++) {
+        write_column(black.data());
+    }
+}
+
+
+/**
+ * Replace the oldest column by a new one.
+ *
+ * @param   rgba
+ *          num_rows() RGBA pixels, top row first
+ */
+void ScrollingTexture::write_column(const uint8_t* rgba)
+{
+    const ofTextureData& data = _texture.getTextureData();
+    glBindTexture(data.textureTarget, data.textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(data.textureTarget, 0, _next_column, 0, 1, _num_rows,
+                    GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    glBindTexture(data.textureTarget, 0);
+
+    _next_column = (_next_column + 1) % _num_columns;
+}
+
+
+/**
+ * Draw all columns into rect, oldest at the left.
+ *
+ * @param   rows_used
+ *          Only the top rows_used rows are drawn
+ */
+void ScrollingTexture::draw(const ofRectangle& rect, int rows_used) const
+{
+    if (!is_allocated()) {
+        return;
+    }
+
+    // Oldest column is at _next_column, the texture wraps around
+    const ofTextureData& data = _texture.getTextureData();
+    float u_begin = (float) _next_column / _num_columns * data.tex_t;
+    float u_end = u_begin + data.tex_t;
+    float v_end = (float) rows_used / _num_rows * data.tex_u;
+
+    ofMesh& quad = _quad;
+    quad.clear();
+    quad.setMode(OF_PRIMITIVE_TRIANGLE_STRIP);
+    quad.addVertex(ofPoint(rect.getLeft(), rect.getTop()));
+    quad.addTexCoord(glm::vec2(u_begin, 0));
+    quad.addVertex(ofPoint(rect.getRight(), rect.getTop()));
+    quad.addTexCoord(glm::vec2(u_end, 0));
+    quad.addVertex(ofPoint(rect.getLeft(), rect.getBottom()));
+    quad.addTexCoord(glm::vec2(u_begin, v_end));
+    quad.addVertex(ofPoint(rect.getRight(), rect.getBottom()));
+    quad.addTexCoord(glm::vec2(u_end, v_end));
+
+    _texture.bind();
+    quad.draw();
+    _texture.unbind();
+}
@@ -0,0 +1,35 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+
+
+/**
+ * Texture used as a ring buffer of columns, for waterfall-style views
+ * (heatmap, spectrogram) that scroll to the left as columns are added.
+ *
+ * Adding a column uploads only that column (glTexSubImage2D); scrolling
+ * is done by offsetting texture coordinates with GL_REPEAT wrapping, so
+ * the per-frame cost does not depend on the number of columns kept.
+ */
+class ScrollingTexture
+{
+  public:
+    ScrollingTexture() : _num_columns(0), _num_rows(0), _next_column(0) {}
+
+    void allocate(int num_columns, int num_rows);
+    bool is_allocated() const { return _num_rows > 0; }
+
+    void write_column(const uint8_t* rgba);
+    void draw(const ofRectangle& rect, int rows_used) const;
+
+    int num_columns() const { return _num_columns; }
+    int num_rows() const { return _num_rows; }
+
+  private:
+    ofTexture _texture;
+    mutable ofMesh _quad; // rebuilt on every draw
+    int _num_columns;
+    int _num_rows;
+    int _next_column; // column that will be overwritten next (= oldest)
+};
@@ -0,0 +1,301 @@
+#include "SegmentBvh.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace {
+
+// Segments per leaf
+const uint32_t BVH_LEAF_SIZE = 4;
+
+// Deeper than any tree built by median splits of 2^32 items
+const int BVH_MAX_DEPTH = 64;
+
+
+/**
+ * Entry distance of a ray into a box, or infinity if it misses.
+ */
+inline float ray_box(const glm::vec3& origin, const glm::vec3& inv_dir,
+                     const glm::vec3& lo, const glm::vec3& hi)
+{
+    float t_near = 0.0f;
+    float t_far = std::numeric_limits<float>::infinity();
+    for (int axis = 0; axis < 3; axis++) {
+        float t0 = (lo[axis] - origin[axis]) * inv_dir[axis];
+        float t1 = (hi[axis] - origin[axis]) * inv_dir[axis];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        t_near = std::max(t_near, t0);
+        t_far = std::min(t_far, t1);
+    }
+    return (t_near <= t_far) ? t_near : std::numeric_limits<float>::infinity();
+}
+
+
+/**
+ * Distance along a ray (unit direction) to a capsule, approximated by
+ * the closest approach of the ray to the capsule axis.
+ */
+inline float ray_capsule(const glm::vec3& origin, const glm::vec3& dir,
+                         const glm::vec3& a, const glm::vec3& b, float radius)
+{
+    glm::vec3 axis = b - a;
+    glm::vec3 w = origin - a;
+    float aa = glm::dot(axis, axis);
+    float ad = glm::dot(axis, dir);
+    float aw = glm::dot(axis, w);
+    float dw = glm::dot(dir, w);
+
+    // Closest points: ray parameter t, axis parameter s in [0, 1]
+    float denom = aa - ad * ad;
+    float s = (denom > 1e-12f) ? (aw - ad * dw) / denom : 0.0f;
+    s = std::min(std::max(s, 0.0f), 1.0f);
+    float t = std::max(s * ad - dw, 0.0f);
+    if (aa > 0.0f) {
+        // Re-project for the clamped s
+        s = std::min(std::max((glm::dot(origin + t * dir - a, axis)) / aa, 0.0f), 1.0f);
+    }
+
+    glm::vec3 gap = (origin + t * dir) - (a + s * axis);
+    float d2 = glm::dot(gap, gap);
+    if (d2 > radius * radius) {
+        return std::numeric_limits<float>::infinity();
+    }
+    return std::max(t - std::sqrt(radius * radius - d2), 0.0f);
+}
+
+} // namespace
+
+
+//==============================================================================
+// Construction
+
+void SegmentBvh::build(const Morphology& morphology)
+{
+    const Morphology& m = morphology;
+    size_t n = m.num_points();
+    _nodes.clear();
+    _items.resize(n);
+    _a.resize(n);
+    _b.resize(n);
+    _radius.resize(n);
+    if (n == 0) {
+        return;
+    }
+
+    std::vector<build_item_t> items(n);
+    for (size_t i = 0; i < n; i++) {
+        int32_t p = m.parent[i];
+        glm::vec3 b(m.x[i], m.y[i], m.z[i]);
+        glm::vec3 a = (p >= 0) ? glm::vec3(m.x[p], m.y[p], m.z[p]) : b;
+        glm::vec3 r((p >= 0) ? std::max(m.radius[i], m.radius[p]) : m.radius[i]);
+        items[i].lo = glm::min(a, b) - r;
+        items[i].hi = glm::max(a, b) + r;
+        items[i].centroid = 0.5f * (a + b);
+        items[i].point = i;
+    }
+
+    _nodes.reserve(2 * n / BVH_LEAF_SIZE + 1);
+    _build(0, n, items);
+
+    // Segment data in tree order, so leaves read contiguous memory
+    for (size_t i = 0; i < n; i++) {
+        uint32_t point = items[i].point;
+        int32_t p = m.parent[point];
+        _items[i] = point;
+        _b[i] = glm::vec3(m.x[point], m.y[point], m.z[point]);
+        _a[i] = (p >= 0) ? glm::vec3(m.x[p], m.y[p], m.z[p]) : _b[i];
+        _radius[i] = (p >= 0) ? std::max(m.radius[point], m.radius[p]) : m.radius[point];
+    }
+}
+
+
+/**
+ * Build the subtree over items[begin, end) and return its node index.
+ */
+uint32_t SegmentBvh::_build(uint32_t begin, uint32_t end,
+                            std::vector<build_item_t>& items)
+{
+    uint32_t index = _nodes.size();
+    _nodes.push_back(node_t());
+
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    glm::vec3 c_lo = lo;
+    glm::vec3 c_hi = hi;
+    for (uint32_t i = begin; i < end; i++) {
+        lo = glm::min(lo, items[i].lo);
+        hi = glm::max(hi, items[i].hi);
+        c_lo = glm::min(c_lo, items[i].centroid);
+        c_hi = glm::max(c_hi, items[i].centroid);
+    }
+    _nodes[index].lo = lo;
+    _nodes[index].hi = hi;
+    _nodes[index].item_begin = begin;
+    _nodes[index].item_end = end;
+    _nodes[index].right = 0;
+
+    if (end - begin <= BVH_LEAF_SIZE) {
+        return index;
+    }
+
+    // Median split along the widest extent of the centroids
+    glm::vec3 extent = c_hi - c_lo;
+    int axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2)
+                                     : ((extent.y > extent.z) ? 1 : 2);
+    uint32_t mid = begin + (end - begin) / 2;
+    std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+                     [axis](const build_item_t& i, const build_item_t& j) {
+                         return i.centroid[axis] < j.centroid[axis];
+                     });
+
+    _build(begin, mid, items);
+    uint32_t right = _build(mid, end, items);
+    _nodes[index].right = right;
+    return index;
+}
+
+
+//==============================================================================
+// Queries
+
+/**
+ * Find the segment nearest to the ray origin that the ray hits.
+ *
+ * @param   direction
+ *          unit vector
+ *
+ * @return  false if no segment is hit
+ */
+bool SegmentBvh::pick(const glm::vec3& origin, const glm::vec3& direction,
+                      uint32_t& segment, float& distance) const
+{
+    if (_nodes.empty()) {
+        return false;
+    }
+    glm::vec3 inv_dir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+    float t_best = std::numeric_limits<float>::infinity();
+    uint32_t best = 0;
+
+    uint32_t stack[BVH_MAX_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const node_t& node = _nodes[stack[--top]];
+        if (ray_box(origin, inv_dir, node.lo, node.hi) >= t_best) {
+            continue;
+        }
+        if (node.right == 0) {
+            for (uint32_t i = node.item_begin; i < node.item_end; i++) {
+                float t = ray_capsule(origin, direction, _a[i], _b[i], _radius[i]);
+                if (t < t_best) {
+                    t_best = t;
+                    best = _items[i];
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first, so farther boxes can be skipped
+        uint32_t left = &node - _nodes.data() + 1;
+        float t_left = ray_box(origin, inv_dir, _nodes[left].lo, _nodes[left].hi);
+        float t_right = ray_box(origin, inv_dir, _nodes[node.right].lo, _nodes[node.right].hi);
+        if (t_left < t_right) {
+            stack[top++] = node.right;
+            stack[top++] = left;
+        } else {
+            stack[top++] = left;
+            stack[top++] = node.right;
+        }
+    }
+
+    if (t_best == std::numeric_limits<float>::infinity()) {
+        return false;
+    }
+    segment = best;
+    distance = t_best;
+    return true;
+}
+
+
+/**
+ * Collect the segments whose bounding boxes are (at least partly)
+ * inside the view frustum. Subtrees fully inside are added without
+ * testing their nodes.
+ *
+ * @param   visible
+ *          cleared, then filled with point indices of segments
+ */
+void SegmentBvh::cull(const glm::mat4& model_view_projection,
+                      std::vector<uint32_t>& visible) const
+{
+    visible.clear();
+    if (_nodes.empty()) {
+        return;
+    }
+
+    // Frustum planes from the rows of the matrix (Gribb & Hartmann),
+    // inside where dot(plane, (x, y, z, 1)) >= 0
+    const glm::mat4& m = model_view_projection;
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+    glm::vec4 planes[6] = {
+        row[3] + row[0], row[3] - row[0],
+        row[3] + row[1], row[3] - row[1],
+        row[3] + row[2], row[3] - row[2],
+    };
+
+    // Stack of (node, planes the node is not yet known to be inside of)
+    uint32_t stack[BVH_MAX_DEPTH][2];
+    int top = 0;
+    stack[top][0] = 0;
+    stack[top][1] = 0x3f;
+    top++;
+    while (top > 0) {
+        --top;
+        const node_t& node = _nodes[stack[top][0]];
+        uint32_t mask = stack[top][1];
+
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++) {
+            if (!(mask & (1u << p))) {
+                continue;
+            }
+            const glm::vec4& plane = planes[p];
+
+            // Box corners farthest along and against the plane normal
+            glm::vec3 far_corner(plane.x >= 0 ? node.hi.x : node.lo.x,
+                                 plane.y >= 0 ? node.hi.y : node.lo.y,
+                                 plane.z >= 0 ? node.hi.z : node.lo.z);
+            glm::vec3 near_corner(plane.x >= 0 ? node.lo.x : node.hi.x,
+                                  plane.y >= 0 ? node.lo.y : node.hi.y,
+                                  plane.z >= 0 ? node.lo.z : node.hi.z);
+            if (glm::dot(glm::vec3(plane), far_corner) + plane.w < 0) {
+                outside = true;
+            } else if (glm::dot(glm::vec3(plane), near_corner) + plane.w >= 0) {
+                mask &= ~(1u << p);
+            }
+        }
+        if (outside) {
+            continue;
+        }
+
+        if (mask == 0 || node.right == 0) {
+            visible.insert(visible.end(), _items.begin() + node.item_begin,
+                           _items.begin() + node.item_end);
+            continue;
+        }
+        uint32_t left = &node - _nodes.data() + 1;
+        stack[top][0] = node.right;
+        stack[top][1] = mask;
+        top++;
+        stack[top][0] = left;
+        stack[top][1] = mask;
+        top++;
+    }
+}
@@ -0,0 +1,61 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "Morphology.h"
+
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * Bounding volume hierarchy over the segments of a morphology, for
+ * picking segments with the mouse and for frustum culling.
+ *
+ * Segment i is the capsule from the parent of point i to point i with
+ * the larger of both radii (a sphere for points without parent). The
+ * tree is built once at load time by median splits along the widest
+ * axis and stored depth first in one array, so queries walk a flat
+ * array with a small fixed-size stack.
+ */
+class SegmentBvh
+{
+  public:
+    void build(const Morphology& morphology);
+    bool empty() const { return _nodes.empty(); }
+
+    bool pick(const glm::vec3& origin, const glm::vec3& direction,
+              uint32_t& segment, float& distance) const;
+    void cull(const glm::mat4& model_view_projection,
+              std::vector<uint32_t>& visible) const;
+
+  private:
+    // Leaves have right == 0 (the root is never a right child).
+    // Items of a node are _items[item_begin, item_end),
+    // its left child is the next node.
+    typedef struct {
+        glm::vec3 lo;
+        glm::vec3 hi;
+        uint32_t item_begin;
+        uint32_t item_end;
+        uint32_t right;
+    } node_t;
+
+    // Segment bounds during construction, moved around by the splits
+    typedef struct {
+        glm::vec3 lo;
+        glm::vec3 hi;
+        glm::vec3 centroid;
+        uint32_t point;
+    } build_item_t;
+
+    uint32_t _build(uint32_t begin, uint32_t end, std::vector<build_item_t>& items);
+
+    std::vector<node_t> _nodes;
+
+    // Segments in tree order
+    std::vector<uint32_t> _items;    // point index of segment
+    std::vector<glm::vec3> _a;       // proximal end
+    std::vector<glm::vec3> _b;       // distal end
+    std::vector<float> _radius;
+};
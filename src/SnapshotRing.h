@@ -0,0 +1,180 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+
+/**
+ * Fixed-capacity ring buffer with one writer and any number of readers,
+ * where readers take consistent snapshots of the newest elements without
+ * ever blocking the writer.
+ *
+ * Elements are addressed by their sequence number: the n-th element ever
+ * pushed has sequence number n. The writer publishes the end of the
+ * written range (head) with release semantics, so a reader that acquires
+ * head sees every element before it.
+ *
+ * When the ring is full the writer overwrites the oldest elements. To let
+ * readers detect this, the writer first announces the range it is about to
+ * overwrite and then stores the elements with release semantics
+ * (seqlock-style). A reader copies what it needs, then calls
+ * View::validate() which tells it the oldest sequence number whose value
+ * was certainly not being overwritten while it was reading. Elements are
+ * stored as lock-free atomics, so there are no data races and no torn
+ * reads. Release stores and acquire loads are plain moves on x86, and
+ * unlike standalone fences they are understood by ThreadSanitizer.
+ *
+ * T must be trivially copyable and small enough for std::atomic<T> to be
+ * lock-free on the target (8 bytes on all platforms we build for).
+ */
+template <typename T>
+class SnapshotRing
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SnapshotRing elements must be trivially copyable");
+
+  public:
+
+    /**
+     * Consistent view of the sequence range [seq_begin, seq_end) in
+     * the ring at the time it was taken. Views do not copy elements.
+     */
+    class View
+    {
+      public:
+        View(const SnapshotRing<T>& ring, uint64_t begin, uint64_t end) :
+            _ring(&ring), _begin(begin), _end(end) {}
+
+        uint64_t seq_begin() const { return _begin; }
+        uint64_t seq_end() const { return _end; }
+        size_t size() const { return _end - _begin; }
+        bool empty() const { return _end == _begin; }
+
+        /**
+         * Element with absolute sequence number seq,
+         * where seq_begin() <= seq < seq_end().
+         */
+        T operator[](uint64_t seq) const { return _ring->_load(seq); }
+        T front() const { return _ring->_load(_begin); }
+        T back() const { return _ring->_load(_end - 1); }
+
+        /**
+         * Narrow the view so that it starts at sequence number seq.
+         */
+        void advance_begin(uint64_t seq) {
+            if (seq > _begin) {
+                _begin = (seq < _end) ? seq : _end;
+            }
+        }
+
+        /**
+         * Oldest sequence number in this view whose element was not
+         * overwritten before this call. Call after reading elements:
+         * anything read at a lower sequence number must be discarded.
+         */
+        uint64_t validate() const {
+            uint64_t reserved = _ring->_reserved.load(std::memory_order_relaxed);
+            uint64_t intact = (reserved > _ring->_capacity) ?
+                              reserved - _ring->_capacity : 0;
+            if (intact < _begin) {
+                return _begin;
+            }
+            return (intact < _end) ? intact : _end;
+        }
+
+      private:
+        const SnapshotRing<T>* _ring;
+        uint64_t _begin;
+        uint64_t _end;
+    };
+
+    /**
+     * Create ring that holds at least min_capacity elements
+     * (rounded up to a power of two).
+     */
+    explicit SnapshotRing(size_t min_capacity) :
+        _capacity(_round_pow2(min_capacity)),
+        _mask(_capacity - 1),
+        _slots(new std::atomic<T>[_capacity]),
+        _head(0),
+        _reserved(0) {}
+
+    size_t capacity() const { return _capacity; }
+
+    /**
+     * Sequence number one past the newest published element.
+     */
+    uint64_t head() const { return _head.load(std::memory_order_acquire); }
+
+    /**
+     * Append one element. Must only be called from the writer thread.
+     */
+    void push(const T& elem) {
+        push(&elem, 1);
+    }
+
+    /**
+     * Append n elements. Must only be called from the writer thread.
+     * Never blocks: when full, the oldest elements are overwritten.
+     */
+    void push(const T* elems, size_t n) {
+        uint64_t head = _head.load(std::memory_order_relaxed);
+        while (n > 0) {
+            size_t chunk = (n < _capacity) ? n : _capacity;
+
+            // Announce the overwritten range before touching any slot.
+            // The release stores below make this visible to any reader
+            // that loads one of the new slot values.
+            _reserved.store(head + chunk, std::memory_order_relaxed);
+
+            for (size_t i = 0; i < chunk; i++) {
+                _slots[(head + i) & _mask].store(elems[i],
+                                                 std::memory_order_release);
+            }
+            head += chunk;
+            _head.store(head, std::memory_order_release);
+
+            elems += chunk;
+            n -= chunk;
+        }
+    }
+
+    /**
+     * Take a snapshot of all elements that are currently retained.
+     */
+    View snapshot() const {
+        uint64_t end = _head.load(std::memory_order_acquire);
+        uint64_t begin = (end > _capacity) ? end - _capacity : 0;
+        return View(*this, begin, end);
+    }
+
+    /**
+     * Read an element owned by the writer thread (e.g. when the writer
+     * post-processes what it just pushed). No validation needed.
+     */
+    T writer_load(uint64_t seq) const { return _load(seq); }
+
+  private:
+    T _load(uint64_t seq) const {
+        return _slots[seq & _mask].load(std::memory_order_acquire);
+    }
+
+    static size_t _round_pow2(size_t n) {
+        size_t c = 1;
+        while (c < n) {
+            c <<= 1;
+        }
+        return c;
+    }
+
+    const size_t _capacity;
+    const size_t _mask;
+    std::unique_ptr<std::atomic<T>[]> _slots;
+
+    std::atomic<uint64_t> _head;     // one past newest published element
+    std::atomic<uint64_t> _reserved; // one past newest element being written
+};
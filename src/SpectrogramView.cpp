@@ -0,0 +1,212 @@
+#include "SpectrogramView.h"
+#include "ColorMap.h"
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+// Samples copied from the ring per read, and pause when there are none
+const size_t MAX_CHUNK_SAMPLES = 4096;
+const long IDLE_SLEEP_MS = 5;
+
+// Decay of the reference peak per column [dB]
+const float DB_PEAK_DECAY = 0.05;
+
+} // namespace
+
+
+/**
+ * Start computing columns from the newest samples on.
+ * The window is rounded up to a power of two.
+ */
+void SpectrogramView::start(std::shared_ptr<SampleBuffer> samples, const std::string& name)
+{
+    int n = 4;
+    while (n < window) {
+        n *= 2;
+    }
+    window = n;
+    hop = std::max(1, std::min(hop, window));
+
+    _samples = samples;
+    _name = name;
+    _fft = std::make_unique<Fft>(window);
+    _df = 1000.0 / (dt * window);
+    _num_rows = std::max(2, std::min(window / 2 + 1, (int) (f_max / _df) + 1));
+
+    // Periodic Hann window
+    _hann.resize(window);
+    for (int i = 0; i < window; i++) {
+        _hann[i] = 0.5 - 0.5 * std::cos(2.0 * M_PI * i / window);
+    }
+    _grid.clear();
+    _grid.reserve(window + hop);
+    _windowed.resize(window);
+    _power.resize(window / 2 + 1);
+    _column.resize(_num_rows * 4);
+    _have_prev = false;
+    _seq_next = samples->snapshot().seq_end();
+    _db_peak = -1e30;
+    {
+        std::lock_guard<std::mutex> guard(_pending_mutex);
+        _pending.clear();
+    }
+    startThread();
+}
+
+
+void SpectrogramView::stop()
+{
+    waitForThread(true);
+}
+
+
+//==============================================================================
+// Worker thread
+
+void SpectrogramView::threadedFunction()
+{
+    while (isThreadRunning()) {
+        auto view = _samples->snapshot();
+        if (_seq_next < view.seq_begin()) {
+            // Fell behind the ring buffer: continue after a gap
+            _seq_next = view.seq_begin();
+            _have_prev = false;
+        }
+        view.advance_begin(_seq_next);
+        if (view.empty()) {
+            sleep(IDLE_SLEEP_MS);
+            continue;
+        }
+
+        // Copy a chunk and check that none of it was overwritten meanwhile
+        size_t n = std::min<uint64_t>(view.size(), MAX_CHUNK_SAMPLES);
+        _chunk.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            _chunk[i] = view[view.seq_begin() + i];
+        }
+        uint64_t seq_intact = view.validate();
+        if (seq_intact > view.seq_begin()) {
+            _seq_next = seq_intact;
+            _have_prev = false;
+            continue;
+        }
+        _seq_next = view.seq_begin() + n;
+        _resample();
+    }
+}
+
+
+/**
+ * Interpolate the chunk onto the uniform grid, emitting a column
+ * whenever a full window is available.
+ */
+void SpectrogramView::_resample()
+{
+    for (const trace_point_t& sample : _chunk) {
+        // First sample, or time went back (simulation restarted)
+        if (!_have_prev || sample.t < _prev.t) {
+            _grid.clear();
+            _prev = sample;
+            _have_prev = true;
+            _t_next = sample.t;
+        }
+        if (sample.t == _prev.t) {
+            _prev = sample;
+            continue;
+        }
+
+        while (_t_next <= sample.t) {
+            float a = (_t_next - _prev.t) / (sample.t - _prev.t);
+            _grid.push_back(_prev.v + a * (sample.v - _prev.v));
+            _t_next += dt;
+            if ((int) _grid.size() == window) {
+                _emit_column();
+                _grid.erase(_grid.begin(), _grid.begin() + hop);
+            }
+        }
+        _prev = sample;
+    }
+}
+
+
+/**
+ * Power spectrum of the grid window (mean removed), as colors.
+ */
+void SpectrogramView::_emit_column()
+{
+    float mean = 0.0;
+    for (int i = 0; i < window; i++) {
+        mean += _grid[i];
+    }
+    mean /= window;
+    for (int i = 0; i < window; i++) {
+        _windowed[i] = (_grid[i] - mean) * _hann[i];
+    }
+    _fft->power_spectrum(_windowed.data(), _power.data());
+
+    float db_max = -1e30;
+    for (int k = 0; k < _num_rows; k++) {
+        _power[k] = 10.0f * std::log10(_power[k] + 1e-20f);
+        db_max = std::max(db_max, _power[k]);
+    }
+    _db_peak = std::max(db_max, _db_peak - DB_PEAK_DECAY);
+
+    // Highest frequency in the top row
+    float db_lower = _db_peak - db_range;
+    for (int row = 0; row < _num_rows; row++) {
+        float db = _power[_num_rows - 1 - row];
+        colormap_rgba((db - db_lower) / db_range, &_column[4 * row]);
+    }
+
+    std::lock_guard<std::mutex> guard(_pending_mutex);
+    if (_pending.size() >= MAX_PENDING_COLUMNS) {
+        _pending.pop_front(); // render thread not drawing us
+    }
+    _pending.push_back(_column);
+}
+
+
+//==============================================================================
+// Render thread
+
+/**
+ * Upload the columns finished since the last frame and draw the
+ * spectrogram with the newest column at the right.
+ */
+void SpectrogramView::draw(const ofRectangle& viewport)
+{
+    if (_num_rows == 0) {
+        return; // not started
+    }
+    if (!_texture.is_allocated() || _texture.num_rows() != _num_rows
+                                 || _texture.num_columns() != num_columns) {
+        _texture.allocate(num_columns, _num_rows);
+    }
+
+    // Never wait for the worker: its columns are drawn next frame
+    {
+        std::unique_lock<std::mutex> lock(_pending_mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            while (!_pending.empty()) {
+                _taken.push_back(std::move(_pending.front()));
+                _pending.pop_front();
+            }
+        }
+    }
+    for (const auto& column : _taken) {
+        _texture.write_column(column.data());
+    }
+    _taken.clear();
+
+    ofPushStyle();
+    ofSetColor(255);
+    _texture.draw(viewport, _num_rows);
+    ofSetColor(0);
+    ofDrawBitmapString(_name, viewport.x, viewport.y - 8);
+    ofDrawBitmapString(ofToString((_num_rows - 1) * _df, 0) + " Hz",
+                       viewport.x - 70, viewport.y + 10);
+    ofDrawBitmapString("0 Hz", viewport.x - 70, viewport.getBottom());
+    ofPopStyle();
+}
@@ -0,0 +1,92 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "SampleBuffer.h"
+#include "ScrollingTexture.h"
+#include "Fft.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+/**
+ * Spectrogram (waterfall of power spectra) of one variable.
+ *
+ * A worker thread follows the variable's sample buffer through
+ * snapshots, like the render thread does: new samples are linearly
+ * interpolated onto a uniform time grid (dt), since the simulator's
+ * step may vary, and every hop grid samples the newest window of grid
+ * samples is multiplied with a Hann window and transformed with Fft.
+ * Windows overlap by window - hop samples. The power in dB, relative to
+ * a slowly decaying peak, becomes one column of colors.
+ *
+ * Finished columns are handed to the render thread, which uploads them
+ * to a ScrollingTexture in draw(); it never touches samples or spectra.
+ *
+ * Options (dt, window, hop, f_max, db_range) must be set before start().
+ */
+class SpectrogramView : public ofThread
+{
+  public:
+    SpectrogramView() :
+        dt(1.0),
+        window(1024),
+        hop(256),
+        f_max(200.0),
+        db_range(60.0),
+        num_columns(512),
+        _num_rows(0),
+        _df(0.0),
+        _have_prev(false),
+        _t_next(0.0),
+        _seq_next(0),
+        _db_peak(-1e30) {}
+
+    void start(std::shared_ptr<SampleBuffer> samples, const std::string& name);
+    void stop();
+    void draw(const ofRectangle& viewport);
+
+    float dt;        // [ms] of the uniform grid
+    int window;      // grid samples per FFT (power of two)
+    int hop;         // grid samples between columns
+    float f_max;     // [Hz] highest frequency shown
+    float db_range;  // dB below the peak shown (black below)
+    int num_columns; // columns shown
+
+  protected:
+    void threadedFunction() override;
+
+  private:
+    void _resample();
+    void _emit_column();
+
+    static const size_t MAX_PENDING_COLUMNS = 256;
+
+    // Set by start(), then only used by the worker thread
+    std::shared_ptr<SampleBuffer> _samples;
+    std::string _name;
+    std::unique_ptr<Fft> _fft;
+    int _num_rows; // frequency bins shown
+    float _df;     // [Hz] between bins
+    std::vector<float> _hann;
+    std::vector<trace_point_t> _chunk; // copied from the ring
+    std::vector<float> _grid;     // uniform samples, oldest first
+    std::vector<float> _windowed; // window * _grid for one FFT
+    std::vector<float> _power;
+    trace_point_t _prev;          // last sample interpolated from
+    bool _have_prev;
+    double _t_next;               // [ms] next grid time
+    uint64_t _seq_next;           // next sample to resample
+    float _db_peak;
+    std::vector<uint8_t> _column;
+
+    // Columns waiting for upload (RGBA, highest frequency first)
+    std::mutex _pending_mutex;
+    std::deque<std::vector<uint8_t>> _pending;
+    std::vector<std::vector<uint8_t>> _taken; // render thread only
+
+    ScrollingTexture _texture;
+};
@@ -0,0 +1,118 @@
+#include "SpikeDetector.h"
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+SpikeDetector::SpikeDetector(uint32_t gid, float threshold, float refractory) :
+    gid(gid),
+    threshold(threshold),
+    refractory(refractory),
+    _t_last_spike(-std::numeric_limits<float>::infinity())
+{
+    _prev.t = -std::numeric_limits<float>::infinity();
+    _prev.v = std::numeric_limits<float>::quiet_NaN(); // no crossing at the first sample
+}
+
+
+/**
+ * Append the spikes in the next batch of samples to spikes.
+ *
+ * @return  number of spikes appended
+ */
+size_t SpikeDetector::detect(const trace_point_t* samples, size_t n,
+                             std::vector<spike_event_t>& spikes)
+{
+    if (n == 0) {
+        return 0;
+    }
+
+    // Time went back (simulation restarted): start over
+    if (samples[0].t < _prev.t) {
+        _prev.v = std::numeric_limits<float>::quiet_NaN();
+        _t_last_spike = -std::numeric_limits<float>::infinity();
+    }
+
+    _crossings.resize(n);
+    size_t num_crossings = find_crossings(samples, n, threshold, _prev.v,
+                                          _crossings.data());
+
+    size_t num_spikes = 0;
+    for (size_t c = 0; c < num_crossings; c++) {
+        uint32_t i = _crossings[c];
+        trace_point_t before = (i > 0) ? samples[i - 1] : _prev;
+        trace_point_t after = samples[i];
+
+        // Linear interpolation between the samples around the crossing
+        float t = before.t + (threshold - before.v) / (after.v - before.v)
+                             * (after.t - before.t);
+        if (t - _t_last_spike < refractory) {
+            continue;
+        }
+        spikes.push_back({t, gid});
+        _t_last_spike = t;
+        num_spikes++;
+    }
+    _prev = samples[n - 1];
+    return num_spikes;
+}
+
+
+/**
+ * Find the upward threshold crossings in a batch of samples.
+ *
+ * @param   v_prev
+ *          value of the sample before samples[0] (NaN: none)
+ *
+ * @param   indices
+ *          room for n indices: i such that samples[i - 1].v < threshold
+ *          and samples[i].v >= threshold, in ascending order
+ *
+ * @return  number of crossings
+ */
+size_t SpikeDetector::find_crossings(const trace_point_t* samples, size_t n,
+                                     float threshold, float v_prev,
+                                     uint32_t* indices)
+{
+    size_t num = 0;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    static_assert(sizeof(trace_point_t) == 2 * sizeof(float),
+                  "samples are loaded as (t, v) pairs of floats");
+    const float* data = &samples[0].t;
+    __m128 thr = _mm_set1_ps(threshold);
+    __m128 prev = _mm_set1_ps(v_prev);
+    for (; i + 4 <= n; i += 4) {
+        // v of samples i..i+3, and of i-1..i+2 (last one of prev)
+        __m128 tv01 = _mm_loadu_ps(data + 2 * i);
+        __m128 tv23 = _mm_loadu_ps(data + 2 * i + 4);
+        __m128 v = _mm_shuffle_ps(tv01, tv23, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 mix = _mm_shuffle_ps(prev, v, _MM_SHUFFLE(0, 0, 3, 3));
+        __m128 v_before = _mm_shuffle_ps(mix, v, _MM_SHUFFLE(2, 1, 2, 0));
+
+        int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(v_before, thr),
+                                              _mm_cmpge_ps(v, thr)));
+        while (mask) {
+            indices[num++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+        prev = v;
+    }
+    if (i > 0) {
+        v_prev = samples[i - 1].v;
+    }
+#endif
+
+    for (; i < n; i++) {
+        float v = samples[i].v;
+        if (v_prev < threshold && v >= threshold) {
+            indices[num++] = i;
+        }
+        v_prev = v;
+    }
+    return num;
+}
@@ -0,0 +1,55 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "SampleBuffer.h"
+#include "SpikeStore.h"
+
+#include <cstdint>
+#include <vector>
+
+
+// Defaults for spike detection on voltage traces
+const float DEFAULT_SPIKE_THRESHOLD = 0.0;  // [mV]
+const float DEFAULT_SPIKE_REFRACTORY = 2.0; // [ms]
+
+
+/**
+ * Spike detection on the samples of one variable (e.g. a soma voltage),
+ * for simulations that do not publish spike events themselves.
+ *
+ * A spike is an upward crossing of the threshold at least the refractory
+ * period after the previous spike; its time is interpolated between the
+ * two samples around the crossing. Each batch of samples is searched
+ * for crossings four samples at a time with SSE2 (scalar elsewhere), so
+ * the cost is a compare per sample and a little work per crossing.
+ *
+ * The state between batches (last sample, last spike) lives here, so
+ * crossings between two batches are found; it is reset when sample time
+ * goes back (the simulation restarted). Used by the ingest thread.
+ */
+class SpikeDetector
+{
+  public:
+    SpikeDetector(uint32_t gid,
+                  float threshold = DEFAULT_SPIKE_THRESHOLD,
+                  float refractory = DEFAULT_SPIKE_REFRACTORY);
+
+    size_t detect(const trace_point_t* samples, size_t n,
+                  std::vector<spike_event_t>& spikes);
+
+    static size_t find_crossings(const trace_point_t* samples, size_t n,
+                                 float threshold, float v_prev,
+                                 uint32_t* indices);
+
+    // [ms] time of the last sample seen (-infinity before the first)
+    float t_last_sample() const { return _prev.t; }
+
+    const uint32_t gid; // of the spike events
+    const float threshold;
+    const float refractory;
+
+  private:
+    trace_point_t _prev; // last sample of the previous batch (v is NaN before the first)
+    float _t_last_spike;
+    std::vector<uint32_t> _crossings; // reused by detect()
+};
@@ -0,0 +1,80 @@
+#include "SpikeParticles.h"
+
+
+/**
+ * Collect emission sites and allocate the particle pool. Must be called
+ * with a GL context.
+ */
+void SpikeParticles::setup(const Morphology& morphology, size_t capacity)
+{
+    const Morphology& m = morphology;
+    _sites.clear();
+    for (size_t i = 0; i < m.num_points(); i++) {
+        if (m.type[i] == SWC_SOMA || m.type[i] == SWC_AXON) {
+            _sites.push_back(glm::vec3(m.x[i], m.y[i], m.z[i]));
+        }
+    }
+
+    // Without soma or axon: emit at the roots
+    if (_sites.empty()) {
+        for (size_t i = 0; i < m.num_points(); i++) {
+            if (m.parent[i] < 0) {
+                _sites.push_back(glm::vec3(m.x[i], m.y[i], m.z[i]));
+            }
+        }
+    }
+    _next_site = 0;
+
+    _pool.setup(capacity);
+}
+
+
+/**
+ * Emit particles for spikes that arrived since the last update and
+ * advance all particles by dt [ms].
+ */
+void SpikeParticles::update(const spike_stores_t& spikes, float dt)
+{
+    // More spikes than fit into the pool would only be dropped
+    size_t max_spikes = _pool.capacity() / std::max<size_t>(per_spike, 1);
+
+    for (int source = 0; source < NUM_SPIKE_SOURCES; source++) {
+        if (!spikes[source]) {
+            continue;
+        }
+        auto view = spikes[source]->snapshot();
+        if (view.seq_end() > _seq_scanned[source] + max_spikes) {
+            _seq_scanned[source] = view.seq_end() - max_spikes;
+        }
+        view.advance_begin(_seq_scanned[source]);
+
+        if (!_sites.empty()) {
+            for (uint64_t seq = view.seq_begin(); seq < view.seq_end(); ++seq) {
+                if (gid >= 0 && view[seq].gid != gid) {
+                    continue;
+                }
+                // Spread bursts over the sites, cheaper than random choice
+                _pool.emit(_sites[_next_site], per_spike, speed, lifetime);
+                _next_site = (_next_site + 1) % _sites.size();
+            }
+        }
+        _seq_scanned[source] = view.seq_end();
+    }
+
+    _pool.update(dt);
+}
+
+
+/**
+ * Forget spikes that arrived since the last update, e.g. while the
+ * particles are not shown, so that they do not burst out at once later.
+ */
+void SpikeParticles::skip(const spike_stores_t& spikes)
+{
+    for (int source = 0; source < NUM_SPIKE_SOURCES; source++) {
+        if (spikes[source]) {
+            _seq_scanned[source] = spikes[source]->snapshot().seq_end();
+        }
+    }
+    _pool.clear();
+}
@@ -0,0 +1,48 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "Morphology.h"
+#include "ParticlePool.h"
+#include "SpikeStore.h"
+
+#include <cstdint>
+#include <vector>
+
+
+// Default number of live particles
+const size_t DEFAULT_PARTICLE_CAPACITY = 1 << 16;
+
+
+/**
+ * Particle bursts on the morphology for every spike: each new spike
+ * event emits particles from the next soma or axon point in turn
+ * (round robin over all of them), which fly off and fade out.
+ */
+class SpikeParticles
+{
+  public:
+    SpikeParticles() :
+        per_spike(16),
+        lifetime(500.0),
+        speed(50.0),
+        gid(-1),
+        _seq_scanned(),
+        _next_site(0) {}
+
+    void setup(const Morphology& morphology, size_t capacity = DEFAULT_PARTICLE_CAPACITY);
+    void update(const spike_stores_t& spikes, float dt);
+    void skip(const spike_stores_t& spikes);
+    void draw() { _pool.draw(); }
+
+    size_t per_spike; // particles emitted per spike
+    float lifetime;   // [ms] of a particle
+    float speed;      // [morphology units/s] initial particle speed
+    int64_t gid;      // only spikes of this cell, all cells if < 0
+
+  private:
+    ParticlePool _pool;
+    std::vector<glm::vec3> _sites; // soma and axon points
+    uint64_t _seq_scanned[NUM_SPIKE_SOURCES]; // spike events already emitted
+    uint32_t _next_site;
+};
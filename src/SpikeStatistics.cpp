@@ -0,0 +1,164 @@
+#include "SpikeStatistics.h"
+#include <algorithm>
+#include <cmath>
+
+
+/**
+ * Add the spikes that arrived since the last call.
+ */
+void SpikeStatistics::update(const spike_stores_t& spikes)
+{
+    for (int source = 0; source < NUM_SPIKE_SOURCES; source++) {
+        if (!spikes[source]) {
+            continue;
+        }
+        auto view = spikes[source]->snapshot();
+        if (_seq_scanned[source] < view.seq_begin()) {
+            num_lost += view.seq_begin() - _seq_scanned[source];
+        }
+        view.advance_begin(_seq_scanned[source]);
+        _events.clear();
+        for (uint64_t seq = view.seq_begin(); seq < view.seq_end(); ++seq) {
+            _events.push_back(view[seq]);
+        }
+
+        // Events overwritten while we copied them are lost too
+        uint64_t seq_intact = view.validate();
+        num_lost += seq_intact - view.seq_begin();
+
+        for (size_t i = seq_intact - view.seq_begin(); i < _events.size(); i++) {
+            const spike_event_t& spike = _events[i];
+            auto it = _stats.find(spike.gid);
+            if (it == _stats.end()) {
+                spike_stats_t stats = {};
+                it = _stats.emplace(spike.gid, stats).first;
+            }
+            _add(it->second, spike.t, source);
+        }
+        _seq_scanned[source] = view.seq_end();
+    }
+}
+
+
+/**
+ * Statistics of a gid (nullptr if it has not spiked).
+ */
+const spike_stats_t* SpikeStatistics::find(uint32_t gid) const
+{
+    auto it = _stats.find(gid);
+    return (it != _stats.end()) ? &it->second : nullptr;
+}
+
+
+void SpikeStatistics::_add(spike_stats_t& stats, float t, int source)
+{
+    // Time went back within one source: the simulation restarted
+    if (t < stats.t_source[source]) {
+        stats = spike_stats_t();
+    }
+    stats.t_source[source] = t;
+
+    if (stats.count > 0) {
+        stats.rate *= std::exp(-std::max(0.0f, t - stats.t_last) / rate_window);
+    }
+    stats.rate += 1000.0 / rate_window;
+    stats.count++;
+
+    // Spikes out of order (from different sources) have no ISI
+    if (stats.count == 1 || t <= stats.t_last) {
+        stats.t_last = std::max(stats.t_last, t);
+        return;
+    }
+    float isi = t - stats.t_last;
+    stats.t_last = t;
+    stats.isi_last = isi;
+
+    stats.num_isi++;
+    double delta = isi - stats.isi_mean;
+    stats.isi_mean += delta / stats.num_isi;
+    stats.isi_m2 += delta * (isi - stats.isi_mean);
+
+    int bin = (int) std::floor(ISI_BINS_PER_OCTAVE * std::log2(isi / ISI_MIN));
+    stats.isi_hist[std::min(std::max(bin, 0), ISI_BINS - 1)]++;
+}
+
+
+/**
+ * Windowed rate [Hz] at time t (>= time of the newest spike).
+ */
+float SpikeStatistics::rate_at(const spike_stats_t& stats, float t) const
+{
+    return stats.rate * std::exp(-std::max(0.0f, t - stats.t_last) / rate_window);
+}
+
+
+/**
+ * Inverse of the last ISI [Hz] (0 before the second spike).
+ */
+float SpikeStatistics::instantaneous_rate(const spike_stats_t& stats)
+{
+    return (stats.isi_last > 0.0) ? 1000.0 / stats.isi_last : 0.0;
+}
+
+
+/**
+ * Coefficient of variation of the ISIs (0 with less than two ISIs).
+ */
+float SpikeStatistics::isi_cv(const spike_stats_t& stats)
+{
+    if (stats.num_isi < 2 || stats.isi_mean <= 0.0) {
+        return 0.0;
+    }
+    double variance = stats.isi_m2 / (stats.num_isi - 1);
+    return std::sqrt(variance) / stats.isi_mean;
+}
+
+
+/**
+ * Small overlay with rates, CV and ISI histogram, top left at (x, y).
+ */
+void SpikeStatistics::draw(const spike_stats_t& stats, float t, float x, float y) const
+{
+    ofPushStyle();
+    ofSetColor(0);
+    ofDrawBitmapString(ofToString(rate_at(stats, t), 1) + " Hz", x, y + 10);
+    ofDrawBitmapString("CV " + ofToString(isi_cv(stats), 2), x, y + 22);
+
+    // One 2 pixel bar per bin, scaled to the fullest bin
+    uint32_t max_count = *std::max_element(stats.isi_hist, stats.isi_hist + ISI_BINS);
+    if (max_count > 0) {
+        const float height = 16.0;
+        ofSetColor(100);
+        for (int i = 0; i < ISI_BINS; i++) {
+            float h = height * stats.isi_hist[i] / max_count;
+            ofDrawRectangle(x + 2 * i, y + 28 + height - h, 2, h);
+        }
+    }
+    ofPopStyle();
+}
+
+
+/**
+ * Write the statistics of all gids as a JSON object keyed by gid,
+ * windowed rates taken at time t.
+ */
+void SpikeStatistics::write_json(std::ostream& os, float t) const
+{
+    os << "{";
+    bool first = true;
+    for (const auto& entry : _stats) {
+        const spike_stats_t& stats = entry.second;
+        os << (first ? "\n" : ",\n") << "    \"" << entry.first << "\": {\"spikes\": " << stats.count
+           << ", \"rate_hz\": " << rate_at(stats, t)
+           << ", \"instantaneous_rate_hz\": " << instantaneous_rate(stats)
+           << ", \"isi_mean_ms\": " << stats.isi_mean
+           << ", \"isi_cv\": " << isi_cv(stats)
+           << ", \"isi_hist\": [";
+        for (int i = 0; i < ISI_BINS; i++) {
+            os << (i > 0 ? ", " : "") << stats.isi_hist[i];
+        }
+        os << "]}";
+        first = false;
+    }
+    os << "\n  }";
+}
@@ -0,0 +1,86 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "ofMain.h"
+#include "SpikeStore.h"
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+
+// ISI histogram: ISI_BINS_PER_OCTAVE bins per doubling from ISI_MIN,
+// shorter and longer intervals go to the first and last bin
+const int ISI_BINS = 40;
+const int ISI_BINS_PER_OCTAVE = 4;
+const float ISI_MIN = 1.0; // [ms]
+
+// Default time constant of the windowed firing rate
+const float DEFAULT_RATE_WINDOW = 1000.0; // [ms]
+
+
+// Running statistics of the spikes of one gid
+typedef struct {
+    uint64_t count;
+    uint64_t num_isi;
+    float t_last;   // [ms] time of the newest spike
+    float t_source[NUM_SPIKE_SOURCES]; // [ms] newest spike per source
+    float isi_last; // [ms] 0 before the second spike
+    float rate;     // [Hz] windowed rate at t_last
+    double isi_mean; // running mean and sum of squared deviations of ISIs
+    double isi_m2;   // (Welford)
+    uint32_t isi_hist[ISI_BINS];
+} spike_stats_t;
+
+
+/**
+ * Firing rate and inter-spike interval (ISI) statistics per gid,
+ * updated from the spike stores (published and detected) once per frame.
+ *
+ * Every new spike costs O(1) and nothing is kept per spike, only a fixed
+ * size record per gid (~200 bytes):
+ *
+ * - instantaneous rate: inverse of the last ISI,
+ *
+ * - windowed rate: spikes counted with an exponentially decaying
+ *   weight (time constant rate_window), which needs no list of recent
+ *   spikes and decays between spikes when read with rate_at(),
+ *
+ * - ISI histogram on a log scale, and the coefficient of variation of
+ *   the ISIs from Welford's running mean and variance.
+ *
+ * Each store is sorted by time, so a spike older than the previous one
+ * of the same gid and source means that the simulation restarted: the
+ * record of the gid starts over.
+ */
+class SpikeStatistics
+{
+  public:
+    SpikeStatistics(float rate_window = DEFAULT_RATE_WINDOW) :
+        rate_window(rate_window),
+        num_lost(0),
+        _seq_scanned() {}
+
+    void update(const spike_stores_t& spikes);
+    const spike_stats_t* find(uint32_t gid) const;
+
+    float rate_at(const spike_stats_t& stats, float t) const;
+    static float instantaneous_rate(const spike_stats_t& stats);
+    static float isi_cv(const spike_stats_t& stats);
+
+    void draw(const spike_stats_t& stats, float t, float x, float y) const;
+    void write_json(std::ostream& os, float t) const;
+
+    size_t size() const { return _stats.size(); }
+
+    float rate_window; // [ms]
+    uint64_t num_lost; // overwritten in a store before we saw them
+
+  private:
+    void _add(spike_stats_t& stats, float t, int source);
+
+    std::unordered_map<uint32_t, spike_stats_t> _stats;
+    uint64_t _seq_scanned[NUM_SPIKE_SOURCES]; // events already counted
+    std::vector<spike_event_t> _events; // copied from a snapshot, then validated
+};
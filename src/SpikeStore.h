@@ -0,0 +1,92 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "SnapshotRing.h"
+
+#include <array>
+#include <memory>
+
+
+// One spike of one cell
+typedef struct {
+    float t;
+    uint32_t gid;
+} spike_event_t;
+
+// Default number of spike events retained
+const size_t DEFAULT_SPIKE_CAPACITY = 1 << 20;
+
+
+/**
+ * Spike events of all cells from one source, in order of arrival.
+ *
+ * Written by the ingest thread and read by the render thread through
+ * lock-free snapshots, like SampleBuffer. Each store must be sorted by
+ * time (between restarts of the simulation), so that a time range is
+ * found by binary search:
+ *
+ * - published spikes: the publisher sends them in order of time,
+ *
+ * - detected spikes: found in samples, which arrive in order of time;
+ *   the spikes of all variables in a message are sorted before they
+ *   are appended.
+ *
+ * The two sources are not in step with each other (spike messages and
+ * sample messages arrive independently), so they go to separate stores
+ * (see spike_stores_t) and readers combine them.
+ */
+class SpikeStore
+{
+  public:
+    typedef SnapshotRing<spike_event_t>::View View;
+
+    SpikeStore(size_t capacity = DEFAULT_SPIKE_CAPACITY) : _events(capacity) {}
+
+    /**
+     * Append events. Must only be called from the ingest thread.
+     */
+    void push(const spike_event_t* events, size_t n) {
+        _events.push(events, n);
+    }
+
+    View snapshot() const { return _events.snapshot(); }
+
+    /**
+     * Snapshot of the events with t_begin <= t.
+     */
+    View snapshot_since(float t_begin) const {
+        View view = _events.snapshot();
+        view.advance_begin(lower_bound(view, t_begin));
+        return view;
+    }
+
+    /**
+     * First sequence number in view with event time t >= t_min.
+     */
+    static uint64_t lower_bound(const View& view, float t_min) {
+        uint64_t lo = view.seq_begin();
+        uint64_t hi = view.seq_end();
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (view[mid].t < t_min) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+  private:
+    SnapshotRing<spike_event_t> _events;
+};
+
+
+// Spike stores by source
+enum spike_source_t {
+    SPIKES_PUBLISHED, // spike messages of the simulator
+    SPIKES_DETECTED,  // threshold crossings in received samples
+    NUM_SPIKE_SOURCES
+};
+
+typedef std::array<std::shared_ptr<SpikeStore>, NUM_SPIKE_SOURCES> spike_stores_t;
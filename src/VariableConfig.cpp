@@ -0,0 +1,302 @@
+#include "VariableConfig.h"
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib> // strtoul, ...
+#include <iostream>
+#include <unordered_set>
+
+
+namespace {
+
+/**
+ * Like cpptoml's table::get_as(), but without the cost of an exception
+ * being thrown and caught for missing keys (which dominates parse time
+ * for large configs with optional keys).
+ */
+template <class T>
+cpptoml::option<T> get_optional(const cpptoml::table& table, const std::string& key)
+{
+    if (!table.contains(key)) {
+        return {};
+    }
+    return table.get_as<T>(key);
+}
+
+
+/**
+ * Parse an unsigned decimal number that fits an unsigned int,
+ * without sign (strtoul accepts and negates "-1").
+ */
+bool parse_id(const char*& pos, unsigned long& id)
+{
+    while (*pos == ' ') {
+        pos++;
+    }
+    if (!std::isdigit((unsigned char) *pos)) {
+        return false;
+    }
+    char* end;
+    errno = 0;
+    id = std::strtoul(pos, &end, 10);
+    if (errno == ERANGE || id > UINT_MAX) {
+        return false;
+    }
+    pos = end;
+    return true;
+}
+
+} // namespace
+
+
+//==============================================================================
+// Variable declarations
+
+/**
+ * Collect all variable declarations from the [[variable]] tables.
+ *
+ * Declarations with missing or invalid identifiers are reported
+ * and skipped, like other config errors.
+ */
+void VariableConfig::parse(const cpptoml::table& config)
+{
+    _specs.clear();
+    _group_options.clear();
+
+    // Options shared by all variables
+    auto p_defaults = config.contains("defaults") ? config.get_table("defaults") : nullptr;
+    if (p_defaults) {
+        _read_options(*p_defaults, _defaults);
+    }
+
+    auto var_descriptions = config.contains("variable") ?
+                            config.get_table_array("variable") : nullptr;
+    if (!var_descriptions) {
+        return;
+    }
+
+    std::vector<unsigned int> ids;
+    std::unordered_set<unsigned int> declared;
+    for (const auto& descr : *var_descriptions)
+    {
+        // *descr is a cpptoml::table
+        auto p_varname = get_optional<std::string>(*descr, "name");
+        auto p_varid = get_optional<uint32_t>(*descr, "id");
+        auto p_varids = get_optional<std::string>(*descr, "ids");
+
+        if (p_varid && p_varids) {
+            std::cout << "Variable description '" << (p_varname ? *p_varname : "")
+                      << "' has both an identifier number (id) and identifier "
+                      << "ranges (ids), use one." << std::endl;
+            continue;
+        }
+
+        ids.clear();
+        if (p_varid) {
+            ids.push_back(*p_varid);
+        } else if (p_varids && !parse_id_ranges(*p_varids, ids)) {
+            std::cout << "Invalid identifier ranges '" << *p_varids
+                      << "' in variable description (at most "
+                      << MAX_IDS_PER_RANGE << " ids)." << std::endl;
+            continue;
+        }
+
+        if (!(p_varname && !ids.empty())) {
+            std::cout << "Each variable description must contain at least "
+                      << "a name and identifier number (id) or "
+                      << "identifier ranges (ids)." << std::endl;
+            continue;
+        }
+
+        NamePattern pattern(*p_varname);
+        if (ids.size() > 1 && !pattern.has_placeholders()) {
+            std::cout << "Name '" << *p_varname << "' of variable group "
+                      << "should contain {id} or {index}." << std::endl;
+        }
+
+        // Group-level options override the defaults
+        _group_options.emplace_back(new variable_options_t(_defaults));
+        variable_options_t* options = _group_options.back().get();
+        _read_options(*descr, *options);
+
+        // Segments of the morphology showing the variables
+        std::vector<unsigned int> segments;
+        auto p_segments = get_optional<std::string>(*descr, "segments");
+        if (p_segments && (!parse_id_ranges(*p_segments, segments)
+                           || (ids.size() > 1 && segments.size() != ids.size()))) {
+            std::cout << "Invalid segments '" << *p_segments << "' of variable '"
+                      << *p_varname << "': need one segment per variable "
+                      << "of a group." << std::endl;
+            segments.clear();
+        }
+
+        // Derived variable
+        auto p_expr = get_optional<std::string>(*descr, "expr");
+        if (p_expr && ids.size() > 1) {
+            std::cout << "Expression of variable group '" << *p_varname
+                      << "' ignored: declare derived variables one by one." << std::endl;
+        }
+
+        // Every id is declared once, the first declaration wins
+        size_t num_duplicates = 0;
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (!declared.insert(ids[i]).second) {
+                num_duplicates++;
+                continue;
+            }
+            _specs.push_back({ids[i], pattern.format(ids[i], i), options, {}, ""});
+            if (ids.size() == 1) {
+                _specs.back().segments.swap(segments);
+                if (p_expr) {
+                    _specs.back().expr = *p_expr;
+                }
+            } else if (!segments.empty()) {
+                _specs.back().segments.push_back(segments[i]);
+            }
+        }
+        if (num_duplicates > 0) {
+            std::cout << num_duplicates << " id(s) of variable '" << *p_varname
+                      << "' were declared before and are ignored." << std::endl;
+        }
+    }
+}
+
+
+/**
+ * Override options with those present in a config table.
+ */
+void VariableConfig::_read_options(const cpptoml::table& table,
+                                   variable_options_t& options)
+{
+    if (auto p = get_optional<double>(table, "v_lim_upper")) {
+        options.v_lim_upper = *p;
+    }
+    if (auto p = get_optional<double>(table, "v_lim_lower")) {
+        options.v_lim_lower = *p;
+    }
+    if (auto p = get_optional<double>(table, "y_per_v")) {
+        options.y_per_v = *p;
+    }
+    if (auto p = get_optional<double>(table, "x_per_t")) {
+        options.x_per_t = *p;
+    }
+    if (auto p = get_optional<bool>(table, "compress_history")) {
+        options.compress_history = *p;
+    }
+    if (auto p = get_optional<unsigned int>(table, "samples")) {
+        options.buffer_samples = *p;
+    }
+    if (auto p = get_optional<bool>(table, "autoscale")) {
+        options.autoscale = *p;
+    }
+    if (auto p = get_optional<bool>(table, "detect_spikes")) {
+        options.detect_spikes = *p;
+    }
+    if (auto p = get_optional<double>(table, "spike_threshold")) {
+        options.spike_threshold = *p;
+    }
+    if (auto p = get_optional<double>(table, "spike_refractory")) {
+        options.spike_refractory = *p;
+    }
+}
+
+
+/**
+ * Parse identifier ranges like "1000-4999,6000,7000-7010".
+ *
+ * @param   ids
+ *          identifiers are appended to this vector, in order
+ *
+ * @return  false if the string is malformed, a number does not fit an
+ *          unsigned int or there are more than MAX_IDS_PER_RANGE ids
+ */
+bool VariableConfig::parse_id_ranges(const std::string& ranges,
+                                     std::vector<unsigned int>& ids)
+{
+    const char* pos = ranges.c_str();
+    uint64_t num_ids = 0;
+    while (*pos) {
+        unsigned long first;
+        if (!parse_id(pos, first)) {
+            return false;
+        }
+        unsigned long last = first;
+        while (*pos == ' ') {
+            pos++;
+        }
+        if (*pos == '-') {
+            pos++;
+            if (!parse_id(pos, last) || last < first) {
+                return false;
+            }
+        }
+        num_ids += (uint64_t) last - first + 1;
+        if (num_ids > MAX_IDS_PER_RANGE) {
+            return false;
+        }
+        while (*pos == ' ') {
+            pos++;
+        }
+        if (*pos == ',') {
+            pos++;
+        } else if (*pos) {
+            return false;
+        }
+
+        for (uint64_t id = first; id <= last; id++) {
+            ids.push_back((unsigned int) id);
+        }
+    }
+    return true;
+}
+
+
+//==============================================================================
+// Name patterns
+
+NamePattern::NamePattern(const std::string& pattern)
+{
+    size_t pos = 0;
+    std::string literal;
+    while (pos < pattern.size()) {
+        if (pattern.compare(pos, 4, "{id}") == 0) {
+            _pieces.push_back({LITERAL, literal});
+            _pieces.push_back({ID, ""});
+            literal.clear();
+            pos += 4;
+        } else if (pattern.compare(pos, 7, "{index}") == 0) {
+            _pieces.push_back({LITERAL, literal});
+            _pieces.push_back({INDEX, ""});
+            literal.clear();
+            pos += 7;
+        } else {
+            literal += pattern[pos++];
+        }
+    }
+    _pieces.push_back({LITERAL, literal});
+}
+
+
+bool NamePattern::has_placeholders() const
+{
+    for (const auto& piece : _pieces) {
+        if (piece.kind != LITERAL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+std::string NamePattern::format(unsigned int id, size_t index) const
+{
+    std::string name;
+    for (const auto& piece : _pieces) {
+        switch (piece.kind) {
+            case LITERAL: name += piece.text; break;
+            case ID:      name += std::to_string(id); break;
+            case INDEX:   name += std::to_string(index); break;
+        }
+    }
+    return name;
+}
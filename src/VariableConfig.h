@@ -0,0 +1,133 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <limits> // needed by cpptoml.h
+#include "cpptoml.h"
+#include "SampleBuffer.h"
+#include "SpikeDetector.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Ids declared by one "ids" (or "segments") string at most, so that a
+// typo in a range does not allocate millions of buffers
+const size_t MAX_IDS_PER_RANGE = 100000;
+
+
+// Plotting and storage options of a variable that can be set in the
+// config file, either in [defaults] or in a [[variable]] table.
+typedef struct {
+    float v_lim_upper;
+    float v_lim_lower;
+    float y_per_v;
+    float x_per_t;
+    bool compress_history;
+    size_t buffer_samples;
+    bool autoscale; // v_lim_* follow the visible samples
+    bool detect_spikes; // threshold crossings become spike events
+    float spike_threshold;
+    float spike_refractory; // [ms]
+} variable_options_t;
+
+const variable_options_t DEFAULT_VARIABLE_OPTIONS = {
+    40.0,   // v_lim_upper
+    -80.0,  // v_lim_lower
+    1.0,    // y_per_v
+    0.5,    // x_per_t
+    false,  // compress_history
+    DEFAULT_BUFFER_CAPACITY,
+    false,  // autoscale
+    false,  // detect_spikes
+    DEFAULT_SPIKE_THRESHOLD,
+    DEFAULT_SPIKE_REFRACTORY
+};
+
+
+// One variable declared in the config file
+typedef struct {
+    unsigned int id;
+    std::string name;
+    const variable_options_t* options; // shared by all variables of a group
+    std::vector<unsigned int> segments; // SWC sample numbers it is shown on
+    std::string expr; // derived variable: expression of other variables
+} variable_spec_t;
+
+
+/**
+ * Variable declarations from the config file.
+ *
+ * Each [[variable]] table declares either a single variable:
+ *
+ *     [[variable]]
+ *     id = 1
+ *     name = "Vsoma"
+ *
+ * or a group of variables with a range of ids and a name pattern:
+ *
+ *     [[variable]]
+ *     ids = "1000-4999,6000"
+ *     name = "soma_{id}"     # also {index}: position in the group
+ *     v_lim_upper = 50.0     # applies to all variables in the group
+ *
+ * Options not given in a [[variable]] table are taken from [defaults].
+ * An id declared twice keeps its first declaration.
+ *
+ * Variables can be shown on the morphology with "segments", a list of
+ * SWC sample numbers in the same range syntax as "ids". A single variable
+ * colors all listed segments, the variables of a group one segment each.
+ *
+ * A single variable can be derived from others with "expr", e.g.
+ * expr = "Vsoma - Vdend" (see Expression.h); its id should not be one
+ * that the simulator publishes.
+ */
+class VariableConfig
+{
+  public:
+    VariableConfig(const variable_options_t& defaults) :
+        _defaults(defaults) {}
+
+    void parse(const cpptoml::table& config);
+
+    const std::vector<variable_spec_t>& specs() const { return _specs; }
+
+    static bool parse_id_ranges(const std::string& ranges,
+                                std::vector<unsigned int>& ids);
+
+  private:
+    static void _read_options(const cpptoml::table& table,
+                              variable_options_t& options);
+
+    variable_options_t _defaults;
+    std::vector<variable_spec_t> _specs;
+
+    // One options struct per [[variable]] table, referenced by its specs
+    std::vector<std::unique_ptr<variable_options_t>> _group_options;
+};
+
+
+/**
+ * Expands a name pattern with {id} and {index} placeholders.
+ *
+ * The pattern is split once, so formatting thousands of names
+ * is a few appends each.
+ */
+class NamePattern
+{
+  public:
+    NamePattern(const std::string& pattern);
+
+    std::string format(unsigned int id, size_t index) const;
+    bool has_placeholders() const;
+
+  private:
+    enum piece_kind { LITERAL, ID, INDEX };
+
+    typedef struct {
+        piece_kind kind;
+        std::string text;
+    } piece_t;
+
+    std::vector<piece_t> _pieces;
+};
@@ -33,9 +33,15 @@ int main(int argc, char* argv[]){
 		exit(1);
 	}
 
+	std::string morphology_file;
+	if (result.count("morphology"))
+	{
+		morphology_file = result["morphology"].as<std::string>();
+	}
+
 	// this kicks off the running of my app
 	// can be OF_WINDOW or OF_FULLSCREEN
 	// pass in width and height too:
-	ofRunApp(new ofApp(config_file));
+	ofRunApp(new ofApp(config_file, morphology_file));
 
 }
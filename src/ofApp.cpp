@@ -1,6 +1,56 @@
 #include "ofApp.h"
 #include "cpptoml.h"
+#include <cmath>
 #include <cstring> // memcpy, ...
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+
+namespace {
+
+// Zoom per step of the mouse wheel (a quarter octave), and zoom limits
+const float ZOOM_STEP = 1.189207f;
+const float X_PER_T_MIN = 1e-5; // [pixels / ms]
+const float X_PER_T_MAX = 1e4;
+
+// Mouse movement [pixels] below which a press is still a click
+const int CLICK_DISTANCE = 3;
+
+/**
+ * Read an optional array of three numbers (integers or floats).
+ *
+ * @return  false if the key exists but is not such an array
+ */
+bool get_vec3(const cpptoml::table& table, const std::string& key, glm::vec3& v)
+{
+    if (!table.contains(key)) {
+        return true;
+    }
+    if (auto floats = table.get_array_of<double>(key)) {
+        if (floats->size() == 3) {
+            v = glm::vec3((*floats)[0], (*floats)[1], (*floats)[2]);
+            return true;
+        }
+    } else if (auto ints = table.get_array_of<int64_t>(key)) {
+        if (ints->size() == 3) {
+            v = glm::vec3((*ints)[0], (*ints)[1], (*ints)[2]);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Screen area of the plots in a window of the given size.
+ */
+ofRectangle plot_viewport(int width, int height)
+{
+    return ofRectangle(0.1 * width, 0.1 * height, 0.8 * width, 0.9 * height);
+}
+
+} // namespace
 
 
 void ofApp::setup()
@@ -25,6 +75,47 @@ void ofApp::setup()
     // setup the socket
     this->_setup_socket(protocol, host, port);
 
+    // =========================================================================
+    // Load cell morphology
+
+    // Command line takes precedence, relative paths in the config
+    // are relative to the config file
+    auto opt_morphology = config->get_qualified_as<std::string>("morphology.file");
+    if (morphology_file.empty() && opt_morphology) {
+        morphology_file = _config_relative(*opt_morphology);
+    }
+    if (!morphology_file.empty()) {
+        uint64_t t_load_start = ofGetElapsedTimeMillis();
+        if (morphology.load(morphology_file)) {
+            DBGMSG(std::cerr, "Loaded morphology with " << morphology.num_points()
+                   << " points, " << morphology.num_sections() << " sections ("
+                   << (ofGetElapsedTimeMillis() - t_load_start) << " ms)");
+        }
+    }
+
+    auto opt_line_pixels = config->get_qualified_as<double>("morphology.lod_line_pixels");
+    auto opt_merge_pixels = config->get_qualified_as<double>("morphology.lod_merge_pixels");
+    if (opt_line_pixels) {
+        morphology_view.line_pixels = *opt_line_pixels;
+    }
+    if (opt_merge_pixels) {
+        morphology_view.merge_pixels = *opt_merge_pixels;
+    }
+    auto opt_morph_upper = config->get_qualified_as<double>("morphology.v_lim_upper");
+    auto opt_morph_lower = config->get_qualified_as<double>("morphology.v_lim_lower");
+    if (opt_morph_upper) {
+        morphology_view.v_lim_upper = *opt_morph_upper;
+    }
+    if (opt_morph_lower) {
+        morphology_view.v_lim_lower = *opt_morph_lower;
+    }
+    morphology_view.setup(morphology);
+
+    // Look at the whole cell
+    _look_at(morphology_view.center(), morphology_view.extent());
+    _camera_view = VIEW_MORPHOLOGY;
+    camera.disableMouseInput();
+
     // =========================================================================
     // Set up MIDI interface
     // see https://github.com/danomatika/ofxMidi/ -> examples
@@ -58,46 +149,333 @@ void ofApp::setup()
         midiIn.setVerbose(true);
     }
 
+    // Buttons that freeze the scrolling views
+    auto opt_freeze_note = config->get_qualified_as<int>("midi.freeze_note");
+    auto opt_freeze_cc = config->get_qualified_as<int>("midi.freeze_cc");
+    midi_freeze_note = opt_freeze_note ? *opt_freeze_note : -1;
+    midi_freeze_cc = opt_freeze_cc ? *opt_freeze_cc : -1;
+
+    // Controllers mapped to simulator parameters, sent on a second socket
+    _p_control = std::make_unique<ParameterControl>();
+    _p_control->parse_mappings(*config);
+    _p_control->set_latency(&control_latency);
+    auto opt_control_port = config->get_qualified_as<unsigned int>("control.port");
+    if (opt_control_port) {
+        auto opt_control_host = config->get_qualified_as<std::string>("control.host");
+        auto opt_control_socket = config->get_qualified_as<std::string>("control.socket");
+        auto opt_control_rate = config->get_qualified_as<double>("control.max_rate");
+        std::ostringstream control_addr;
+        control_addr << protocol << "://" << (opt_control_host ? *opt_control_host : host)
+                     << ":" << *opt_control_port;
+        int socket_type = ZMQ_PUB;
+        if (opt_control_socket && *opt_control_socket == "dealer") {
+            socket_type = ZMQ_DEALER;
+        } else if (opt_control_socket && *opt_control_socket != "pub") {
+            std::cout << "Unknown control socket type '" << *opt_control_socket
+                      << "', using pub." << std::endl;
+        }
+        if (opt_control_rate) {
+            _p_control->max_rate = *opt_control_rate;
+        }
+        _p_control->connect(*_p_context, socket_type, control_addr.str());
+        DBGMSG(std::cerr, "Sending " << _p_control->num_parameters()
+               << " parameters to: " << control_addr.str());
+    } else if (!_p_control->empty()) {
+        std::cout << "MIDI mappings need a [control] port to send parameters to."
+                  << std::endl;
+    }
+
+    // Pacing of the simulation, sent as rate limit on the control socket
+    auto opt_pacing = config->get_qualified_as<bool>("pacing.enabled");
+    auto opt_pacing_parameter = config->get_qualified_as<std::string>("pacing.parameter");
+    auto opt_pacing_target = config->get_qualified_as<double>("pacing.target");
+    auto opt_pacing_kp = config->get_qualified_as<double>("pacing.kp");
+    auto opt_pacing_ki = config->get_qualified_as<double>("pacing.ki");
+    pacing_parameter = opt_pacing_parameter ? *opt_pacing_parameter : "pacing.rate";
+    if (opt_pacing_target) {
+        pacing.target = *opt_pacing_target;
+    }
+    if (opt_pacing_kp) {
+        pacing.kp = *opt_pacing_kp;
+    }
+    if (opt_pacing_ki) {
+        pacing.ki = *opt_pacing_ki;
+    }
+    pacing.enabled = opt_pacing && *opt_pacing;
+
 	// =========================================================================
     // Create graphed variables
     DBGMSG(std::cerr, "Creating graphed variables...");
 
-    int window_width = ofGetWindowWidth();
-    int last_y_offset = 0.1 * ofGetWindowHeight();
+    // Plots are stacked in the viewport and can be scrolled
+    layout.set_viewport(plot_viewport(ofGetWindowWidth(), ofGetWindowHeight()));
 
-    auto var_descriptions = config->get_table_array("variable");
+    // Defaults for all variables, overridden by [defaults] and per group
+    variable_options_t var_defaults = DEFAULT_VARIABLE_OPTIONS;
 
-    for (const auto& descr : *var_descriptions)
-    {
-        // *descr is a cpptoml::table
-        auto p_varname = descr->get_as<std::string>("name");
-        auto p_varid = descr->get_as<uint32_t>("id");
+    // Number of samples retained per variable
+    auto opt_capacity = config->get_qualified_as<unsigned int>("buffer.samples");
+    if (opt_capacity) {
+        var_defaults.buffer_samples = *opt_capacity;
+    }
 
-        if (!(p_varname && p_varid)) {
-            std::cout << "Each variable description must contain at least "
-                      << "a name and identifier number." << std::endl;
-            continue;
+    // Keep older samples in compressed form (default for all variables)
+    auto opt_compress = config->get_qualified_as<bool>("buffer.compress_history");
+    auto opt_history = config->get_qualified_as<unsigned int>("buffer.history_samples");
+    if (opt_compress) {
+        var_defaults.compress_history = *opt_compress;
+    }
+    size_t history_samples = opt_history ? *opt_history : DEFAULT_HISTORY_SAMPLES;
+
+    // Expand single, range and pattern declarations
+    uint64_t t_parse_start = ofGetElapsedTimeMillis();
+    VariableConfig var_config(var_defaults);
+    var_config.parse(*config);
+
+    // Derived variables refer to received variables by name
+    std::unordered_map<std::string, unsigned int> received_ids;
+    for (const auto& spec : var_config.specs()) {
+        if (!spec.expr.empty()) {
+            received_ids.reserve(var_config.specs().size());
+            for (const auto& input : var_config.specs()) {
+                if (input.expr.empty()) {
+                    received_ids.emplace(input.name, input.id);
+                }
+            }
+            break;
+        }
+    }
+    std::vector<std::pair<unsigned int, std::unique_ptr<Expression>>> derived;
+
+    for (const auto& spec : var_config.specs())
+    {
+        std::unique_ptr<Expression> expression;
+        if (!spec.expr.empty()) {
+            expression = std::make_unique<Expression>();
+            if (!expression->compile(spec.expr)) {
+                std::cout << "Invalid expression '" << spec.expr << "' of variable '"
+                          << spec.name << "': " << expression->error() << std::endl;
+                continue;
+            }
+            if (expression->inputs().empty()) {
+                std::cout << "Expression of variable '" << spec.name
+                          << "' does not use any variable." << std::endl;
+                continue;
+            }
+            bool resolved = true;
+            for (const std::string& name : expression->inputs()) {
+                if (!received_ids.count(name)) {
+                    std::cout << "Expression of variable '" << spec.name << "' uses '"
+                              << name << "', which is not a received variable." << std::endl;
+                    resolved = false;
+                }
+            }
+            if (!resolved) {
+                continue;
+            }
         }
 
+        const variable_options_t& opts = *spec.options;
         auto variable = std::make_shared<GraphedVariable>(
-                                                          *p_varid, *p_varname);
+                                    spec.id, spec.name, opts.buffer_samples);
+        variable->v_lim_upper = opts.v_lim_upper;
+        variable->v_lim_lower = opts.v_lim_lower;
+        variable->y_per_v = opts.y_per_v;
+        variable->x_per_t = opts.x_per_t;
+        if (opts.autoscale) {
+            variable->enable_autoscale();
+        }
 
-        // Position of graphed variable on screen
-        variable->x_width_max = 0.8 * window_width;
-        variable->ax_origin = ofPoint(0.1 * window_width,
-                                      last_y_offset + variable->y_height_max());
+        // Compressed history tier for long-retention variables
+        if (opts.compress_history) {
+            variable->history = std::make_shared<CompressedHistory>(history_samples);
+            if (!_p_compressor) {
+                _p_compressor = std::make_unique<HistoryCompressor>();
+                _p_receiver->set_compressor(_p_compressor.get());
+            }
+        }
 
-        // Store in map<gid, variable>
-        variables[*p_varid] = variable;
+        add_graphed_var(variable);
+        _p_receiver->add_buffer(spec.id, variable->samples, variable->history);
+        if (opts.detect_spikes) {
+            _p_receiver->add_spike_detector(spec.id, opts.spike_threshold,
+                                            opts.spike_refractory);
+        }
+        if (expression) {
+            derived.emplace_back(spec.id, std::move(expression));
+        }
 
-        last_y_offset += variable->y_height_max();
-        DBGMSG(std::cerr, "Listening for var: " << *p_varname);
+        // Show on the morphology
+        if (!spec.segments.empty()) {
+            std::vector<uint32_t> points;
+            if (!morphology.find_points(spec.segments, points)) {
+                std::cout << "Some segments of variable '" << spec.name
+                          << "' are not in the morphology." << std::endl;
+            }
+            morphology_view.bind_variable(variable->samples, points);
+            for (uint32_t point : points) {
+                _segment_variable[point] = spec.id;
+            }
+        }
     }
 
+    // Computed from their inputs once all buffers exist
+    for (auto& entry : derived) {
+        std::vector<unsigned int> input_ids;
+        for (const std::string& name : entry.second->inputs()) {
+            input_ids.push_back(received_ids[name]);
+        }
+        _p_receiver->add_derived(entry.first, std::move(entry.second), input_ids);
+    }
+    DBGMSG(std::cerr, "Listening for " << var_config.specs().size()
+           << " variables (setup took "
+           << (ofGetElapsedTimeMillis() - t_parse_start) << " ms)");
+
+    // Scene of many cells sharing morphology templates
+    _setup_scene(*config);
+
+    // Optionally also listen for variables that are not in the config
+    auto opt_discover = config->get_qualified_as<bool>("discovery.enabled");
+    if (opt_discover && *opt_discover) {
+        auto opt_disc_samples = config->get_qualified_as<unsigned int>("discovery.samples");
+        auto opt_disc_max = config->get_qualified_as<unsigned int>("discovery.max_variables");
+        auto opt_disc_max_mb = config->get_qualified_as<unsigned int>("discovery.max_mb");
+        _p_receiver->enable_discovery(
+            opt_disc_samples ? *opt_disc_samples : DEFAULT_DISCOVERY_CAPACITY,
+            opt_disc_max ? *opt_disc_max : DEFAULT_DISCOVERY_MAX_VARS,
+            (size_t) (opt_disc_max_mb ? *opt_disc_max_mb : DEFAULT_DISCOVERY_MAX_MB) << 20);
+        DBGMSG(std::cerr, "Listening for unknown variables");
+    }
+
+    // Spike events for the raster view
+    auto opt_spike_capacity = config->get_qualified_as<unsigned int>("spikes.capacity");
+    auto opt_raster_x_per_t = config->get_qualified_as<double>("spikes.x_per_t");
+    for (auto& store : spikes) {
+        store = std::make_shared<SpikeStore>(
+            opt_spike_capacity ? *opt_spike_capacity : DEFAULT_SPIKE_CAPACITY);
+    }
+    if (opt_raster_x_per_t) {
+        raster.x_per_t = *opt_raster_x_per_t;
+    }
+    _p_receiver->set_spike_stores(spikes);
+    _p_receiver->set_latency(&control_latency);
+
+    // Particle bursts on the morphology for spikes
+    auto opt_particle_capacity = config->get_qualified_as<unsigned int>("particles.capacity");
+    auto opt_per_spike = config->get_qualified_as<unsigned int>("particles.per_spike");
+    auto opt_particle_lifetime = config->get_qualified_as<double>("particles.lifetime");
+    auto opt_particle_speed = config->get_qualified_as<double>("particles.speed");
+    auto opt_particle_gid = config->get_qualified_as<int64_t>("particles.gid");
+    if (opt_per_spike) {
+        spike_particles.per_spike = *opt_per_spike;
+    }
+    if (opt_particle_lifetime) {
+        spike_particles.lifetime = *opt_particle_lifetime;
+    }
+    if (opt_particle_speed) {
+        spike_particles.speed = *opt_particle_speed;
+    }
+    if (opt_particle_gid) {
+        spike_particles.gid = *opt_particle_gid;
+    }
+    spike_particles.setup(morphology, opt_particle_capacity ? *opt_particle_capacity
+                                                            : DEFAULT_PARTICLE_CAPACITY);
+
+    // Heatmap view
+    auto opt_heatmap_dt = config->get_qualified_as<double>("heatmap.dt");
+    auto opt_heatmap_columns = config->get_qualified_as<unsigned int>("heatmap.columns");
+    if (opt_heatmap_dt) {
+        heatmap.dt_bin = *opt_heatmap_dt;
+    }
+    if (opt_heatmap_columns) {
+        heatmap.num_columns = *opt_heatmap_columns;
+    }
+
+    // Spectrogram view
+    auto opt_spectrogram_variable = config->get_qualified_as<int64_t>("spectrogram.variable");
+    auto opt_spectrogram_dt = config->get_qualified_as<double>("spectrogram.dt");
+    auto opt_spectrogram_window = config->get_qualified_as<unsigned int>("spectrogram.window");
+    auto opt_spectrogram_hop = config->get_qualified_as<unsigned int>("spectrogram.hop");
+    auto opt_spectrogram_f_max = config->get_qualified_as<double>("spectrogram.f_max");
+    auto opt_spectrogram_db_range = config->get_qualified_as<double>("spectrogram.db_range");
+    auto opt_spectrogram_columns = config->get_qualified_as<unsigned int>("spectrogram.columns");
+    if (opt_spectrogram_variable) {
+        spectrogram_variable = *opt_spectrogram_variable;
+    }
+    if (opt_spectrogram_dt) {
+        if (*opt_spectrogram_dt > 0.0) {
+            spectrogram.dt = *opt_spectrogram_dt;
+        } else {
+            std::cout << "spectrogram.dt must be positive, using " << spectrogram.dt << std::endl;
+        }
+    }
+    if (opt_spectrogram_window) {
+        spectrogram.window = *opt_spectrogram_window;
+    }
+    if (opt_spectrogram_hop) {
+        spectrogram.hop = *opt_spectrogram_hop;
+    }
+    if (opt_spectrogram_f_max) {
+        spectrogram.f_max = *opt_spectrogram_f_max;
+    }
+    if (opt_spectrogram_db_range) {
+        spectrogram.db_range = *opt_spectrogram_db_range;
+    }
+    if (opt_spectrogram_columns) {
+        spectrogram.num_columns = *opt_spectrogram_columns;
+    }
+
+    // Statistics overlay and benchmark output
+    auto opt_show_stats = config->get_qualified_as<bool>("stats.overlay");
+    auto opt_benchmark_file = config->get_qualified_as<std::string>("stats.benchmark_file");
+    auto opt_spike_overlay = config->get_qualified_as<bool>("stats.spike_overlay");
+    auto opt_rate_window = config->get_qualified_as<double>("stats.rate_window");
+    show_stats = opt_show_stats && *opt_show_stats;
+    show_spike_stats = !opt_spike_overlay || *opt_spike_overlay;
+    if (opt_rate_window) {
+        spike_stats.rate_window = *opt_rate_window;
+    }
+    if (opt_benchmark_file) {
+        benchmark_file = *opt_benchmark_file;
+    }
+
+    // Start receiving samples on the ingest thread
+    if (_p_compressor) {
+        _p_compressor->startThread();
+    }
+    _p_receiver->startThread();
+
     DBGMSG(std::cerr, "ofApp setup done!");
 }
 
 
+/**
+ * Stop worker threads before the socket and buffers are destroyed.
+ */
+void ofApp::exit()
+{
+    midiIn.closePort();
+    midiIn.removeListener(this);
+    DBGMSG(std::cerr, "MIDI: " << midi_events.num_drained << " events, "
+           << midi_events.num_dropped << " dropped, latency mean "
+           << midi_events.latency_mean << " us, max "
+           << midi_events.latency_max << " us");
+
+    if (_p_receiver) {
+        _p_receiver->waitForThread(true);
+    }
+    if (_p_compressor) {
+        _p_compressor->waitForThread(true);
+        DBGMSG(std::cerr, "History: " << _p_compressor->num_dropped
+               << " blocks dropped (compressor behind)");
+    }
+    spectrogram.stop();
+    if (!benchmark_file.empty()) {
+        _write_benchmark(benchmark_file);
+    }
+}
+
+
 /**
  * Update application state.
  *
@@ -114,68 +492,115 @@ void ofApp::setup()
  */
 void ofApp::update()
 {
-    // TODO: receive points from socket and add them to graphed_var
-    //  - make sure data parsed correctly
-    //  - move to separate thread for continuous receive into buffer
-    auto& subscriber = *(this->_p_socket);
+    // Add variables that the ingest thread saw for the first time
+    _p_receiver->take_discovered(_discovered);
+    for (const auto& disc : _discovered) {
+        if (disc.buffer) {
+            auto variable = std::make_shared<GraphedVariable>(
+                                    disc.gid, disc.name, disc.buffer);
+            variable->auto_discovered = true;
+            add_graphed_var(variable);
+            DBGMSG(std::cerr, "Discovered var: " << disc.name);
+        } else if (variables.count(disc.gid) > 0) {
+            variables[disc.gid]->name = disc.name;
+        }
+    }
+    _discovered.clear();
+
+    // New plot positions and widths, once per frame however many
+    // resize events arrived
+    if (_resize_pending) {
+        layout.set_viewport(plot_viewport(ofGetWindowWidth(), ofGetWindowHeight()));
+        _invalidate_windows();
+        _resize_pending = false;
+    }
 
-    //  receive raw data
-    zmq::message_t update;
-    subscriber.recv(&update);
+    // MIDI events since the last update, in order of arrival
+    _midi_drained.clear();
+    midi_events.drain(_midi_drained);
+    for (const midi_event_t& event : _midi_drained) {
+        bool freeze_pressed =
+            (event.status == MIDI_NOTE_ON && event.number == midi_freeze_note
+             && event.value > 0) ||
+            (event.status == MIDI_CONTROL_CHANGE && event.number == midi_freeze_cc
+             && event.value >= 64);
+        if (freeze_pressed) {
+            _toggle_freeze();
+            continue;
+        }
+        _p_control->handle(event);
+    }
+    if (pacing.update(_p_receiver->t_newest.load(std::memory_order_relaxed),
+                      ofGetElapsedTimeMillis())) {
+        _p_control->set_parameter(pacing_parameter, pacing.command());
+    }
+    _p_control->flush(ofGetElapsedTimeMillis());
+    control_latency.update(ofGetElapsedTimeMicros());
+
+    raster.update(spikes);
+    spike_stats.update(spikes);
+    if (view_mode == VIEW_MORPHOLOGY) {
+        morphology_view.update(camera, ofGetCurrentViewport());
+        morphology_view.update_values();
+        spike_particles.update(spikes, ofGetLastFrameTime() * 1000.0);
+    } else {
+        spike_particles.skip(spikes);
+    }
+    if (view_mode == VIEW_SCENE) {
+        scene.update_values();
+    }
+    if (view_mode == VIEW_HEATMAP) {
+        heatmap.update(layout.variables());
+    }
 
-    // Parse data into workable types
-    // See NEURON-sockets/ZmqOutputVars.mod: we got sequence of triples
-    // (float, float, float) all concatenated into arbitrary size message.
-    size_t sample_size = sizeof(sample_t);
-    size_t msg_size = update.size();
-    void* data_addr = update.data();
-    sample_t* sample;
+    // Samples are received on the ingest thread (see SampleReceiver).
+    // Here we only look at a snapshot of the samples of visible variables.
+    layout.update_visible();
+    for (GraphedVariable* variable : layout.visible())
+    {
+        auto view = variable->samples->snapshot();
+        if (view.empty()) {
+            continue;
+        }
 
-    DBGMSG(std::cerr, "Received message of size " << msg_size);
+        // Find oldest sample still inside plotting range.
+        // I.e. first sample where (t_newest - t) * x_per_t <= x_width
+        float t_newest = view.back().t;
+        float t_window = variable->x_width_max / variable->x_per_t;
 
-    size_t bytes_processed = 0;
-    unsigned int i_msg = 0;
-    bool debug_var_encountered = false;
+        // Frozen: the window stays put, ingest carries on regardless
+        if (playhead.frozen) {
+            variable->t_lim_lower = playhead.t_end - t_window;
+            continue;
+        }
 
-    while (bytes_processed < msg_size) {
-        // memcpy(&sample, data_addr + (i_msg * sample_size), sample_size);
-        sample = (sample_t*) data_addr + (i_msg * sample_size);
-        i_msg++;
-        bytes_processed += sample_size;
+        uint64_t seq_first = lower_bound_time(view, t_newest - t_window);
+        float t_oldest = view[seq_first].t;
 
-        // Look up the variable in map by identifier and append sample
-        auto gid = (unsigned int) sample->gid;
-        if (this->variables.count(gid) > 0) {
-            this->variables[gid]->samples->push_back(ofPoint(sample->t, sample->v));
+        // Samples that were overwritten while reading are forgotten anyway
+        uint64_t seq_intact = view.validate();
+        if (seq_intact == view.seq_end()) {
+            continue;
         }
-
-        // One debug statement per message received
-        if (sample->gid == 1.0 && !debug_var_encountered) {
-            DBGMSG(std::cerr, "Received (gid, t, v): "
-                   << sample->gid << ", "
-                   << sample->t << ", "
-                   << sample->v << std::endl);
-            debug_var_encountered = true;
+        if (seq_first < seq_intact) {
+            seq_first = seq_intact;
+            t_oldest = view[seq_first].t;
         }
-    }
-
-    // Forget all samples that are outside of plotting range.
-    // I.e. samples where (t_newest - t) * x_per_t > x_width
-    for (auto const& id_and_var: variables)
-    {
-        auto variable = id_and_var.second;
-        float t_newest = variable->samples->back().x;
-        float t_oldest = variable->samples->front().x;
-        while (true) {
-            if ((t_newest - t_oldest) * variable->x_per_t > variable->x_width_max) {
-                variable->samples->pop_front(); // forget point
-                t_oldest = variable->samples->front().x; // get new oldest point
-                variable->t_lim_lower = t_oldest;
-            } else {
-                break;
+        if (seq_first != variable->seq_first_visible) {
+            variable->seq_first_visible = seq_first;
+            variable->t_lim_lower = t_oldest;
+
+            // Zoomed out past the ring buffer: the rest is history
+            if (seq_first == view.seq_begin() && variable->history
+                && variable->history->num_samples() > 0) {
+                variable->t_lim_lower = std::min(t_oldest, t_newest - t_window);
             }
         }
 
+        if (variable->autoscaler) {
+            _autoscale(*variable, view, seq_first);
+        }
+
         // Calculate arrival rate of samples
         uint64_t t_elapsed = ofGetElapsedTimeMillis();
         float dt_var_update = (float) t_elapsed - variable->tsys_last_update;
@@ -193,15 +618,85 @@ void ofApp::update()
  * Draw to the screen (called after update()).
  */
 void ofApp::draw()
+{
+    _draw_view();
+    if (show_stats) {
+        _draw_stats();
+    }
+
+    // Control commands whose effect is on screen from this frame on
+    control_latency.frame_drawn(ofGetElapsedTimeMicros());
+    frame_times.add(ofGetLastFrameTime() * 1e6);
+}
+
+
+/**
+ * Draw the current view mode.
+ */
+void ofApp::_draw_view()
 {
     //TODO: match scroll speed to rate that new samples arrive
     // - with current t_lim_lower update by pop() => jittery scrolling
     // - instead: set constant scroll speed and match it to rate of arriving samples
 
-    // Draw all our graphed lines
-    for (auto const& id_and_var: variables)
+    if (pacing.enabled) {
+        ofDrawBitmapString("Pacing [sim ms/s]: target " + ofToString(pacing.target, 1)
+                           + ", measured " + ofToString(pacing.measured(), 1)
+                           + ", rate limit " + ofToString(pacing.command(), 1), 20, 40);
+    }
+
+    if (playhead.frozen && (view_mode == VIEW_TRACES || view_mode == VIEW_RASTER)) {
+        ofDrawBitmapString("Frozen at t = " + ofToString(playhead.t_end, 1) + " ms (live "
+                           + ofToString(_p_receiver->t_newest.load(std::memory_order_relaxed), 1)
+                           + " ms), left/right: rewind, f: back to live", 20, 60);
+    }
+
+    if (view_mode == VIEW_RASTER) {
+        raster.draw(spikes, layout.viewport(), playhead);
+        return;
+    }
+    if (view_mode == VIEW_HEATMAP) {
+        heatmap.draw(layout.viewport());
+        return;
+    }
+    if (view_mode == VIEW_SPECTROGRAM) {
+        spectrogram.draw(layout.viewport());
+        return;
+    }
+    if (view_mode == VIEW_MORPHOLOGY) {
+        ofEnableDepthTest();
+        camera.begin();
+        morphology_view.draw();
+        spike_particles.draw();
+        camera.end();
+        ofDisableDepthTest();
+        ofDrawBitmapString(morphology_selection, 20, 20);
+        return;
+    }
+    if (view_mode == VIEW_SCENE) {
+        ofEnableDepthTest();
+        camera.begin();
+        scene.draw();
+        camera.end();
+        ofDisableDepthTest();
+        return;
+    }
+
+    // Draw the graphed lines of all visible variables
+    for (GraphedVariable* var : layout.visible())
     {
-        auto var = id_and_var.second;
+        if (!var->trace) {
+            var->trace = std::make_unique<ofPolyline>();
+        }
+        if (playhead.frozen) {
+            if (_decimate(*var)) {
+                _build_decimated_trace(*var, playhead.t_end);
+            } else {
+                _build_frozen_trace(*var);
+            }
+            var->trace->draw();
+            continue;
+        }
 
         // Scroll speed must track update speed (arrival rate) but as low-pass filter
         float draw_time = ofGetLastFrameTime() * 1e-3; // [ms] time elapsed since last frame drawn
@@ -212,29 +707,530 @@ void ofApp::draw()
         // [sys_time] * [sim_time / sys_time] * [pixels / sim_time]
         var->t_lim_lower += draw_time * var->scroll_speed * var->x_per_t;
 
-        // Draw all the line segments of remaining points
-        const ofPoint& last_pt = var->samples->front();
-        ofPoint last_xy;
-        sample_to_screen(*var, last_pt, last_xy);
+        // Zoomed out: min/max per pixel column instead of every sample
+        if (_decimate(*var)) {
+            _build_decimated_trace(*var, var->t_lim_lower + var->x_width_max / var->x_per_t);
+            var->trace->draw();
+            continue;
+        }
+
+        // Build the line through all samples in plotting range.
+        // The ingest thread keeps appending while we read, so we work
+        // on a snapshot and discard anything it overwrote meanwhile.
+        auto view = var->samples->snapshot();
+        view.advance_begin(var->seq_first_visible);
+
+        ofPolyline& trace = *var->trace;
 
-        auto it = ++var->samples->begin(); // second point
-        while (it != var->samples->end())
+        trace.clear();
+        ofPoint xy;
+        for (uint64_t seq = view.seq_begin(); seq < view.seq_end(); ++seq)
         {
             // Map sample point to screen position based on axes origin
-            auto sample = *it;
-            ofPoint next_xy;
-            sample_to_screen(*var, sample, next_xy);
-            ofDrawLine(last_xy, next_xy);
-            last_xy = next_xy;
+            trace_point_t sample = view[seq];
+            sample_to_screen(*var, ofPoint(sample.t, sample.v), xy);
+            trace.addVertex(xy);
+        }
+
+        uint64_t seq_intact = view.validate();
+        if (seq_intact > view.seq_begin()) {
+            auto& vertices = trace.getVertices();
+            vertices.erase(vertices.begin(),
+                           vertices.begin() + (seq_intact - view.seq_begin()));
+        }
+
+        trace.draw();
+    }
+
+    // Rates and ISIs right of the plots of variables that spike
+    if (show_spike_stats && spike_stats.size() > 0) {
+        float t_now = _p_receiver->t_newest.load(std::memory_order_relaxed);
+        for (GraphedVariable* var : layout.visible()) {
+            const spike_stats_t* stats = spike_stats.find(var->id);
+            if (stats) {
+                spike_stats.draw(*stats, t_now, layout.viewport().getRight() + 20,
+                                 var->ax_origin.y - var->y_height_max());
+            }
+        }
+    }
+
+    layout.draw_scrollbar();
+}
+
+
+/**
+ * Rebuild the trace of a variable for the frozen window ending at the
+ * playhead (t_lim_lower is set by update()).
+ *
+ * Samples still in the ring buffer are read in place from a snapshot,
+ * like the live trace. Only the part of the window that the ring buffer
+ * no longer holds is read from the compressed history, if the variable
+ * retains one; older samples are gone and leave the window empty.
+ */
+void ofApp::_build_frozen_trace(GraphedVariable& var)
+{
+    float t_begin = var.t_lim_lower;
+    float t_end = playhead.t_end;
+    ofPolyline& trace = *var.trace;
+    trace.clear();
+    ofPoint xy;
+
+    // Oldest sample of the ring (may be overwritten meanwhile, then the
+    // ring starts later and we read somewhat more history than needed)
+    auto view = var.samples->snapshot();
+    float t_ring_oldest = view.empty() ? t_end : view[view.seq_begin()].t;
+
+    // Part of the window before the ring buffer
+    float t_history_last = -std::numeric_limits<float>::max();
+    if (var.history && t_begin < t_ring_oldest) {
+        _history_points.clear();
+        var.history->read(t_begin, std::min(t_end, t_ring_oldest), _history_points);
+        for (const trace_point_t& sample : _history_points) {
+            sample_to_screen(var, ofPoint(sample.t, sample.v), xy);
+            trace.addVertex(xy);
+        }
+        if (!_history_points.empty()) {
+            t_history_last = _history_points.back().t;
+        }
+    }
+    size_t num_history = trace.size();
+
+    // Rest of the window from the ring, continuing after the history
+    uint64_t seq_first = (t_history_last > t_begin) ?
+                         lower_bound_time(view, std::nextafter(t_history_last, t_end)) :
+                         lower_bound_time(view, t_begin);
+    view.advance_begin(seq_first);
+    for (uint64_t seq = view.seq_begin(); seq < view.seq_end(); ++seq)
+    {
+        trace_point_t sample = view[seq];
+        if (sample.t > t_end) {
+            break;
+        }
+        sample_to_screen(var, ofPoint(sample.t, sample.v), xy);
+        trace.addVertex(xy);
+    }
+
+    uint64_t seq_intact = view.validate();
+    if (seq_intact > view.seq_begin()) {
+        auto& vertices = trace.getVertices();
+        size_t num_lost = std::min<uint64_t>(seq_intact - view.seq_begin(),
+                                             vertices.size() - num_history);
+        vertices.erase(vertices.begin() + num_history,
+                       vertices.begin() + num_history + num_lost);
+    }
+}
+
+
+/**
+ * Whether the plotting range of a variable has more than two samples
+ * per pixel column, judging by the sample spacing in its ring buffer.
+ */
+bool ofApp::_decimate(const GraphedVariable& var) const
+{
+    auto view = var.samples->snapshot();
+    if (view.size() < 2) {
+        return false;
+    }
+    float dt_sample = (view.back().t - view.front().t) / (view.size() - 1);
+    return dt_sample * var.x_per_t < 0.5;
+}
+
+
+/**
+ * Rebuild the trace of a variable from the min/max of the samples in
+ * each pixel column of the window from t_lim_lower to t_end.
+ *
+ * The columns come from the variable's DecimationCache, so only the
+ * newest column is computed from samples every frame while scrolling,
+ * and zooming back to a recent level or panning scans nothing again.
+ */
+void ofApp::_build_decimated_trace(GraphedVariable& var, float t_end)
+{
+    if (!var.decimation) {
+        var.decimation = std::make_unique<DecimationCache>();
+    }
+
+    // Column width of about one pixel, quantized to quarter octaves so
+    // that returning to a zoom level finds the same cached columns
+    float dt = std::exp2(std::round(4.0f * std::log2(1.0f / var.x_per_t)) / 4.0f);
+    int64_t k_begin = var.decimation->query(*var.samples, var.history.get(), dt,
+                                            var.t_lim_lower, t_end, _buckets);
+
+    ofPolyline& trace = *var.trace;
+    trace.clear();
+    ofPoint xy;
+    for (size_t i = 0; i < _buckets.size(); i++) {
+        const minmax_bucket_t& bucket = _buckets[i];
+        if (bucket.count == 0) {
+            continue;
+        }
+        float t = (k_begin + i + 0.5) * dt;
+        sample_to_screen(var, ofPoint(t, bucket.v_min), xy);
+        trace.addVertex(xy);
+        sample_to_screen(var, ofPoint(t, bucket.v_max), xy);
+        trace.addVertex(xy);
+    }
+}
+
+
+/**
+ * Zoom the time axis of all plots by factor (> 1: zoom in). Live, the
+ * newest sample stays at the right edge; frozen, the time at screen
+ * coordinate x stays in place.
+ */
+void ofApp::_zoom_time(float factor, float x)
+{
+    if (layout.visible().empty()) {
+        return;
+    }
+    float x_per_t = layout.visible().front()->x_per_t;
+    if (x_per_t * factor < X_PER_T_MIN || x_per_t * factor > X_PER_T_MAX) {
+        return;
+    }
+    if (playhead.frozen) {
+        float dx_right = layout.viewport().getRight() - x;
+        float t_at_x = playhead.t_end - dx_right / x_per_t;
+        playhead.t_end = t_at_x + dx_right / (x_per_t * factor);
+    }
+
+    for (auto& entry : variables) {
+        entry.second->x_per_t *= factor;
+    }
+    _invalidate_windows();
+}
+
+
+/**
+ * Zoom the value axis of one plot by factor (> 1: zoom in), keeping the
+ * value at screen coordinate y in place and the plot height unchanged.
+ * The limits are set by hand from now on, not autoscaled.
+ */
+void ofApp::_zoom_value(GraphedVariable& var, float factor, float y)
+{
+    float height = (var.v_lim_upper - var.v_lim_lower) * var.y_per_v;
+    float v_at_y = var.v_lim_lower + (var.ax_origin.y - y) / var.y_per_v;
+    var.v_lim_lower = v_at_y - (v_at_y - var.v_lim_lower) / factor;
+    var.v_lim_upper = v_at_y + (var.v_lim_upper - v_at_y) / factor;
+    var.y_per_v = height / (var.v_lim_upper - var.v_lim_lower);
+    var.autoscaler.reset();
+}
+
+
+/**
+ * Freeze the scrolling views at the newest sample, or go back to live.
+ * Only the display stops: samples keep arriving in the meantime.
+ */
+void ofApp::_toggle_freeze()
+{
+    playhead.toggle(_p_receiver->t_newest.load(std::memory_order_relaxed));
+    if (!playhead.frozen) {
+        _invalidate_windows(); // snap back to live
+    }
+}
+
+
+/**
+ * Show the spectrogram of the configured variable (or of the first one
+ * shown), or go back to the traces. Its worker only runs while shown.
+ */
+void ofApp::_toggle_spectrogram()
+{
+    if (view_mode == VIEW_SPECTROGRAM) {
+        spectrogram.stop();
+        view_mode = VIEW_TRACES;
+        return;
+    }
 
-            ++it;
+    std::shared_ptr<GraphedVariable> var;
+    if (spectrogram_variable >= 0) {
+        auto it = variables.find(spectrogram_variable);
+        if (it != variables.end()) {
+            var = it->second;
         }
+    } else if (!layout.variables().empty()) {
+        var = layout.variables().front();
+    }
+    if (!var) {
+        std::cout << "spectrogram: variable " << spectrogram_variable << " not found" << std::endl;
+        return;
+    }
+    spectrogram.start(var->samples, var->name);
+    view_mode = VIEW_SPECTROGRAM;
+}
+
+
+/**
+ * Make update() find the plotting range of every variable again, after
+ * the time window changed in some other way than by scrolling.
+ */
+void ofApp::_invalidate_windows()
+{
+    for (auto& entry : variables) {
+        entry.second->seq_first_visible = std::numeric_limits<uint64_t>::max();
     }
 }
 
+
+/**
+ * Move the frozen window by a fraction of its width (negative: back
+ * in time), within the samples still retained for the current view.
+ */
+void ofApp::_scrub(float fraction)
+{
+    float t_live = _p_receiver->t_newest.load(std::memory_order_relaxed);
+    float t_oldest = std::numeric_limits<float>::max();
+    float t_window = 0.0;
+    if (view_mode == VIEW_RASTER) {
+        t_window = layout.viewport().width / raster.x_per_t;
+        for (const auto& store : spikes) {
+            auto view = store->snapshot();
+            if (!view.empty()) {
+                t_oldest = std::min(t_oldest, view[view.seq_begin()].t);
+            }
+        }
+    } else {
+        for (GraphedVariable* var : layout.visible()) {
+            t_window = std::max(t_window, var->x_width_max / var->x_per_t);
+            auto view = var->samples->snapshot();
+            if (!view.empty()) {
+                t_oldest = std::min(t_oldest, view[view.seq_begin()].t);
+            }
+            if (var->history && var->history->num_samples() > 0) {
+                t_oldest = std::min(t_oldest, var->history->t_oldest());
+            }
+        }
+    }
+    if (t_oldest <= t_live) {
+        playhead.scrub(fraction * t_window, t_oldest, t_live);
+    }
+}
+
+
+/**
+ * Resolve a path from the config file: relative paths are relative
+ * to the directory of the config file.
+ */
+std::string ofApp::_config_relative(const std::string& path) const
+{
+    size_t dir_end = config_file.rfind('/');
+    if (path.empty() || path[0] == '/' || dir_end == std::string::npos) {
+        return path;
+    }
+    return config_file.substr(0, dir_end + 1) + path;
+}
+
+
+/**
+ * Point the 3D camera at a bounding sphere.
+ */
+void ofApp::_look_at(const glm::vec3& center, float extent)
+{
+    camera.setTarget(center);
+    camera.setDistance(std::max(3.0f * extent, 100.0f));
+    camera.setNearClip(0.1);
+    camera.setFarClip(100.0f * std::max(extent, 100.0f));
+}
+
+
+/**
+ * Switch pacing on or off. Without pacing the simulator is sent a rate
+ * limit of 0, which means no limit.
+ */
+void ofApp::_set_pacing(bool enabled)
+{
+    pacing.enabled = enabled;
+    pacing.reset();
+    if (!enabled) {
+        _p_control->set_parameter(pacing_parameter, 0.0);
+    }
+}
+
+
+/**
+ * Load the morphology templates and place the cells of the scene:
+ *
+ *     [[scene.template]]
+ *     name = "pyramidal"
+ *     file = "pyramidal.swc"
+ *
+ *     [[scene.cell]]
+ *     template = "pyramidal"
+ *     variable = 1                  # id of the variable coloring the cell
+ *     position = [0.0, 0.0, 0.0]
+ *     rotation = [0.0, 90.0, 0.0]   # degrees about x, y, z
+ *     scale = 1.0
+ *
+ * Templates with the same file are loaded once.
+ */
+void ofApp::_setup_scene(const cpptoml::table& config)
+{
+    auto templates = config.get_table_array_qualified("scene.template");
+    auto cells = config.get_table_array_qualified("scene.cell");
+    if (!templates || !cells) {
+        return;
+    }
+    uint64_t t_load_start = ofGetElapsedTimeMillis();
+
+    std::map<std::string, size_t> template_index; // by name
+    std::map<std::string, size_t> file_index;     // by resolved path
+    for (const auto& descr : *templates) {
+        auto p_name = descr->get_as<std::string>("name");
+        auto p_file = descr->get_as<std::string>("file");
+        if (!(p_name && p_file)) {
+            std::cout << "Each scene template must have a name and a file." << std::endl;
+            continue;
+        }
+        std::string path = _config_relative(*p_file);
+        if (file_index.count(path) == 0) {
+            Morphology template_morphology;
+            if (!template_morphology.load(path)) {
+                continue;
+            }
+            file_index[path] = scene.add_template(template_morphology);
+        }
+        template_index[*p_name] = file_index[path];
+    }
+
+    for (const auto& descr : *cells) {
+        auto p_template = descr->get_as<std::string>("template");
+        if (!p_template || template_index.count(*p_template) == 0) {
+            std::cout << "Scene cell with unknown template '"
+                      << (p_template ? *p_template : "") << "'." << std::endl;
+            continue;
+        }
+        glm::vec3 position(0.0);
+        glm::vec3 rotation(0.0);
+        if (!(get_vec3(*descr, "position", position)
+              && get_vec3(*descr, "rotation", rotation))) {
+            std::cout << "Scene cell position and rotation must be "
+                      << "arrays of three numbers." << std::endl;
+            continue;
+        }
+        auto p_scale = descr->get_as<double>("scale");
+
+        std::shared_ptr<SampleBuffer> samples;
+        auto p_variable = descr->get_as<unsigned int>("variable");
+        if (p_variable && variables.count(*p_variable) > 0) {
+            samples = variables[*p_variable]->samples;
+        } else if (p_variable) {
+            std::cout << "Scene cell colored by undeclared variable "
+                      << *p_variable << "." << std::endl;
+        }
+        scene.add_cell(template_index[*p_template], position, rotation,
+                       p_scale ? *p_scale : 1.0, samples);
+    }
+    scene.v_lim_upper = morphology_view.v_lim_upper;
+    scene.v_lim_lower = morphology_view.v_lim_lower;
+
+    DBGMSG(std::cerr, "Scene of " << scene.num_cells() << " cells from "
+           << scene.num_templates() << " templates ("
+           << (ofGetElapsedTimeMillis() - t_load_start) << " ms)");
+}
+
+
+/**
+ * Overlay with throughput, frame times and latencies (toggled with 's').
+ */
+void ofApp::_draw_stats()
+{
+    std::vector<std::string> lines = {
+        "fps " + ofToString(ofGetFrameRate(), 1) + ", frame time " + frame_times.summary(),
+        "received: " + ofToString(_p_receiver->messages_received.load()) + " messages, "
+            + ofToString(_p_receiver->samples_received.load()) + " samples, "
+            + ofToString(_p_receiver->spikes_received.load()) + " spikes, "
+            + ofToString(_p_receiver->spikes_detected.load()) + " detected",
+        "spike statistics: " + ofToString(spike_stats.size()) + " gids, "
+            + ofToString(spike_stats.num_lost) + " spikes missed",
+        "MIDI queue: " + ofToString(midi_events.num_drained) + " events, "
+            + ofToString(midi_events.num_dropped.load()) + " dropped, latency mean "
+            + ofToString(midi_events.latency_mean * 1e-3, 3) + " ms",
+        "Control latency",
+        "  MIDI -> send:      " + control_latency.midi_to_send.summary(),
+        "  send -> applied:   " + control_latency.send_to_apply.summary(),
+        "  applied -> sample: " + control_latency.apply_to_sample.summary(),
+        "  sample -> drawn:   " + control_latency.sample_to_draw.summary(),
+        "  end to end:        " + control_latency.end_to_end.summary(),
+    };
+
+    float x = ofGetWidth() - 540;
+    float y = 20;
+    for (const std::string& line : lines) {
+        ofDrawBitmapStringHighlight(line, x, y);
+        y += 16;
+    }
+}
+
+
+/**
+ * Write counters and latency histograms as JSON, for comparing runs.
+ */
+void ofApp::_write_benchmark(const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out) {
+        std::cout << "Can not write benchmark file '" << path << "'." << std::endl;
+        return;
+    }
+    out << "{\n  \"messages_received\": " << _p_receiver->messages_received
+        << ",\n  \"samples_received\": " << _p_receiver->samples_received
+        << ",\n  \"spikes_received\": " << _p_receiver->spikes_received
+        << ",\n  \"spikes_detected\": " << _p_receiver->spikes_detected
+        << ",\n  \"midi_events\": " << midi_events.num_drained
+        << ",\n  \"midi_dropped\": " << midi_events.num_dropped
+        << ",\n  \"midi_queue_latency_mean_us\": " << midi_events.latency_mean
+        << ",\n  \"midi_queue_latency_max_us\": " << midi_events.latency_max
+        << ",\n  \"control_messages_sent\": " << _p_control->num_messages_sent
+        << ",\n  \"frame_time\": ";
+    frame_times.write_json(out);
+    out << ",\n  \"control_latency\": ";
+    control_latency.write_json(out);
+    out << ",\n  \"spike_statistics\": ";
+    spike_stats.write_json(out, _p_receiver->t_newest.load(std::memory_order_relaxed));
+    out << "\n}\n";
+    DBGMSG(std::cerr, "Wrote benchmark to " << path);
+}
+
+
+/**
+ * Follow the plotting range [seq_first, end of view) of an autoscaled
+ * variable. Only samples that arrived since the last frame are looked
+ * at; the window min/max are kept incrementally (see SlidingMinMax).
+ */
+void ofApp::_autoscale(GraphedVariable& var, const SampleBuffer::View& view,
+                       uint64_t seq_first)
+{
+    AxisAutoscaler& autoscaler = *var.autoscaler;
+    autoscaler.set_window(seq_first);
+    for (uint64_t seq = autoscaler.seq_next(); seq < view.seq_end(); ++seq) {
+        autoscaler.add(seq, view[seq].v);
+    }
+
+    // Values read before seq_intact may have been overwritten meanwhile;
+    // they are before the window start and leave it with the next call.
+    float dt = ofGetLastFrameTime() * 1000.0; // [ms]
+    if (autoscaler.update(dt, var.v_lim_lower, var.v_lim_upper)) {
+        var.y_per_v = var.y_height / (var.v_lim_upper - var.v_lim_lower);
+    }
+}
+
+
+/**
+ * Add a new graphed variable below all existing ones and
+ * start tracking it.
+ */
+void ofApp::add_graphed_var(std::shared_ptr<GraphedVariable> variable)
+{
+    layout.add(variable);
+
+    // Store in map<gid, variable>
+    variables[variable->id] = variable;
+}
+
+
 /**
  * Transform sample point (t, v) to screen coordinates based on
  * drawing-related properties of GraphedVariable.
+ * The axes origin is the bottom left corner of the plot.
  *
  * @param   var
  *          GraphedVariable to which the sample point belongs
@@ -248,7 +1244,7 @@ void ofApp::sample_to_screen(const GraphedVariable &var,
 {
     float x = var.ax_origin.x + (sample.x - var.t_lim_lower) * var.x_per_t;
     float v_to_y = (sample.y - var.v_lim_lower) * var.y_per_v;
-    float y = var.ax_origin.y + v_to_y;
+    float y = var.ax_origin.y - v_to_y; // screen y points down
     point.set(x, y);
 }
 
@@ -277,6 +1273,11 @@ int ofApp::_setup_socket(string protocol, string host, unsigned int port) {
     // However, an empty filter value with length argument zero subscribes to all messages
     subscriber.setsockopt(ZMQ_SUBSCRIBE, NULL, 0);
 
+    // Receive with timeout so the ingest thread can be stopped
+    int recv_timeout_ms = 100;
+    subscriber.setsockopt(ZMQ_RCVTIMEO, &recv_timeout_ms, sizeof(recv_timeout_ms));
+    this->_p_receiver = std::make_unique<SampleReceiver>(subscriber);
+
     DBGMSG(std::cerr, "Listening for samples on: " << addr << std::endl);
     return 0;
 }
@@ -292,19 +1293,13 @@ int ofApp::_setup_socket(string protocol, string host, unsigned int port) {
 
 /**
  * Handle MIDI messages (required by ofxMidiListener interface).
+ * Called on the MIDI input thread.
  *
- * @effect  Save the midi message in member variable 'midiMessage'
- *          for later use.
+ * @effect  Queue the message for the next update()
  */
-void ofApp::newMidiMessage(ofxMidiMessage& msg) {
-
-	// make a copy of the latest message
-	midiMessage = msg;
-
-    // TODO: see all attributes of a MIDI message in
-    // https://github.com/danomatika/ofxMidi/blob/master/midiInputExample/src/ofApp.cpp
-    // and decide which attributes to use for storing control info
-    // based on which are easy to manipulate using MIDI controller.
+void ofApp::newMidiMessage(ofxMidiMessage& msg)
+{
+    midi_events.push(msg);
 }
 
 //==============================================================================
@@ -312,6 +1307,83 @@ void ofApp::newMidiMessage(ofxMidiMessage& msg) {
 
 void ofApp::keyPressed(int key)
 {
+    // Scroll through the stack of plots
+    switch (key) {
+        case OF_KEY_UP:        layout.scroll_by(-20); break;
+        case OF_KEY_DOWN:      layout.scroll_by(20); break;
+        case OF_KEY_PAGE_UP:   layout.scroll_by(-layout.viewport().height); break;
+        case OF_KEY_PAGE_DOWN: layout.scroll_by(layout.viewport().height); break;
+        case OF_KEY_HOME:      layout.scroll_to(0); break;
+        case OF_KEY_END:       layout.scroll_to(layout.content_height()); break;
+        case OF_KEY_LEFT:      _scrub(-0.25); break;
+        case OF_KEY_RIGHT:     _scrub(0.25); break;
+        case 'f':
+        case ' ':
+            _toggle_freeze();
+            break;
+        case 'r':
+            view_mode = (view_mode == VIEW_RASTER) ? VIEW_TRACES : VIEW_RASTER;
+            break;
+        case 'h':
+            view_mode = (view_mode == VIEW_HEATMAP) ? VIEW_TRACES : VIEW_HEATMAP;
+            heatmap.reset();
+            break;
+        case 'g':
+            _toggle_spectrogram();
+            break;
+        case 'm':
+            if (!morphology_view.empty()) {
+                view_mode = (view_mode == VIEW_MORPHOLOGY) ? VIEW_TRACES : VIEW_MORPHOLOGY;
+                if (_camera_view != VIEW_MORPHOLOGY) {
+                    _look_at(morphology_view.center(), morphology_view.extent());
+                    _camera_view = VIEW_MORPHOLOGY;
+                }
+            }
+            break;
+        case 'p':
+            _set_pacing(!pacing.enabled);
+            break;
+        case 's':
+            show_stats = !show_stats;
+            break;
+        case 'i':
+            show_spike_stats = !show_spike_stats;
+            break;
+        case '+':
+        case '=':
+            // Only while pacing is on, when the target is shown
+            if (pacing.enabled) {
+                pacing.target *= 2.0;
+            }
+            break;
+        case '-':
+            if (pacing.enabled) {
+                pacing.target /= 2.0;
+            }
+            break;
+        case 'n':
+            if (!scene.empty()) {
+                view_mode = (view_mode == VIEW_SCENE) ? VIEW_TRACES : VIEW_SCENE;
+                if (_camera_view != VIEW_SCENE) {
+                    _look_at(scene.center(), scene.extent());
+                    _camera_view = VIEW_SCENE;
+                }
+            }
+            break;
+        default: break;
+    }
+
+    // Switched from the spectrogram to another view
+    if (view_mode != VIEW_SPECTROGRAM && spectrogram.isThreadRunning()) {
+        spectrogram.stop();
+    }
+
+    // Rotate/zoom the camera with the mouse only in 3D views
+    if (view_mode == VIEW_MORPHOLOGY || view_mode == VIEW_SCENE) {
+        camera.enableMouseInput();
+    } else {
+        camera.disableMouseInput();
+    }
 }
 
 //--------------------------------------------------------------
@@ -327,16 +1399,98 @@ void ofApp::mouseMoved(int x, int y)
 //--------------------------------------------------------------
 void ofApp::mouseDragged(int x, int y, int button)
 {
+    if (view_mode != VIEW_TRACES || button != OF_MOUSE_BUTTON_LEFT) {
+        return;
+    }
+    // Lock to the dominant direction once the mouse moved further than
+    // a click, so that jitter of a vertical drag does not freeze the traces
+    if (_drag_axis == DRAG_UNDECIDED) {
+        float dx_total = std::abs(x - _mouse_pressed_at.x);
+        float dy_total = std::abs(y - _mouse_pressed_at.y);
+        if (dx_total < CLICK_DISTANCE && dy_total < CLICK_DISTANCE) {
+            return;
+        }
+        _drag_axis = (dx_total >= dy_total) ? DRAG_TIME : DRAG_VALUE;
+    }
+    float dx = (_drag_axis == DRAG_TIME) ? x - _mouse_dragged_at.x : 0.0;
+    float dy = (_drag_axis == DRAG_VALUE) ? y - _mouse_dragged_at.y : 0.0;
+    _mouse_dragged_at = ofPoint(x, y);
+
+    // Pan in time: the traces stop following the newest samples
+    if (dx != 0.0) {
+        if (!playhead.frozen) {
+            _toggle_freeze();
+        }
+        _scrub(-dx / layout.viewport().width);
+    }
+
+    // Pan the values of the plot the drag started on
+    if (dy != 0.0 && _drag_variable) {
+        float dv = dy / _drag_variable->y_per_v;
+        _drag_variable->v_lim_lower += dv;
+        _drag_variable->v_lim_upper += dv;
+        _drag_variable->autoscaler.reset();
+    }
 }
 
 //--------------------------------------------------------------
 void ofApp::mousePressed(int x, int y, int button)
 {
+    _mouse_pressed_at = ofPoint(x, y);
+    _mouse_dragged_at = ofPoint(x, y);
+    _drag_variable = (view_mode == VIEW_TRACES) ? layout.visible_at(y) : nullptr;
+    _drag_axis = DRAG_UNDECIDED;
 }
 
 //--------------------------------------------------------------
 void ofApp::mouseReleased(int x, int y, int button)
 {
+    // A click (not a camera drag) on the morphology selects the segment
+    // and scrolls the plot of its variable into view
+    bool is_click = std::abs(x - _mouse_pressed_at.x) < CLICK_DISTANCE
+                    && std::abs(y - _mouse_pressed_at.y) < CLICK_DISTANCE;
+    if (view_mode != VIEW_MORPHOLOGY || button != OF_MOUSE_BUTTON_LEFT || !is_click) {
+        return;
+    }
+
+    uint32_t point;
+    if (!morphology_view.pick(camera, ofGetCurrentViewport(), x, y, point)) {
+        morphology_selection.clear();
+        return;
+    }
+    morphology_selection = "SWC sample " + ofToString(morphology.swc_id[point]);
+
+    auto it = _segment_variable.find(point);
+    if (it != _segment_variable.end() && variables.count(it->second) > 0) {
+        GraphedVariable* variable = variables[it->second].get();
+        morphology_selection += ": " + variable->name;
+        layout.scroll_to_variable(variable);
+    }
+    DBGMSG(std::cerr, "Picked " << morphology_selection);
+}
+
+//--------------------------------------------------------------
+void ofApp::mouseScrolled(int x, int y, float scrollX, float scrollY)
+{
+    // Ctrl + wheel zooms time, shift + wheel the values under the mouse
+    float factor = std::pow(ZOOM_STEP, scrollY);
+    bool zoom_time = ofGetKeyPressed(OF_KEY_CONTROL);
+    if (view_mode == VIEW_RASTER && zoom_time) {
+        raster.x_per_t = ofClamp(raster.x_per_t * factor, X_PER_T_MIN, X_PER_T_MAX);
+    }
+    if (view_mode != VIEW_TRACES) {
+        return;
+    }
+    if (zoom_time) {
+        _zoom_time(factor, x);
+    } else if (ofGetKeyPressed(OF_KEY_SHIFT)) {
+        GraphedVariable* variable = layout.visible_at(y);
+        if (variable) {
+            _zoom_value(*variable, factor, y);
+        }
+    } else {
+        layout.scroll_by(-20 * scrollY);
+    }
 }
 
 //--------------------------------------------------------------
@@ -350,8 +1504,18 @@ void ofApp::mouseExited(int x, int y)
 }
 
 //--------------------------------------------------------------
+/**
+ * Window resized: only noted here and applied in the next update(), so
+ * that a stream of resize events costs one relayout per frame.
+ *
+ * The plots keep their time scale (x_per_t) and get a wider or narrower
+ * time window, so cached decimated traces stay valid. Nothing else
+ * depends on the window size: the other views are laid out every frame,
+ * and the ingest thread is not involved at all.
+ */
 void ofApp::windowResized(int w, int h)
 {
+    _resize_pending = true;
 }
 
 //--------------------------------------------------------------
@@ -4,6 +4,29 @@
 #include "ofMain.h"
 #include "ofxMidi.h"
 #include "zmq.hpp"
+#include "SampleBuffer.h"
+#include "SampleReceiver.h"
+#include "CompressedHistory.h"
+#include "HistoryCompressor.h"
+#include "VariableConfig.h"
+#include "PlotLayout.h"
+#include "SpikeStore.h"
+#include "RasterView.h"
+#include "HeatmapView.h"
+#include "AxisAutoscaler.h"
+#include "Morphology.h"
+#include "MorphologyView.h"
+#include "SpikeParticles.h"
+#include "CellScene.h"
+#include "MidiEventQueue.h"
+#include "ParameterControl.h"
+#include "PacingController.h"
+#include "ControlLatency.h"
+#include "LatencyHistogram.h"
+#include "SpikeStatistics.h"
+#include "Playhead.h"
+#include "DecimationCache.h"
+#include "SpectrogramView.h"
 
 #define DEBUG 1
 #define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
@@ -19,6 +42,24 @@
 
 class GraphedVariable;
 
+// What is shown in the plotting area
+enum view_mode_t {
+    VIEW_TRACES,   // one line graph per variable
+    VIEW_RASTER,   // spike raster of all cells
+    VIEW_HEATMAP,  // one heatmap row per variable
+    VIEW_MORPHOLOGY, // 3D cell morphology
+    VIEW_SCENE,    // 3D scene of many cells
+    VIEW_SPECTROGRAM, // power spectra of one variable over time
+};
+
+// Direction a drag on the traces is locked to, after its first move
+// beyond the click distance
+enum drag_axis_t {
+    DRAG_UNDECIDED,
+    DRAG_TIME,  // horizontal: pan in time
+    DRAG_VALUE, // vertical: pan the values of one plot
+};
+
 /**
  * Our OpenFrameworks applications where all the magic happens.
  */
@@ -26,13 +67,24 @@ class ofApp : public ofBaseApp, public ofxMidiListener
 {
 
   public:
-    ofApp(std::string config_path) :
+    ofApp(std::string config_path, std::string morphology_path = "") :
         config_file(config_path),
+        morphology_file(morphology_path),
+        view_mode(VIEW_TRACES),
+        spectrogram_variable(-1),
+        midi_freeze_note(-1),
+        midi_freeze_cc(-1),
+        show_stats(false),
+        show_spike_stats(true),
+        _drag_variable(nullptr),
+        _drag_axis(DRAG_UNDECIDED),
+        _resize_pending(false),
         LOG_PREFIX("\n[NeuroControl]: ") {}
 
     void setup();
     void update();
     void draw();
+    void exit();
 
     void keyPressed(int key);
     void keyReleased(int key);
@@ -40,6 +92,7 @@ class ofApp : public ofBaseApp, public ofxMidiListener
     void mouseDragged(int x, int y, int button);
     void mousePressed(int x, int y, int button);
     void mouseReleased(int x, int y, int button);
+    void mouseScrolled(int x, int y, float scrollX, float scrollY);
     void mouseEntered(int x, int y);
     void mouseExited(int x, int y);
     void windowResized(int w, int h);
@@ -47,8 +100,26 @@ class ofApp : public ofBaseApp, public ofxMidiListener
     void gotMessage(ofMessage msg);
 
     // Supporting methods
-    void add_graphed_var(string var_name, ofPoint ax_origin);
+    void add_graphed_var(std::shared_ptr<GraphedVariable> variable);
     int _setup_socket(string protocol, string host, unsigned int port);
+    void _autoscale(GraphedVariable& var, const SampleBuffer::View& view,
+                    uint64_t seq_first);
+    std::string _config_relative(const std::string& path) const;
+    void _look_at(const glm::vec3& center, float extent);
+    void _setup_scene(const cpptoml::table& config);
+    void _set_pacing(bool enabled);
+    void _toggle_freeze();
+    void _toggle_spectrogram();
+    void _invalidate_windows();
+    void _scrub(float fraction);
+    void _build_frozen_trace(GraphedVariable& var);
+    void _build_decimated_trace(GraphedVariable& var, float t_end);
+    bool _decimate(const GraphedVariable& var) const;
+    void _zoom_time(float factor, float x);
+    void _zoom_value(GraphedVariable& var, float factor, float y);
+    void _draw_view();
+    void _draw_stats();
+    void _write_benchmark(const std::string& path);
 
     inline static void sample_to_screen(
         const GraphedVariable &var,
@@ -56,17 +127,62 @@ class ofApp : public ofBaseApp, public ofxMidiListener
         ofPoint &point);
 
     string config_file;
+    string morphology_file; // overrides [morphology] file if not empty
 
     // We need one polyline per graphed variable
     // vector<GraphedVar> variables;
     map<unsigned int, std::shared_ptr<GraphedVariable>> variables;
+    PlotLayout layout; // display order and screen positions of variables
+
+    view_mode_t view_mode;
+
+    // Right edge of the scrolling views: live, or frozen for rewinding
+    Playhead playhead;
+
+    // Spike events of all cells, published and detected, shown as
+    // raster instead of traces
+    spike_stores_t spikes;
+    RasterView raster;
+
+    // Heatmap of all variables, for many compartments
+    HeatmapView heatmap;
+
+    // Spectrogram of one variable, computed only while shown
+    SpectrogramView spectrogram;
+    int64_t spectrogram_variable; // id (-1 for the first variable shown)
+
+    // Cell morphology (empty if none configured)
+    Morphology morphology;
+    MorphologyView morphology_view;
+    ofEasyCam camera; // for 3D views, mouse input only while shown
+    std::string morphology_selection; // picked segment, shown in 3D view
+    SpikeParticles spike_particles; // bursts at the soma/axon on spikes
+
+    // Firing rates and ISIs per gid, shown next to the plot of that id
+    SpikeStatistics spike_stats;
+
+    // Many cells sharing morphology templates (empty if none configured)
+    CellScene scene;
     float max_time;     // maximum timepoint received for any variable
 
     // MIDI communication
     ofxMidiIn midiIn;
-    ofxMidiMessage midiMessage;
+    MidiEventQueue midi_events; // from the MIDI input thread
+    int midi_freeze_note; // note toggling freeze (-1 for none)
+    int midi_freeze_cc;   // button (CC) toggling freeze (-1 for none)
     void newMidiMessage(ofxMidiMessage& eventArgs);
 
+    // Latency from MIDI event to drawn effect, frame times
+    ControlLatency control_latency;
+    LatencyHistogram frame_times;
+    bool show_stats;            // overlay toggled with 's'
+    bool show_spike_stats;      // rates next to plots, toggled with 'i'
+    std::string benchmark_file; // stats written on exit (if not empty)
+
+    // Simulated time per wall time, kept at a target by rate commands
+    PacingController pacing;
+    std::string pacing_parameter; // rate limit parameter of the simulator
+
   private:
 
     // Socket communication
@@ -78,27 +194,59 @@ class ofApp : public ofBaseApp, public ofxMidiListener
     // zmq::context_t context;
     // zmq::socket_t subscriber;
 
-    const std::string LOG_PREFIX;
-};
+    // Parameters set with MIDI controllers, sent back to the simulator
+    // (declared after the context: its socket must be closed first)
+    std::unique_ptr<ParameterControl> _p_control;
 
+    // Ingest thread that owns the socket once started
+    std::unique_ptr<SampleReceiver> _p_receiver;
 
-typedef struct {
-    double gid;
-    double t;
-    double v;
-} sample_t;
+    // Compresses history of long-retention variables (if any)
+    std::unique_ptr<HistoryCompressor> _p_compressor;
+
+    // Variables discovered by the ingest thread, reused every update
+    std::vector<discovered_var_t> _discovered;
+
+    // MIDI events taken from the queue, reused every update
+    std::vector<midi_event_t> _midi_drained;
+
+    // Samples read from compressed history while frozen, reused every frame
+    std::vector<trace_point_t> _history_points;
+
+    // Min/max per pixel column of zoomed out traces, reused every frame
+    std::vector<minmax_bucket_t> _buckets;
+
+    // Variable shown on each morphology segment (point index -> gid)
+    std::unordered_map<uint32_t, unsigned int> _segment_variable;
+    ofPoint _mouse_pressed_at; // to tell clicks from camera drags
+    ofPoint _mouse_dragged_at; // last position while panning plots
+    GraphedVariable* _drag_variable; // plot panned in value (or nullptr)
+    drag_axis_t _drag_axis;
+    bool _resize_pending; // window resized since the last update()
+    view_mode_t _camera_view;  // 3D view the camera was last pointed for
+
+    const std::string LOG_PREFIX;
+};
 
 
 // A graphed variable.
 // Its responsibilities are data storage for the incoming signal samples
 // and storing plotting options.
-// The signal samples are contained in GraphedVar.samples.
+// The signal samples are contained in GraphedVar.samples, which is written
+// by the ingest thread and only read here through lock-free snapshots.
 // The sample time and value are denoted as t, v and the screen positions
 // as x, y.
 class GraphedVariable
 {
   public:
-    GraphedVariable(unsigned int id, std::string varname) :
+    GraphedVariable(unsigned int id, std::string varname,
+                    size_t buffer_capacity = DEFAULT_BUFFER_CAPACITY) :
+        GraphedVariable(id, varname,
+                        std::make_shared<SampleBuffer>(buffer_capacity)) {}
+
+    GraphedVariable(unsigned int id, std::string varname,
+                    std::shared_ptr<SampleBuffer> buffer) :
+        samples(buffer),
         name(varname),
         id(id),
         ax_origin(0.0, 0.0),
@@ -112,12 +260,10 @@ class GraphedVariable
         v_lim_upper(40.0),
         v_lim_lower(-80.0),
         t_lim_lower(0.0),
+        seq_first_visible(0),
+        auto_discovered(false),
         tmax_last_update(0.0)
     {
-        // samples = new std::deque<ofPoint>({ofPoint(0.0)});
-        samples = std::unique_ptr<std::deque<ofPoint>>(
-                 new std::deque<ofPoint>({ofPoint(0.0, 0.0)}));
-
         tsys_last_update = ofGetElapsedTimeMillis();
     }
 
@@ -125,8 +271,30 @@ class GraphedVariable
         return (v_lim_upper - v_lim_lower) * y_per_v;
     }
 
-    // std::deque<ofPoint> * samples;
-    std::unique_ptr<std::deque<ofPoint>> samples;
+    /**
+     * Let the value axis follow the visible samples. The plot keeps
+     * its current height: y_per_v changes with the limits instead.
+     */
+    void enable_autoscale() {
+        y_height = y_height_max();
+        autoscaler = std::make_unique<AxisAutoscaler>();
+    }
+
+    std::shared_ptr<SampleBuffer> samples;
+
+    // Older samples in compressed form (nullptr if history is not retained)
+    std::shared_ptr<CompressedHistory> history;
+
+    // Min/max of the plotting range (nullptr if limits are fixed)
+    std::unique_ptr<AxisAutoscaler> autoscaler;
+
+    // Screen geometry of the visible samples, rebuilt every frame.
+    // Only allocated once the variable is first visible.
+    std::unique_ptr<ofPolyline> trace;
+
+    // Min/max of samples per pixel column for recent zoom levels.
+    // Only allocated once zoomed out to many samples per pixel.
+    std::unique_ptr<DecimationCache> decimation;
 
     // Variable metadata
     string name;
@@ -136,7 +304,7 @@ class GraphedVariable
     ofPoint ax_origin;
 
     // Size and dimensions
-    float y_height;
+    float y_height;     // [pixels] plot height if autoscaled
     float y_per_v;
     float x_per_t;
     float x_width_max; // max pixel width of all graphs showing t
@@ -151,6 +319,8 @@ class GraphedVariable
     float v_lim_lower;
 
     float t_lim_lower; // constantly updated, determines apparent scroll speed
+    uint64_t seq_first_visible; // sequence number of oldest sample in plotting range
+    bool auto_discovered; // not in config, created when first sample arrived
     float tmax_last_update; // [ms] time of most recent sample in last update
     uint64_t tsys_last_update; // [ms] system time of last update
 };
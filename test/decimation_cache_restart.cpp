@@ -0,0 +1,100 @@
+// DecimationCache against a brute-force min/max of the samples, while a
+// run grows and after the simulation restarted (time goes back): the
+// buckets of the previous run must not be shown, neither from the cache
+// nor from the samples of that run still in the ring buffer.
+
+#include "DecimationCache.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+
+namespace {
+
+const float DT = 2.0;          // [ms] bucket width
+const float SAMPLE_DT = 0.5;   // [ms]
+
+// Buckets of [t_begin, t_end] from the samples of the current run
+std::vector<minmax_bucket_t> brute_force(const std::vector<trace_point_t>& run,
+                                         int64_t k_begin, size_t num_buckets)
+{
+    std::vector<minmax_bucket_t> out(num_buckets, minmax_bucket_t{0.0f, 0.0f, 0});
+    for (const trace_point_t& pt : run) {
+        int64_t i = (int64_t) std::floor(pt.t / DT) - k_begin;
+        if (i < 0 || i >= (int64_t) num_buckets) {
+            continue;
+        }
+        minmax_bucket_t& b = out[i];
+        b.v_min = (b.count == 0) ? pt.v : std::min(b.v_min, pt.v);
+        b.v_max = (b.count == 0) ? pt.v : std::max(b.v_max, pt.v);
+        b.count++;
+    }
+    return out;
+}
+
+
+int check(const char* name, DecimationCache& cache, const SampleBuffer& ring,
+          const std::vector<trace_point_t>& run, float t_begin, float t_end)
+{
+    std::vector<minmax_bucket_t> got;
+    int64_t k_begin = cache.query(ring, nullptr, DT, t_begin, t_end, got);
+    std::vector<minmax_bucket_t> expected = brute_force(run, k_begin, got.size());
+    int num_errors = 0;
+    for (size_t i = 0; i < got.size(); i++) {
+        if (got[i].count != expected[i].count || got[i].v_min != expected[i].v_min
+                                              || got[i].v_max != expected[i].v_max) {
+            if (num_errors < 3) {
+                std::printf("%s: bucket %lld has %u samples in [%g, %g], expected "
+                            "%u in [%g, %g]\n", name, (long long) (k_begin + i),
+                            got[i].count, got[i].v_min, got[i].v_max, expected[i].count,
+                            expected[i].v_min, expected[i].v_max);
+            }
+            num_errors++;
+        }
+    }
+    return num_errors;
+}
+
+
+// Append samples of a run up to t_end, value depending on the run
+void grow(SampleBuffer& ring, std::vector<trace_point_t>& run, float t_end, float offset)
+{
+    std::vector<trace_point_t> batch;
+    float t = run.empty() ? 0.0f : run.back().t + SAMPLE_DT;
+    for (; t < t_end; t += SAMPLE_DT) {
+        trace_point_t pt = {t, offset + std::sin(0.01f * t)};
+        batch.push_back(pt);
+        run.push_back(pt);
+    }
+    ring.push(batch.data(), batch.size());
+}
+
+} // namespace
+
+
+int main()
+{
+    SampleBuffer ring(1 << 16);
+    DecimationCache cache;
+    int num_errors = 0;
+
+    // First run, queried while it grows, at two zooms
+    std::vector<trace_point_t> run;
+    for (float t = 1000.0; t <= 8000.0; t += 1000.0) {
+        grow(ring, run, t, 100.0);
+        num_errors += check("first run", cache, ring, run, 0.0, 1000.0);
+        num_errors += check("first run", cache, ring, run, t - 1000.0, t);
+    }
+
+    // Restart: shorter than the cached run, then past its end
+    run.clear();
+    for (float t = 500.0; t <= 10000.0; t += 500.0) {
+        grow(ring, run, t, -100.0);
+        num_errors += check("restarted", cache, ring, run, 0.0, 1000.0);
+        num_errors += check("restarted", cache, ring, run, t - 1000.0, t);
+    }
+
+    std::printf("decimation: %zu levels, %d errors\n", cache.num_levels(), num_errors);
+    return (num_errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+// Round trip of the CompressedHistory block codec, and of read() over
+// many blocks against a brute-force filter of the appended samples.
+//
+// The codec must be lossless: decoded times and values are compared by
+// their bit patterns, for regular and jittered time steps, smooth and
+// random values, repeated values, signed zeros and non-finite values.
+// After a restart of the simulation (time goes back), read() must only
+// return samples of the new run.
+
+#include "CompressedHistory.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+
+namespace {
+
+uint32_t bits_of(float x)
+{
+    uint32_t b;
+    std::memcpy(&b, &x, sizeof(b));
+    return b;
+}
+
+
+int check_round_trip(const char* name, const std::vector<trace_point_t>& points)
+{
+    std::vector<uint64_t> bits;
+    CompressedHistory::encode_block(points.data(), points.size(), bits);
+    std::vector<trace_point_t> decoded(points.size());
+    CompressedHistory::decode_block(bits, points.size(), decoded.data());
+
+    int num_errors = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (bits_of(decoded[i].t) != bits_of(points[i].t)
+                || bits_of(decoded[i].v) != bits_of(points[i].v)) {
+            if (num_errors < 5) {
+                std::printf("%s: sample %zu is (%g, %g), expected (%g, %g)\n", name, i,
+                            decoded[i].t, decoded[i].v, points[i].t, points[i].v);
+            }
+            num_errors++;
+        }
+    }
+    std::printf("%-20s %5zu samples, %6.2f bits/sample, %d errors\n", name,
+                points.size(), 64.0 * bits.size() / points.size(), num_errors);
+    return num_errors;
+}
+
+} // namespace
+
+
+int main()
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(-100.0, 100.0);
+    const size_t n = HISTORY_BLOCK_SAMPLES;
+    int num_errors = 0;
+
+    std::vector<trace_point_t> points(n);
+    for (size_t i = 0; i < n; i++) {
+        points[i] = {0.025f * i, -65.0f + 30.0f * std::sin(0.01f * i)};
+    }
+    num_errors += check_round_trip("regular, smooth", points);
+
+    for (size_t i = 0; i < n; i++) {
+        points[i] = {1000.0f + 0.025f * i + 0.001f * (rng() % 7), uniform(rng)};
+    }
+    num_errors += check_round_trip("jittered, random", points);
+
+    // Like NEURON: computed in double, published as float
+    for (size_t i = 0; i < n; i++) {
+        double t = 5000.0 + 0.025 * i;
+        points[i] = {(float) t, (float) (-65.0 + 20.0 * std::exp(-0.002 * i)
+                                         * std::cos(0.03 * i))};
+    }
+    num_errors += check_round_trip("simulated", points);
+
+    for (size_t i = 0; i < n; i++) {
+        points[i] = {(float) i, (i % 100 < 50) ? -65.0f : 20.0f};
+    }
+    num_errors += check_round_trip("steps", points);
+
+    const float special[] = {0.0f, -0.0f, std::numeric_limits<float>::infinity(),
+                             -std::numeric_limits<float>::infinity(),
+                             std::numeric_limits<float>::quiet_NaN(),
+                             std::numeric_limits<float>::denorm_min(),
+                             std::numeric_limits<float>::max(), 1.0f};
+    for (size_t i = 0; i < n; i++) {
+        points[i] = {(i % 3 == 0) ? 1e30f * i : 0.5f * i, special[rng() % 8]};
+    }
+    num_errors += check_round_trip("special values", points);
+
+    num_errors += check_round_trip("single sample",
+                                   std::vector<trace_point_t>(1, trace_point_t{3.0f, 4.0f}));
+
+    // read() over many blocks, retention limited to 32 blocks
+    CompressedHistory history(32 * n);
+    std::vector<trace_point_t> all;
+    for (size_t block = 0; block < 100; block++) {
+        std::vector<trace_point_t> samples(n);
+        for (size_t i = 0; i < n; i++) {
+            size_t k = block * n + i;
+            samples[i] = {0.1f * k, uniform(rng)};
+        }
+        history.append(block * n, samples.data(), n);
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    float t_oldest = history.t_oldest();
+    int read_errors = 0;
+    for (int query = 0; query < 1000; query++) {
+        float t_begin = 0.1f * (rng() % (100 * n));
+        float t_end = t_begin + 0.1f * (rng() % (4 * n));
+        std::vector<trace_point_t> got;
+        history.read(t_begin, t_end, got);
+        std::vector<trace_point_t> expected;
+        for (const trace_point_t& pt : all) {
+            if (pt.t >= t_oldest && pt.t >= t_begin && pt.t < t_end) {
+                expected.push_back(pt);
+            }
+        }
+        if (got.size() != expected.size()
+                || std::memcmp(got.data(), expected.data(),
+                               got.size() * sizeof(trace_point_t)) != 0) {
+            if (read_errors < 5) {
+                std::printf("read [%g, %g): %zu samples, expected %zu\n",
+                            t_begin, t_end, got.size(), expected.size());
+            }
+            read_errors++;
+        }
+    }
+    std::printf("read: %zu blocks retained, 1000 queries, %d errors\n",
+                history.num_samples() / n, read_errors);
+    num_errors += read_errors;
+
+    // Restart in the middle of a block, then whole blocks of the new run
+    std::vector<trace_point_t> restart(n);
+    for (size_t i = 0; i < n; i++) {
+        float t = (i < n / 2) ? 0.1f * (100 * n + i) : 0.1f * (i - n / 2);
+        restart[i] = {t, 1.0f};
+    }
+    history.append(100 * n, restart.data(), n);
+    for (size_t block = 1; block < 3; block++) {
+        for (size_t i = 0; i < n; i++) {
+            restart[i] = {0.1f * (block * n + i - n / 2), 2.0f};
+        }
+        history.append((100 + block) * n, restart.data(), n);
+    }
+    std::vector<trace_point_t> got;
+    history.read(0.0, 1e9, got);
+    bool new_run_only = got.size() == history.num_samples()
+                        && got.size() == 2 * n + n / 2 && got.front().t == 0.0f;
+    std::printf("restart: %zu samples retained, %zu read%s\n", history.num_samples(),
+                got.size(), new_run_only ? "" : ", expected only the new run");
+    num_errors += !new_run_only;
+
+    return (num_errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+// Stress test of SnapshotRing: one writer, one concurrent reader.
+//
+// The writer pushes samples whose time and value are both derived from
+// their sequence number, in batches of varying size (some larger than
+// the ring), into a small ring so that the reader is overwritten often.
+// The reader checks that every element it reads and that validate()
+// reports as intact belongs to its sequence number (no torn (t, v)
+// pairs, no stale slots), and that snapshots never go backwards.
+//
+// Build with -fsanitize=thread (make tsan) to check for data races.
+
+#include "SampleBuffer.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+const size_t RING_CAPACITY = 1024;
+const uint64_t NUM_SAMPLES = 1 << 23;
+
+// Exact in float for seq < 2^24 (the pattern repeats after that)
+trace_point_t sample_of(uint64_t seq)
+{
+    float t = (float) (seq & 0xffffff);
+    return {t, 0.5f * t + 1.0f};
+}
+
+} // namespace
+
+
+int main()
+{
+    SampleBuffer ring(RING_CAPACITY);
+    std::atomic<bool> done(false);
+
+    std::thread writer([&] {
+        std::vector<trace_point_t> batch;
+        uint64_t seq = 0;
+        size_t batch_size = 1;
+        while (seq < NUM_SAMPLES) {
+            batch.clear();
+            for (size_t i = 0; i < batch_size; i++) {
+                batch.push_back(sample_of(seq + i));
+            }
+            ring.push(batch.data(), batch.size());
+            seq += batch_size;
+            batch_size = (batch_size * 7 + 3) % (3 * RING_CAPACITY) + 1;
+        }
+        done.store(true);
+    });
+
+    uint64_t num_snapshots = 0;
+    uint64_t num_checked = 0;
+    uint64_t num_discarded = 0;
+    uint64_t num_errors = 0;
+    uint64_t seq_end_prev = 0;
+    std::vector<trace_point_t> copy;
+
+    while (!done.load()) {
+        auto view = ring.snapshot();
+        num_snapshots++;
+        if (view.seq_end() < seq_end_prev || view.seq_begin() > view.seq_end()
+                                          || view.size() > ring.capacity()) {
+            std::printf("snapshot [%llu, %llu) after end %llu\n",
+                        (unsigned long long) view.seq_begin(),
+                        (unsigned long long) view.seq_end(),
+                        (unsigned long long) seq_end_prev);
+            num_errors++;
+        }
+        seq_end_prev = view.seq_end();
+
+        // Copy first, then validate, like the render thread
+        copy.clear();
+        for (uint64_t seq = view.seq_begin(); seq < view.seq_end(); seq++) {
+            copy.push_back(view[seq]);
+        }
+        uint64_t seq_intact = view.validate();
+        num_discarded += seq_intact - view.seq_begin();
+
+        for (uint64_t seq = seq_intact; seq < view.seq_end(); seq++) {
+            trace_point_t got = copy[seq - view.seq_begin()];
+            trace_point_t expected = sample_of(seq);
+            if (got.t != expected.t || got.v != expected.v) {
+                if (num_errors < 10) {
+                    std::printf("seq %llu: (%g, %g), expected (%g, %g)\n",
+                                (unsigned long long) seq, got.t, got.v,
+                                expected.t, expected.v);
+                }
+                num_errors++;
+            }
+            num_checked++;
+        }
+    }
+    writer.join();
+
+    std::printf("%llu snapshots, %llu samples checked, %llu discarded as "
+                "overwritten, %llu errors\n",
+                (unsigned long long) num_snapshots, (unsigned long long) num_checked,
+                (unsigned long long) num_discarded, (unsigned long long) num_errors);
+    return (num_errors == 0 && num_checked > 0) ? 0 : 1;
+}
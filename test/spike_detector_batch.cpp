@@ -0,0 +1,115 @@
+// SpikeDetector: SSE2 crossing search against a scalar reference,
+// detection in batches of any size against detection in one batch,
+// restart of the simulation, and throughput of the crossing search.
+
+#include "SpikeDetector.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+
+namespace {
+
+size_t reference_crossings(const std::vector<trace_point_t>& samples, float threshold,
+                           float v_prev, std::vector<uint32_t>& indices)
+{
+    indices.clear();
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (v_prev < threshold && samples[i].v >= threshold) {
+            indices.push_back(i);
+        }
+        v_prev = samples[i].v;
+    }
+    return indices.size();
+}
+
+
+// Voltage-like trace: resting level with spikes every ~10 ms and noise
+std::vector<trace_point_t> make_trace(size_t n, float t0, std::mt19937& rng)
+{
+    std::normal_distribution<float> noise(0.0, 2.0);
+    std::vector<trace_point_t> samples(n);
+    for (size_t i = 0; i < n; i++) {
+        float t = t0 + 0.025f * i;
+        float phase = std::fmod(t, 10.0f);
+        float v = (phase < 1.0f) ? -65.0f + 100.0f * std::sin(3.14159f * phase) : -65.0f;
+        samples[i] = {t, v + noise(rng)};
+    }
+    return samples;
+}
+
+} // namespace
+
+
+int main()
+{
+    std::mt19937 rng(1);
+    int num_errors = 0;
+
+    // Crossing search, all lengths around the 4-wide blocks
+    std::uniform_real_distribution<float> uniform(-2.0, 2.0);
+    std::vector<uint32_t> got, expected;
+    for (int trial = 0; trial < 10000; trial++) {
+        std::vector<trace_point_t> samples(trial % 41);
+        for (size_t i = 0; i < samples.size(); i++) {
+            samples[i] = {(float) i, uniform(rng)};
+        }
+        float v_prev = (trial % 3 == 0) ? NAN : uniform(rng);
+        got.resize(samples.size());
+        size_t n = SpikeDetector::find_crossings(samples.data(), samples.size(), 0.0f,
+                                                 v_prev, got.data());
+        got.resize(n);
+        reference_crossings(samples, 0.0f, v_prev, expected);
+        if (got != expected) {
+            num_errors++;
+        }
+    }
+    std::printf("find_crossings: 10000 random batches, %d mismatches\n", num_errors);
+
+    // Same spikes whatever the batch sizes
+    std::vector<trace_point_t> trace = make_trace(400000, 0.0, rng);
+    std::vector<spike_event_t> whole, batched;
+    SpikeDetector(1).detect(trace.data(), trace.size(), whole);
+    SpikeDetector detector(1);
+    for (size_t i = 0; i < trace.size(); ) {
+        size_t n = std::min<size_t>(rng() % 300, trace.size() - i);
+        detector.detect(trace.data() + i, n, batched);
+        i += n;
+    }
+    bool same = whole.size() == batched.size();
+    for (size_t i = 0; same && i < whole.size(); i++) {
+        same = whole[i].t == batched[i].t && whole[i].gid == batched[i].gid;
+    }
+    std::printf("batches: %zu spikes in one batch, %zu in random batches%s\n",
+                whole.size(), batched.size(), same ? "" : ", MISMATCH");
+    num_errors += !same;
+
+    // Restart: the second run starts at t = 0 again, its first spikes count
+    std::vector<spike_event_t> restarted;
+    std::vector<trace_point_t> run = make_trace(4000, 0.0, rng); // 100 ms
+    SpikeDetector restarting(1);
+    size_t first_run = restarting.detect(run.data(), run.size(), restarted);
+    size_t second_run = restarting.detect(run.data(), run.size(), restarted);
+    std::printf("restart: %zu spikes in the first run, %zu in the second\n",
+                first_run, second_run);
+    num_errors += (second_run != first_run || first_run == 0);
+
+    // Throughput of the crossing search
+    std::vector<uint32_t> indices(trace.size());
+    const int repeat = 200;
+    size_t num_found = 0;
+    auto t_start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) {
+        num_found += SpikeDetector::find_crossings(trace.data(), trace.size(), 0.0f,
+                                                   NAN, indices.data());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                   - t_start).count();
+    std::printf("find_crossings: %.0f M samples/s (%zu crossings)\n",
+                repeat * trace.size() / seconds / 1e6, num_found / repeat);
+
+    return (num_errors == 0) ? 0 : 1;
+}